@@ -56,7 +56,8 @@ int main(int argc, char *argv[])
 	FILE *fout = NULL;
 	unsigned char *source = NULL;
 	unsigned char *dest = NULL;
-	unsigned int len, dlen, outlen;
+	size_t len, dlen, outlen;
+	long size;
 	int retval = EXIT_FAILURE;
 	int res;
 
@@ -86,10 +87,17 @@ int main(int argc, char *argv[])
 
 	fseek(fin, 0, SEEK_END);
 
-	len = ftell(fin);
+	size = ftell(fin);
 
 	fseek(fin, 0, SEEK_SET);
 
+	if (size < 0) {
+		printf_error("unable to get size of input file");
+		goto out;
+	}
+
+	len = (size_t) size;
+
 	if (len < 18) {
 		printf_error("input too small to be gzip");
 		goto out;
@@ -107,29 +115,48 @@ int main(int argc, char *argv[])
 		goto out;
 	}
 
-	/* -- Get decompressed length -- */
+	/* -- Get decompressed length modulo 2^32 -- */
 
 	dlen = read_le32(&source[len - 4]);
 
-	dest = (unsigned char *) malloc(dlen ? dlen : 1);
+	/* -- Decompress data -- */
 
-	if (dest == NULL) {
-		printf_error("not enough memory");
-		goto out;
-	}
+	/*
+	 * If the data does not fit, it may be larger than 4 GB, so we try
+	 * adding multiples of 2^32 to the size, up to the maximum size that
+	 * deflate can expand the input to
+	 */
+	for (;;) {
+		dest = (unsigned char *) malloc(dlen ? dlen : 1);
 
-	/* -- Decompress data -- */
+		if (dest == NULL) {
+			printf_error("not enough memory");
+			goto out;
+		}
+
+		outlen = dlen;
+
+		res = tinf_gzip_uncompress_z(dest, &outlen, source, len);
 
-	outlen = dlen;
+		if (res != TINF_BUF_ERROR || sizeof(size_t) <= 4
+		 || dlen / 1032 > len) {
+			break;
+		}
 
-	res = tinf_gzip_uncompress(dest, &outlen, source, len);
+		free(dest);
+		dest = NULL;
+
+		/* Add in two steps to avoid warning when size_t is 32-bit */
+		dlen += (size_t) 0x80000000;
+		dlen += (size_t) 0x80000000;
+	}
 
 	if ((res != TINF_OK) || (outlen != dlen)) {
 		printf_error("decompression failed");
 		goto out;
 	}
 
-	printf("decompressed %u bytes\n", outlen);
+	printf("decompressed %lu bytes\n", (unsigned long) outlen);
 
 	/* -- Write output -- */
 
@@ -34,6 +34,11 @@
 #define A32_NMAX 5552
 
 unsigned int tinf_adler32(const void *data, unsigned int length)
+{
+	return tinf_adler32_z(data, length);
+}
+
+unsigned int tinf_adler32_z(const void *data, size_t length)
 {
 	const unsigned char *buf = (const unsigned char *) data;
 
@@ -41,7 +46,7 @@ unsigned int tinf_adler32(const void *data, unsigned int length)
 	unsigned int s2 = 0;
 
 	while (length > 0) {
-		int k = length < A32_NMAX ? length : A32_NMAX;
+		int k = length < A32_NMAX ? (int) length : A32_NMAX;
 		int i;
 
 		for (i = k / 16; i; --i, buf += 16) {
@@ -93,3 +98,33 @@ unsigned int tinf_adler32(const void *data, unsigned int length)
 
 	return (s2 << 16) | s1;
 }
+
+unsigned int tinf_adler32_combine(unsigned int adler1, unsigned int adler2,
+                                  size_t length2)
+{
+	unsigned int rem = (unsigned int) (length2 % A32_BASE);
+	unsigned int s1 = adler1 & 0xFFFF;
+	unsigned int s2 = (rem * s1) % A32_BASE;
+
+	/*
+	 * Every byte of the second block adds s1 of the first block to s2,
+	 * and the initial 1 of the second block is already counted in s1
+	 */
+	s1 += (adler2 & 0xFFFF) + A32_BASE - 1;
+	s2 += ((adler1 >> 16) & 0xFFFF) + ((adler2 >> 16) & 0xFFFF) + A32_BASE - rem;
+
+	if (s1 >= A32_BASE) {
+		s1 -= A32_BASE;
+	}
+	if (s1 >= A32_BASE) {
+		s1 -= A32_BASE;
+	}
+	if (s2 >= 2 * A32_BASE) {
+		s2 -= 2 * A32_BASE;
+	}
+	if (s2 >= A32_BASE) {
+		s2 -= A32_BASE;
+	}
+
+	return (s2 << 16) | s1;
+}
@@ -38,10 +38,15 @@ static const unsigned int tinf_crc32tab[16] = {
 };
 
 unsigned int tinf_crc32(const void *data, unsigned int length)
+{
+	return tinf_crc32_z(data, length);
+}
+
+unsigned int tinf_crc32_z(const void *data, size_t length)
 {
 	const unsigned char *buf = (const unsigned char *) data;
 	unsigned int crc = 0xFFFFFFFF;
-	unsigned int i;
+	size_t i;
 
 	if (length == 0) {
 		return 0;
@@ -55,3 +60,41 @@ unsigned int tinf_crc32(const void *data, unsigned int length)
 
 	return crc ^ 0xFFFFFFFF;
 }
+
+/* Multiply polynomials a and b modulo the CRC polynomial (reflected) */
+static unsigned int tinf_crc32_multmodp(unsigned int a, unsigned int b)
+{
+	unsigned int m = 0x80000000;
+	unsigned int p = 0;
+
+	for (;;) {
+		if (a & m) {
+			p ^= b;
+			if ((a & (m - 1)) == 0) {
+				break;
+			}
+		}
+		m >>= 1;
+		b = (b & 1) ? (b >> 1) ^ 0xEDB88320 : b >> 1;
+	}
+
+	return p;
+}
+
+unsigned int tinf_crc32_combine(unsigned int crc1, unsigned int crc2,
+                                size_t length2)
+{
+	unsigned int p = 0x80000000; /* x^0 */
+	unsigned int x = 0x00800000; /* x^8 */
+
+	/* Compute x^(8 * length2) by repeated squaring */
+	while (length2) {
+		if (length2 & 1) {
+			p = tinf_crc32_multmodp(x, p);
+		}
+		x = tinf_crc32_multmodp(x, x);
+		length2 >>= 1;
+	}
+
+	return tinf_crc32_multmodp(p, crc1) ^ crc2;
+}
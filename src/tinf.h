@@ -26,6 +26,8 @@
 #ifndef TINF_H_INCLUDED
 #define TINF_H_INCLUDED
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -49,11 +51,270 @@ extern "C" {
  * @see tinf_uncompress, tinf_gzip_uncompress, tinf_zlib_uncompress
  */
 typedef enum {
-	TINF_OK         = 0,  /**< Success */
-	TINF_DATA_ERROR = -3, /**< Input error */
-	TINF_BUF_ERROR  = -5  /**< Not enough room for output */
+	TINF_OK          = 0,  /**< Success */
+	TINF_MORE        = 2,  /**< More work to do, see `tinf_stream_step()` */
+	TINF_DATA_ERROR  = -3, /**< Input error */
+	TINF_MEM_ERROR   = -4, /**< Out of memory */
+	TINF_BUF_ERROR   = -5, /**< Not enough room for output */
+	TINF_LIMIT_ERROR = -6  /**< Decompression limit exceeded */
 } tinf_error_code;
 
+/**
+ * Minimum size of window for decompressing to a sink.
+ *
+ * The window holds 32 KB of history, and room for a match.
+ *
+ * @see tinf_uncompress_sink
+ */
+#define TINF_WINDOW_MIN (32768 + 258)
+
+/**
+ * Sink function called with decompressed data.
+ *
+ * @param arg the `sinkArg` passed to the decompression function
+ * @param data pointer to decompressed data, valid until the function returns
+ * @param length size of data
+ * @return 0 to continue, non-zero to stop with `TINF_BUF_ERROR`
+ */
+typedef int (TINFCC *tinf_sink_func)(void *arg, const unsigned char *data,
+                                     size_t length);
+
+/**
+ * Source function called for more compressed data.
+ *
+ * @param arg the `sourceArg` passed to the decompression function
+ * @param data pointer to variable set to point to the next part of the data,
+ * which must stay valid until the decompression function returns
+ * @return size of next part, 0 at end of data
+ */
+typedef size_t (TINFCC *tinf_source_func)(void *arg,
+                                          const unsigned char **data);
+
+/**
+ * Buffer holding part of the compressed or decompressed data.
+ *
+ * Like `struct iovec`, `base` is not const, but input buffers are only
+ * read from.
+ *
+ * @see tinf_uncompress_iov, tinf_uncompress_to_iov
+ */
+struct tinf_iovec {
+	void *base; /**< Pointer to data */
+	size_t len; /**< Size of data */
+};
+
+/**
+ * Span of decompressed data.
+ *
+ * @see tinf_uncompress_spans
+ */
+struct tinf_span {
+	const unsigned char *data; /**< Pointer to data */
+	size_t len;                /**< Size of data */
+};
+
+/**
+ * Session for decompressing a sequence of messages sharing history.
+ *
+ * The fields are private.
+ *
+ * @see tinf_session_init, tinf_session_uncompress
+ */
+struct tinf_session {
+	unsigned char window[32768]; /**< Last 32 KB of output */
+	size_t have;                 /**< Size of data in `window` */
+};
+
+/**
+ * Preset dictionary for zlib data.
+ *
+ * @see tinf_dict_registry_init, tinf_zlib_uncompress_dict
+ */
+struct tinf_dict {
+	const void *data; /**< Pointer to dictionary */
+	size_t len;       /**< Size of dictionary */
+	unsigned int id;  /**< Adler-32 checksum of dictionary (DICTID) */
+};
+
+/**
+ * Limits on decompression, to stop decompression bombs early.
+ *
+ * A value of 0 means no limit.
+ *
+ * @see tinf_uncompress_limited
+ */
+struct tinf_limits {
+	size_t max_output;      /**< Maximum size of decompressed data */
+	unsigned int max_ratio; /**< Maximum ratio of output to input read */
+	size_t max_symbols;     /**< Maximum number of symbols decoded */
+};
+
+/**
+ * Memory allocator.
+ *
+ * @see tinf_set_allocator
+ */
+struct tinf_allocator {
+	/** Allocate `size` bytes, returns NULL on failure */
+	void *(TINFCC *alloc)(void *opaque, size_t size);
+	/** Resize allocation at `ptr` (or allocate if NULL), like `realloc` */
+	void *(TINFCC *resize)(void *opaque, void *ptr, size_t size);
+	/** Free allocation at `ptr` */
+	void (TINFCC *release)(void *opaque, void *ptr);
+	/** Value passed to the functions */
+	void *opaque;
+};
+
+struct tinf_arena_slab;
+
+/**
+ * Arena handing out memory from slabs, which are freed together.
+ *
+ * The fields are private.
+ *
+ * @see tinf_arena_init
+ */
+struct tinf_arena {
+	struct tinf_arena_slab *slab; /**< Current slab */
+	size_t slab_size;             /**< Minimum size of slabs */
+	int flags;                    /**< Flags given to `tinf_arena_init` */
+};
+
+/**
+ * Back arena slabs by huge pages where supported.
+ *
+ * @see tinf_arena_init
+ */
+#define TINF_ARENA_HUGEPAGES 1
+
+/**
+ * Formats of compressed data.
+ *
+ * @see tinf_batch_uncompress
+ */
+typedef enum {
+	TINF_FORMAT_DEFLATE      = 0, /**< Raw deflate data */
+	TINF_FORMAT_ZLIB         = 1, /**< zlib data */
+	TINF_FORMAT_GZIP         = 2, /**< gzip data */
+	TINF_FORMAT_GZIP_MEMBERS = 3  /**< Concatenated gzip members */
+} tinf_format;
+
+/**
+ * Decode kernels.
+ *
+ * @see tinf_set_kernel
+ */
+typedef enum {
+	TINF_KERNEL_AUTO     = -1, /**< Best kernel supported by the CPU */
+	TINF_KERNEL_PORTABLE = 0,  /**< Portable C */
+	TINF_KERNEL_BMI2     = 1,  /**< Compiled for x86 BMI2 */
+	TINF_KERNEL_AVX2     = 2   /**< Compiled for x86 AVX2 and BMI2 */
+} tinf_kernel;
+
+/**
+ * Decompression job for batch decompression.
+ *
+ * @see tinf_batch_uncompress
+ */
+struct tinf_batch_job {
+	int format;          /**< Format of data (`tinf_format`) */
+	const void *source;  /**< Pointer to compressed data */
+	size_t source_len;   /**< Size of compressed data */
+	void *dest;          /**< Pointer to where to place decompressed data */
+	size_t dest_len;     /**< Size of `dest`, set to size of data on success */
+	int result;          /**< Set to status code of job */
+};
+
+struct tinf_stream;
+
+struct tinf_cache;
+
+/**
+ * Information about an entry in a zip archive.
+ *
+ * @see tinf_zip_read_directory
+ */
+struct tinf_zip_entry {
+	const unsigned char *name; /**< Name of entry (not zero-terminated) */
+	unsigned int name_len;     /**< Length of name */
+	unsigned int flags;        /**< General purpose bit flags */
+	unsigned int method;       /**< Method (0 = stored, 8 = deflate) */
+	unsigned int crc32;        /**< CRC32 checksum of data */
+	size_t compressed_size;    /**< Size of compressed data */
+	size_t size;               /**< Size of data */
+	size_t offset;             /**< Offset of local header */
+};
+
+/**
+ * Set allocator used for memory allocated by tinf.
+ *
+ * The default uses `malloc`, `realloc` and `free`. The allocator is shared
+ * by all threads, including the threads of the parallel functions, so it
+ * must be thread-safe, and should be set before other functions are used.
+ *
+ * @param allocator pointer to allocator, which is copied, or NULL to
+ * restore the default
+ */
+void TINFCC tinf_set_allocator(const struct tinf_allocator *allocator);
+
+/**
+ * Select the kernel used to decode compressed blocks.
+ *
+ * The kernels other than `TINF_KERNEL_PORTABLE` are only built with the
+ * fast engine on x86 with GCC or Clang, where the best one the CPU supports
+ * is selected when the program is loaded. All kernels produce the same
+ * output, so this is mainly for testing and benchmarking. The kernel is
+ * shared by all threads, and should be set before other functions are used.
+ *
+ * @param kernel kernel to use, or `TINF_KERNEL_AUTO` for the best one
+ * @return kernel selected, `TINF_KERNEL_PORTABLE` if `kernel` is not
+ * available
+ */
+int TINFCC tinf_set_kernel(int kernel);
+
+/**
+ * Initialize `arena` with slabs of at least `slabSize` bytes.
+ *
+ * An arena is not thread-safe, and is meant to be used for one request at
+ * a time, where everything is freed together with `tinf_arena_reset()`.
+ * Freeing and resizing individual allocations only reclaims memory for the
+ * most recent one, which makes a growing output buffer cheap.
+ *
+ * With `TINF_ARENA_HUGEPAGES`, slabs are allocated with `mmap` and rounded
+ * up to 2 MB, and huge pages are requested with `madvise`. Otherwise, or
+ * where this is not supported, slabs are allocated with `malloc`, so an
+ * arena can itself be set with `tinf_set_allocator()`.
+ *
+ * @param arena pointer to arena
+ * @param slabSize minimum size of slabs
+ * @param flags 0 or `TINF_ARENA_HUGEPAGES`
+ */
+void TINFCC tinf_arena_init(struct tinf_arena *arena, size_t slabSize,
+                            int flags);
+
+/**
+ * Set up `allocator` to allocate from `arena`.
+ *
+ * @param arena pointer to arena
+ * @param allocator pointer to allocator to set up
+ */
+void TINFCC tinf_arena_allocator(struct tinf_arena *arena,
+                                 struct tinf_allocator *allocator);
+
+/**
+ * Free all allocations from `arena`, keeping the current slab for reuse.
+ *
+ * @param arena pointer to arena
+ */
+void TINFCC tinf_arena_reset(struct tinf_arena *arena);
+
+/**
+ * Free all memory used by `arena`.
+ *
+ * @param arena pointer to arena
+ */
+void TINFCC tinf_arena_destroy(struct tinf_arena *arena);
+
 /**
  * Initialize global data used by tinf.
  *
@@ -79,6 +340,507 @@ void TINFCC tinf_init(void);
 int TINFCC tinf_uncompress(void *dest, unsigned int *destLen,
                            const void *source, unsigned int sourceLen);
 
+/**
+ * Decompress `sourceLen` bytes of deflate data from `source` to `dest`.
+ *
+ * Same as `tinf_uncompress`, but with sizes of type `size_t`, which allows
+ * data larger than 4 GB on 64-bit platforms.
+ *
+ * @see tinf_uncompress
+ *
+ * @param dest pointer to where to place decompressed data
+ * @param destLen pointer to variable containing size of `dest`
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_uncompress_z(void *dest, size_t *destLen,
+                             const void *source, size_t sourceLen);
+
+/**
+ * Number of bytes after the input that `tinf_uncompress_padded` may read.
+ */
+#define TINF_PADDING 16
+
+/**
+ * Decompress `sourceLen` bytes of deflate data from padded `source` to
+ * `dest`.
+ *
+ * Same as `tinf_uncompress_z`, but the caller guarantees that at least
+ * `TINF_PADDING` bytes after the end of `source` can be read. Their values
+ * do not matter. Input is then read four bytes at a time without checking
+ * for the end of each byte, and reading past the end is found from the
+ * position in the input after each symbol.
+ *
+ * @see tinf_uncompress_z
+ *
+ * @param dest pointer to where to place decompressed data
+ * @param destLen pointer to variable containing size of `dest`
+ * @param source pointer to compressed data, followed by `TINF_PADDING`
+ * readable bytes
+ * @param sourceLen size of compressed data, not counting the padding
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_uncompress_padded(void *dest, size_t *destLen,
+                                  const void *source, size_t sourceLen);
+
+/**
+ * Number of bytes after the output that `tinf_uncompress_slop` may write.
+ */
+#define TINF_SLOP 32
+
+/**
+ * Decompress `sourceLen` bytes of deflate data from `source` to `dest`,
+ * which is followed by slop.
+ *
+ * Same as `tinf_uncompress_z`, but the caller guarantees that at least
+ * `TINF_SLOP` bytes after the end of `dest` can be written, and their
+ * contents may be overwritten. The output and its size are the same, but
+ * the fast engine can then copy matches with wide stores up to the end of
+ * `dest` rather than a byte at a time. The small engine does not use the
+ * slop.
+ *
+ * @see tinf_uncompress_z
+ *
+ * @param dest pointer to where to place decompressed data, followed by
+ * `TINF_SLOP` writable bytes
+ * @param destLen pointer to variable containing size of `dest`, not
+ * counting the slop
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_uncompress_slop(void *dest, size_t *destLen,
+                                const void *source, size_t sourceLen);
+
+/**
+ * Decompress deflate data from `source` to `dest`, stopping at a sync point.
+ *
+ * A sync point is an empty non-final uncompressed block, as written by a
+ * zlib full or sync flush. Decompression stops after the first sync point
+ * that ends at or after `syncOffset` bytes of input, or after the final
+ * block.
+ *
+ * The variable `destLen` points to must contain the size of `dest` on entry,
+ * and will be set to the size of the decompressed data on success.
+ *
+ * The variable `sourceLen` points to must contain the size of `source` on
+ * entry, and will be set to the number of bytes consumed on success.
+ *
+ * Since the output starts with an empty history, a segment starting at a
+ * sync point written by a full flush can be decompressed independently.
+ *
+ * @param dest pointer to where to place decompressed data
+ * @param destLen pointer to variable containing size of `dest`
+ * @param source pointer to compressed data
+ * @param sourceLen pointer to variable containing size of `source`
+ * @param syncOffset minimum input offset of sync point to stop at
+ * @param final pointer to variable set to 1 if the final block was reached
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_uncompress_segment(void *dest, size_t *destLen,
+                                   const void *source, size_t *sourceLen,
+                                   size_t syncOffset, int *final);
+
+/**
+ * Decompress deflate data pulled from `source` to `dest`.
+ *
+ * The compressed data does not have to be contiguous. When the bit reader
+ * reaches the end of a part, `source` is called for the next one, so data
+ * received in pieces, for instance network packets, can be decompressed
+ * without first copying it into one buffer. Parts may end anywhere, also
+ * inside a block header or an uncompressed block.
+ *
+ * @param dest pointer to where to place decompressed data
+ * @param destLen pointer to variable containing size of `dest`
+ * @param source function called for compressed data
+ * @param sourceArg value passed to `source`
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_uncompress_source(void *dest, size_t *destLen,
+                                  tinf_source_func source, void *sourceArg);
+
+/**
+ * Decompress deflate data stored in the `iovcnt` buffers of `iov` to `dest`.
+ *
+ * @see tinf_uncompress_source
+ *
+ * @param dest pointer to where to place decompressed data
+ * @param destLen pointer to variable containing size of `dest`
+ * @param iov pointer to array of buffers holding compressed data in order
+ * @param iovcnt number of buffers
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_uncompress_iov(void *dest, size_t *destLen,
+                               const struct tinf_iovec *iov, size_t iovcnt);
+
+/**
+ * Decompress `sourceLen` bytes of deflate data from `source` to `dest`,
+ * describing the output with spans.
+ *
+ * The decompressed data is the concatenation of the spans stored in
+ * `spans`. Uncompressed blocks are not copied, but returned as spans
+ * pointing into `source`, so the bytes of `dest` at their positions are
+ * unspecified; only the part a later compressed block may refer to is
+ * copied. The other spans point into `dest`. `dest` must still have room
+ * for all of the decompressed data. If `spans` runs short, uncompressed
+ * blocks are copied to `dest` instead.
+ *
+ * @param dest pointer to where to place decompressed data
+ * @param destLen pointer to variable containing size of `dest`
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @param spans pointer to array to store spans in
+ * @param spanCount pointer to variable containing the number of entries in
+ * `spans` (at least 1), set to the number of spans used on success
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_uncompress_spans(void *dest, size_t *destLen,
+                                 const void *source, size_t sourceLen,
+                                 struct tinf_span *spans, size_t *spanCount);
+
+/**
+ * Decompress `sourceLen` bytes of gzip data from `source` to `dest`,
+ * describing the output with spans.
+ *
+ * The CRC32 checksum is computed over the spans, so stored data is only
+ * read from `source`.
+ *
+ * @see tinf_uncompress_spans
+ *
+ * @param dest pointer to where to place decompressed data
+ * @param destLen pointer to variable containing size of `dest`
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @param spans pointer to array to store spans in
+ * @param spanCount pointer to variable containing the number of entries in
+ * `spans` (at least 1), set to the number of spans used on success
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_gzip_uncompress_spans(void *dest, size_t *destLen,
+                                      const void *source, size_t sourceLen,
+                                      struct tinf_span *spans,
+                                      size_t *spanCount);
+
+/**
+ * Decompress `sourceLen` bytes of deflate data from `source` to `dest`,
+ * using `dict` as preset dictionary.
+ *
+ * The dictionary acts as output preceding the data, so back-references may
+ * refer to the last 32 KB of it. It is not copied.
+ *
+ * @param dest pointer to where to place decompressed data
+ * @param destLen pointer to variable containing size of `dest`
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @param dict pointer to dictionary
+ * @param dictLen size of dictionary
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_uncompress_dict(void *dest, size_t *destLen,
+                                const void *source, size_t sourceLen,
+                                const void *dict, size_t dictLen);
+
+/**
+ * Set the `id` of each of the `count` dictionaries in `dicts` to its DICTID,
+ * and sort them by it, so they can be used as a registry.
+ *
+ * @see tinf_zlib_uncompress_dict
+ *
+ * @param dicts pointer to array of dictionaries with `data` and `len` set
+ * @param count number of dictionaries
+ */
+void TINFCC tinf_dict_registry_init(struct tinf_dict *dicts, size_t count);
+
+/**
+ * Decompress `sourceLen` bytes of zlib data from `source` to `dest`, using
+ * the preset dictionary from `dicts` with the DICTID in the header.
+ *
+ * `dicts` is a registry set up with `tinf_dict_registry_init()`, and the
+ * dictionary is found with a binary search once per stream. Data without a
+ * preset dictionary is decompressed as by `tinf_zlib_uncompress_z()`.
+ *
+ * @param dest pointer to where to place decompressed data
+ * @param destLen pointer to variable containing size of `dest`
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @param dicts pointer to registry of dictionaries
+ * @param dictCount number of dictionaries
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_zlib_uncompress_dict(void *dest, size_t *destLen,
+                                     const void *source, size_t sourceLen,
+                                     const struct tinf_dict *dicts,
+                                     size_t dictCount);
+
+/**
+ * Decompress `sourceLen` bytes of deflate data at the end of `buf` to the
+ * start of `buf`.
+ *
+ * The output grows towards the compressed data, and is never allowed to
+ * overwrite input that has not been read yet, in which case
+ * `TINF_BUF_ERROR` is returned. `tinf_uncompress_inplace_size()` gives a
+ * size of `buf` that is sufficient.
+ *
+ * @param buf pointer to buffer with compressed data at the end
+ * @param bufLen size of `buf`
+ * @param sourceLen size of compressed data
+ * @param destLen pointer to variable set to the size of the decompressed
+ * data on success
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_uncompress_inplace(void *buf, size_t bufLen,
+                                   size_t sourceLen, size_t *destLen);
+
+/**
+ * Decompress `sourceLen` bytes of deflate data from `source` to `dest`,
+ * and compute the size of buffer needed to decompress it in-place.
+ *
+ * This is intended to be run once where the data is produced, so the size
+ * can be stored with it.
+ *
+ * @see tinf_uncompress_inplace
+ *
+ * @param dest pointer to where to place decompressed data
+ * @param destLen pointer to variable containing size of `dest`
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @param bufLen pointer to variable set to the size of buffer needed
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_uncompress_inplace_size(void *dest, size_t *destLen,
+                                        const void *source, size_t sourceLen,
+                                        size_t *bufLen);
+
+/**
+ * Initialize session `s` with empty history.
+ *
+ * @see tinf_session_uncompress
+ *
+ * @param s pointer to session
+ */
+void TINFCC tinf_session_init(struct tinf_session *s);
+
+/**
+ * Decompress a message of `sourceLen` bytes of deflate data from `source`
+ * to `dest`, as part of session `s`.
+ *
+ * Back-references may refer to the last 32 KB of output of earlier
+ * messages in the session, as with context takeover in WebSocket
+ * permessage-deflate. Each message must end with a sync point (an empty
+ * uncompressed block, `00 00 FF FF`) or a final block, so permessage-deflate
+ * messages need the removed `00 00 FF FF` appended. The history is kept
+ * after a final block. On error, the session should be initialized again.
+ *
+ * @param s pointer to session
+ * @param dest pointer to where to place decompressed data
+ * @param destLen pointer to variable containing size of `dest`
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_session_uncompress(struct tinf_session *s,
+                                   void *dest, size_t *destLen,
+                                   const void *source, size_t sourceLen);
+
+/**
+ * Decompress `sourceLen` bytes of deflate data from `source` to a buffer
+ * allocated with `allocator`.
+ *
+ * The buffer starts at `sizeHint` bytes and is grown geometrically as
+ * needed, so data of unknown size is decompressed in one pass. If the
+ * output would exceed `maxLen` bytes, `TINF_BUF_ERROR` is returned, and if
+ * the allocator fails, `TINF_MEM_ERROR`.
+ *
+ * On success, `*dest` is set to the buffer, which may be larger than the
+ * data, and must be freed with the `release` function of the allocator
+ * (`free()` with the default allocator). On error, `*dest` is set to NULL.
+ *
+ * @param dest pointer to variable set to the buffer
+ * @param destLen pointer to variable set to the size of the decompressed
+ * data on success
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @param sizeHint initial size of buffer, or 0 for a guess
+ * @param maxLen maximum size of decompressed data, or 0 for no limit
+ * @param allocator pointer to allocator, or NULL for the allocator set with
+ * `tinf_set_allocator()`
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_uncompress_alloc(void **dest, size_t *destLen,
+                                 const void *source, size_t sourceLen,
+                                 size_t sizeHint, size_t maxLen,
+                                 const struct tinf_allocator *allocator);
+
+/**
+ * Decompress `sourceLen` bytes of zlib data from `source` to a buffer
+ * allocated with `allocator`.
+ *
+ * @see tinf_uncompress_alloc
+ *
+ * @param dest pointer to variable set to the buffer
+ * @param destLen pointer to variable set to the size of the decompressed
+ * data on success
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @param sizeHint initial size of buffer, or 0 for a guess
+ * @param maxLen maximum size of decompressed data, or 0 for no limit
+ * @param allocator pointer to allocator, or NULL for the allocator set with
+ * `tinf_set_allocator()`
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_zlib_uncompress_alloc(void **dest, size_t *destLen,
+                                      const void *source, size_t sourceLen,
+                                      size_t sizeHint, size_t maxLen,
+                                      const struct tinf_allocator *allocator);
+
+/**
+ * Decompress `sourceLen` bytes of deflate data from `source` to `dest`,
+ * stopping with `TINF_LIMIT_ERROR` if a limit in `limits` is exceeded.
+ *
+ * The output limit is exact. Whichever of the output limit and the size
+ * of `dest` is reached first is reported, `TINF_LIMIT_ERROR` when output
+ * reaches the limit and `TINF_BUF_ERROR` when `dest` fills up first.
+ *
+ * The ratio of output to compressed input read so far, and the number of
+ * literals and matches decoded, are checked every few thousand symbols and
+ * after each block, so they may be exceeded by a small amount before
+ * decompression stops.
+ *
+ * @param dest pointer to where to place decompressed data
+ * @param destLen pointer to variable containing size of `dest`
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @param limits pointer to limits
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_uncompress_limited(void *dest, size_t *destLen,
+                                   const void *source, size_t sourceLen,
+                                   const struct tinf_limits *limits);
+
+/**
+ * Decompress `sourceLen` bytes of gzip data from `source` to `dest`,
+ * within `limits`.
+ *
+ * If the size in the trailer exceeds the output limit, `TINF_LIMIT_ERROR`
+ * is returned before decompressing.
+ *
+ * @see tinf_uncompress_limited
+ *
+ * @param dest pointer to where to place decompressed data
+ * @param destLen pointer to variable containing size of `dest`
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @param limits pointer to limits
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_gzip_uncompress_limited(void *dest, size_t *destLen,
+                                        const void *source, size_t sourceLen,
+                                        const struct tinf_limits *limits);
+
+/**
+ * Decompress `sourceLen` bytes of zlib data from `source` to `dest`,
+ * within `limits`.
+ *
+ * @see tinf_uncompress_limited
+ *
+ * @param dest pointer to where to place decompressed data
+ * @param destLen pointer to variable containing size of `dest`
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @param limits pointer to limits
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_zlib_uncompress_limited(void *dest, size_t *destLen,
+                                        const void *source, size_t sourceLen,
+                                        const struct tinf_limits *limits);
+
+/**
+ * Decompress `sourceLen` bytes of deflate data from `source` to the
+ * `iovcnt` buffers of `iov`.
+ *
+ * The output fills each buffer in turn, so data can be decompressed
+ * directly into a list of pages instead of one contiguous buffer.
+ * Back-references may reach into earlier buffers, which must therefore
+ * stay unchanged until the function returns.
+ *
+ * @param iov pointer to array of buffers to place decompressed data in
+ * @param iovcnt number of buffers
+ * @param destLen pointer to variable set to the total size of the
+ * decompressed data on success
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_uncompress_to_iov(const struct tinf_iovec *iov,
+                                  size_t iovcnt, size_t *destLen,
+                                  const void *source, size_t sourceLen);
+
+/**
+ * Decompress `sourceLen` bytes of deflate data from `source`, passing the
+ * output to `sink` in chunks.
+ *
+ * The output is written to `window`, which must be at least
+ * `TINF_WINDOW_MIN` bytes, and `sink` is called with each filled part of
+ * it. The last 32 KB are kept for back-references, so a larger window
+ * means larger chunks and less copying. The memory used does not depend
+ * on the size of the output, and the data reaches the sink while it is
+ * still in cache.
+ *
+ * @param sink function called with decompressed data
+ * @param sinkArg value passed to `sink`
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @param window pointer to window
+ * @param windowSize size of `window`
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_uncompress_sink(tinf_sink_func sink, void *sinkArg,
+                                const void *source, size_t sourceLen,
+                                void *window, size_t windowSize);
+
+/**
+ * Decompress `sourceLen` bytes of gzip data from `source`, passing the
+ * output to `sink` in chunks.
+ *
+ * The size and CRC32 checksum are checked after all output has been passed
+ * to `sink`, so a consumer must be prepared to discard it on error.
+ *
+ * @see tinf_uncompress_sink
+ *
+ * @param sink function called with decompressed data
+ * @param sinkArg value passed to `sink`
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @param window pointer to window
+ * @param windowSize size of `window`
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_gzip_uncompress_sink(tinf_sink_func sink, void *sinkArg,
+                                     const void *source, size_t sourceLen,
+                                     void *window, size_t windowSize);
+
+/**
+ * Decompress `sourceLen` bytes of zlib data from `source`, passing the
+ * output to `sink` in chunks.
+ *
+ * The Adler-32 checksum is checked after all output has been passed to
+ * `sink`, so a consumer must be prepared to discard it on error.
+ *
+ * @see tinf_uncompress_sink
+ *
+ * @param sink function called with decompressed data
+ * @param sinkArg value passed to `sink`
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @param window pointer to window
+ * @param windowSize size of `window`
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_zlib_uncompress_sink(tinf_sink_func sink, void *sinkArg,
+                                     const void *source, size_t sourceLen,
+                                     void *window, size_t windowSize);
+
 /**
  * Decompress `sourceLen` bytes of gzip data from `source` to `dest`.
  *
@@ -97,6 +859,27 @@ int TINFCC tinf_uncompress(void *dest, unsigned int *destLen,
 int TINFCC tinf_gzip_uncompress(void *dest, unsigned int *destLen,
                                 const void *source, unsigned int sourceLen);
 
+/**
+ * Decompress `sourceLen` bytes of gzip data from `source` to `dest`.
+ *
+ * Same as `tinf_gzip_uncompress`, but with sizes of type `size_t`, which
+ * allows data larger than 4 GB on 64-bit platforms.
+ *
+ * The gzip trailer only stores the size of the data modulo 2^32, so it is
+ * used as a lower bound on the size before decompressing, and checked
+ * modulo 2^32 after.
+ *
+ * @see tinf_gzip_uncompress
+ *
+ * @param dest pointer to where to place decompressed data
+ * @param destLen pointer to variable containing size of `dest`
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_gzip_uncompress_z(void *dest, size_t *destLen,
+                                  const void *source, size_t sourceLen);
+
 /**
  * Decompress `sourceLen` bytes of zlib data from `source` to `dest`.
  *
@@ -115,6 +898,318 @@ int TINFCC tinf_gzip_uncompress(void *dest, unsigned int *destLen,
 int TINFCC tinf_zlib_uncompress(void *dest, unsigned int *destLen,
                                 const void *source, unsigned int sourceLen);
 
+/**
+ * Decompress `sourceLen` bytes of zlib data from `source` to `dest`.
+ *
+ * Same as `tinf_zlib_uncompress`, but with sizes of type `size_t`, which
+ * allows data larger than 4 GB on 64-bit platforms.
+ *
+ * @see tinf_zlib_uncompress
+ *
+ * @param dest pointer to where to place decompressed data
+ * @param destLen pointer to variable containing size of `dest`
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_zlib_uncompress_z(void *dest, size_t *destLen,
+                                  const void *source, size_t sourceLen);
+
+/**
+ * Decompress `sourceLen` bytes of gzip data from `source` to `dest`, using
+ * up to `threads` threads.
+ *
+ * The deflate data is split at sync points written by a full flush, and
+ * the segments are decompressed in parallel. Data without sync points, or
+ * with back-references across them, is decompressed by a single thread.
+ *
+ * @see tinf_gzip_uncompress
+ *
+ * @param dest pointer to where to place decompressed data
+ * @param destLen pointer to variable containing size of `dest`
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @param threads maximum number of threads to use
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_gzip_uncompress_parallel(void *dest, size_t *destLen,
+                                         const void *source, size_t sourceLen,
+                                         int threads);
+
+/**
+ * Decompress `sourceLen` bytes of zlib data from `source` to `dest`, using
+ * up to `threads` threads.
+ *
+ * The deflate data is split at sync points written by a full flush, and
+ * the segments are decompressed in parallel. Data without sync points, or
+ * with back-references across them, is decompressed by a single thread.
+ *
+ * @see tinf_zlib_uncompress
+ *
+ * @param dest pointer to where to place decompressed data
+ * @param destLen pointer to variable containing size of `dest`
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @param threads maximum number of threads to use
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_zlib_uncompress_parallel(void *dest, size_t *destLen,
+                                         const void *source, size_t sourceLen,
+                                         int threads);
+
+/**
+ * Decompress concatenated gzip members from `source` to `dest`, using up to
+ * `threads` threads.
+ *
+ * Members that state their compressed size in a BGZF extra field, as
+ * written by bgzip, are decompressed in parallel. Other members are
+ * decompressed in order by the calling thread.
+ *
+ * On entry, the variable pointed to by `destLen` should contain the size of
+ * `dest`. On success, it is set to the total size of the decompressed data.
+ *
+ * @param dest pointer to where to place decompressed data
+ * @param destLen pointer to variable containing size of `dest`
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @param threads maximum number of threads to use
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_gzip_uncompress_members(void *dest, size_t *destLen,
+                                        const void *source, size_t sourceLen,
+                                        int threads);
+
+/**
+ * Create a cache for the trees of dynamic blocks, which
+ * `tinf_uncompress_cached()` reuses across calls.
+ *
+ * With the fast engine, the trees of the last `TINF_TREE_CACHE` (default 4)
+ * distinct dynamic block headers decoded with the cache are kept with
+ * their lookup tables, so messages compressed with the same settings skip
+ * building them. With the small engine the cache is not used. The cache is
+ * allocated with the allocator set with `tinf_set_allocator()`, and must
+ * be freed with `tinf_cache_destroy()`. It must not be used by more than
+ * one thread at a time.
+ *
+ * @return pointer to cache, NULL if out of memory
+ */
+struct tinf_cache *TINFCC tinf_cache_create(void);
+
+/**
+ * Free cache `cache`.
+ *
+ * @param cache pointer to cache, or NULL
+ */
+void TINFCC tinf_cache_destroy(struct tinf_cache *cache);
+
+/**
+ * Decompress `sourceLen` bytes of data in `format` from `source` to `dest`,
+ * reusing the trees of earlier dynamic blocks kept in `cache`.
+ *
+ * The data is decompressed as by `tinf_uncompress_z`,
+ * `tinf_zlib_uncompress_z` or `tinf_gzip_uncompress_z` depending on
+ * `format`. `TINF_FORMAT_GZIP_MEMBERS` is not supported.
+ *
+ * @param cache pointer to cache
+ * @param format format of data (`tinf_format`)
+ * @param dest pointer to where to place decompressed data
+ * @param destLen pointer to variable containing size of `dest`
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_uncompress_cached(struct tinf_cache *cache, int format,
+                                  void *dest, size_t *destLen,
+                                  const void *source, size_t sourceLen);
+
+/**
+ * Create a stream for decompressing `sourceLen` bytes of data in `format`
+ * from `source` to `dest` a little at a time with `tinf_stream_step()`.
+ *
+ * `TINF_FORMAT_GZIP_MEMBERS` is not supported. The stream is allocated
+ * with the allocator set with `tinf_set_allocator()`, and must be freed
+ * with `tinf_stream_destroy()`. `source` and `dest` must stay valid until
+ * the stream is finished.
+ *
+ * @param format format of data (`tinf_format`)
+ * @param dest pointer to where to place decompressed data
+ * @param destLen size of `dest`
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @return pointer to stream, NULL if out of memory
+ */
+struct tinf_stream *TINFCC tinf_stream_create(int format,
+                                              void *dest, size_t destLen,
+                                              const void *source,
+                                              size_t sourceLen);
+
+/**
+ * Decompress from stream `s` until about `maxOutput` bytes have been
+ * written or `maxSymbols` literals, matches and block headers have been
+ * decoded, so a single-threaded event loop can interleave decompression
+ * with other work.
+ *
+ * Returns `TINF_MORE` if there is more to decompress, and the stream keeps
+ * its state until the next call. A step stops between symbols, so it may
+ * write up to a match (258 bytes) past `maxOutput`, or the rest of an
+ * uncompressed block. When the data is finished, the result is returned as
+ * by the function for `format`, and is returned again on further calls.
+ *
+ * @param s pointer to stream
+ * @param maxOutput number of bytes to write in this step, or 0 for no limit
+ * @param maxSymbols number of symbols to decode in this step, or 0 for no
+ * limit
+ * @param destLen pointer to variable set to the size of the decompressed
+ * data so far
+ * @return `TINF_MORE` if not finished, `TINF_OK` on success, error code on
+ * error
+ */
+int TINFCC tinf_stream_step(struct tinf_stream *s, size_t maxOutput,
+                            size_t maxSymbols, size_t *destLen);
+
+/**
+ * Maximum size of a checkpoint saved with `tinf_stream_save()`.
+ */
+#define TINF_CHECKPOINT_MAX (48 + 160 + 32768 + 4)
+
+/**
+ * Save the state of stream `s` as a checkpoint of up to
+ * `TINF_CHECKPOINT_MAX` bytes, which `tinf_stream_restore()` can continue
+ * from in another process.
+ *
+ * The checkpoint holds the position in the compressed data, including
+ * the bits read ahead, the code lengths of the current block, the checksum
+ * and size of the output so far, and the last 32 KB of output. It is
+ * protected by a CRC32, and is portable between platforms.
+ *
+ * @param s pointer to unfinished stream
+ * @param cp pointer to where to place checkpoint
+ * @param cpLen pointer to variable containing size of `cp`, set to size of
+ * checkpoint on success
+ * @return `TINF_OK` on success, `TINF_BUF_ERROR` if `cp` is too small,
+ * `TINF_DATA_ERROR` if the stream is finished
+ */
+int TINFCC tinf_stream_save(struct tinf_stream *s, void *cp, size_t *cpLen);
+
+/**
+ * Create a stream continuing from checkpoint `cp`, which was saved from a
+ * stream of the same `sourceLen` bytes of data from `source`.
+ *
+ * Output from the checkpoint on is placed in `dest`, so the size reported
+ * by `tinf_stream_step()` is that of the output since the checkpoint. The
+ * checksum is checked over all output at the end. If the checkpoint is
+ * invalid, `TINF_DATA_ERROR` is returned by the first step.
+ *
+ * @param cp pointer to checkpoint
+ * @param cpLen size of checkpoint
+ * @param dest pointer to where to place decompressed data
+ * @param destLen size of `dest`
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @return pointer to stream, NULL if out of memory
+ */
+struct tinf_stream *TINFCC tinf_stream_restore(const void *cp, size_t cpLen,
+                                               void *dest, size_t destLen,
+                                               const void *source,
+                                               size_t sourceLen);
+
+/**
+ * Free stream `s`, which may be unfinished.
+ *
+ * @param s pointer to stream, or NULL
+ */
+void TINFCC tinf_stream_destroy(struct tinf_stream *s);
+
+/**
+ * Decompress `count` independent jobs, using up to `threads` threads.
+ *
+ * Each job is decompressed as by `tinf_uncompress_z`,
+ * `tinf_zlib_uncompress_z`, `tinf_gzip_uncompress_z` or
+ * `tinf_gzip_uncompress_members` depending on its format, and its
+ * `dest_len` and `result` are set accordingly.
+ *
+ * Small jobs are grouped, so there is little overhead per job. Large jobs
+ * are split into subtasks at full flush sync points or gzip members, and
+ * idle threads steal work from busy ones, so a few large jobs mixed with
+ * many small ones do not leave threads idle. The threads are kept in a pool
+ * between calls.
+ *
+ * @param jobs array of jobs
+ * @param count number of jobs
+ * @param threads maximum number of threads to use
+ * @return `TINF_OK` if all jobs succeeded, error code of first failed job
+ * otherwise
+ */
+int TINFCC tinf_batch_uncompress(struct tinf_batch_job *jobs, size_t count,
+                                 int threads);
+
+/**
+ * Read the central directory of the zip archive in `source`.
+ *
+ * The variable `count` points to must contain the number of elements in
+ * `entries` on entry, and will be set to the number of entries in the
+ * archive. If there is not enough room, `TINF_BUF_ERROR` is returned, so
+ * the number of entries can be found by passing `NULL` for `entries`.
+ *
+ * Zip64 archives are supported, multi-disk archives are not. The entry
+ * names point into `source`.
+ *
+ * @param entries pointer to where to place information about entries
+ * @param count pointer to variable containing number of elements in `entries`
+ * @param source pointer to zip archive
+ * @param sourceLen size of zip archive
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_zip_read_directory(struct tinf_zip_entry *entries,
+                                   size_t *count, const void *source,
+                                   size_t sourceLen);
+
+/**
+ * Decompress the zip archive entry `entry` from `source` to `dest`.
+ *
+ * Stored and deflate compressed entries are supported. The CRC32 checksum
+ * of the data is checked.
+ *
+ * Writes at most `entry->size` bytes to `dest`.
+ *
+ * @param dest pointer to where to place decompressed data
+ * @param destLen size of `dest`
+ * @param source pointer to zip archive
+ * @param sourceLen size of zip archive
+ * @param entry pointer to information about entry from central directory
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_zip_uncompress(void *dest, size_t destLen,
+                               const void *source, size_t sourceLen,
+                               const struct tinf_zip_entry *entry);
+
+/**
+ * Decompress `count` zip archive entries from `source`, using up to
+ * `threads` threads.
+ *
+ * Entry `entries[i]` is decompressed to `dests[i]`, which must have room
+ * for `entries[i].size` bytes, or be `NULL` to skip the entry. The status
+ * of each entry is placed in `results[i]`.
+ *
+ * Since every entry is written to a buffer of its own, the buffers can be
+ * parts of one large buffer, such as a memory mapped output file.
+ *
+ * @see tinf_zip_uncompress
+ *
+ * @param dests array of pointers to where to place decompressed data
+ * @param results array of status codes for entries
+ * @param source pointer to zip archive
+ * @param sourceLen size of zip archive
+ * @param entries array of information about entries
+ * @param count number of entries
+ * @param threads maximum number of threads to use
+ * @return `TINF_OK` if all entries were decompressed, error code otherwise
+ */
+int TINFCC tinf_zip_uncompress_all(void * const *dests, int *results,
+                                   const void *source, size_t sourceLen,
+                                   const struct tinf_zip_entry *entries,
+                                   size_t count, int threads);
+
 /**
  * Compute Adler-32 checksum of `length` bytes starting at `data`.
  *
@@ -124,6 +1219,17 @@ int TINFCC tinf_zlib_uncompress(void *dest, unsigned int *destLen,
  */
 unsigned int TINFCC tinf_adler32(const void *data, unsigned int length);
 
+/**
+ * Compute Adler-32 checksum of `length` bytes starting at `data`.
+ *
+ * Same as `tinf_adler32`, but with size of type `size_t`.
+ *
+ * @param data pointer to data
+ * @param length size of data
+ * @return Adler-32 checksum
+ */
+unsigned int TINFCC tinf_adler32_z(const void *data, size_t length);
+
 /**
  * Compute CRC32 checksum of `length` bytes starting at `data`.
  *
@@ -133,6 +1239,40 @@ unsigned int TINFCC tinf_adler32(const void *data, unsigned int length);
  */
 unsigned int TINFCC tinf_crc32(const void *data, unsigned int length);
 
+/**
+ * Compute CRC32 checksum of `length` bytes starting at `data`.
+ *
+ * Same as `tinf_crc32`, but with size of type `size_t`.
+ *
+ * @param data pointer to data
+ * @param length size of data
+ * @return CRC32 checksum
+ */
+unsigned int TINFCC tinf_crc32_z(const void *data, size_t length);
+
+/**
+ * Combine Adler-32 checksums of two consecutive blocks of data.
+ *
+ * @param adler1 Adler-32 checksum of first block
+ * @param adler2 Adler-32 checksum of second block
+ * @param length2 size of second block
+ * @return Adler-32 checksum of both blocks
+ */
+unsigned int TINFCC tinf_adler32_combine(unsigned int adler1,
+                                         unsigned int adler2,
+                                         size_t length2);
+
+/**
+ * Combine CRC32 checksums of two consecutive blocks of data.
+ *
+ * @param crc1 CRC32 checksum of first block
+ * @param crc2 CRC32 checksum of second block
+ * @param length2 size of second block
+ * @return CRC32 checksum of both blocks
+ */
+unsigned int TINFCC tinf_crc32_combine(unsigned int crc1, unsigned int crc2,
+                                       size_t length2);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -0,0 +1,330 @@
+/*
+ * tinfalloc - memory allocation
+ *
+ * Copyright (c) 2003-2019 Joergen Ibsen
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *   1. The origin of this software must not be misrepresented; you must
+ *      not claim that you wrote the original software. If you use this
+ *      software in a product, an acknowledgment in the product
+ *      documentation would be appreciated but is not required.
+ *
+ *   2. Altered source versions must be plainly marked as such, and must
+ *      not be misrepresented as being the original software.
+ *
+ *   3. This notice may not be removed or altered from any source
+ *      distribution.
+ */
+
+#include "tinf.h"
+#include "tinfpar.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#  include <sys/mman.h>
+#endif
+
+/* -- Allocator -- */
+
+static void *TINFCC tinf_default_alloc(void *opaque, size_t size)
+{
+	(void) opaque;
+
+	return malloc(size);
+}
+
+static void *TINFCC tinf_default_resize(void *opaque, void *ptr,
+                                        size_t size)
+{
+	(void) opaque;
+
+	return realloc(ptr, size);
+}
+
+static void TINFCC tinf_default_free(void *opaque, void *ptr)
+{
+	(void) opaque;
+
+	free(ptr);
+}
+
+static const struct tinf_allocator tinf_default_allocator = {
+	tinf_default_alloc, tinf_default_resize, tinf_default_free, NULL
+};
+
+static struct tinf_allocator tinf_allocator_global = {
+	tinf_default_alloc, tinf_default_resize, tinf_default_free, NULL
+};
+
+void tinf_set_allocator(const struct tinf_allocator *allocator)
+{
+	tinf_allocator_global = allocator != NULL ? *allocator
+	                                          : tinf_default_allocator;
+}
+
+const struct tinf_allocator *tinf_get_allocator(void)
+{
+	return &tinf_allocator_global;
+}
+
+void *tinf_malloc(size_t size)
+{
+	return tinf_allocator_global.alloc(tinf_allocator_global.opaque, size);
+}
+
+void *tinf_realloc(void *ptr, size_t size)
+{
+	return tinf_allocator_global.resize(tinf_allocator_global.opaque,
+	                                    ptr, size);
+}
+
+void tinf_free(void *ptr)
+{
+	if (ptr != NULL) {
+		tinf_allocator_global.release(tinf_allocator_global.opaque, ptr);
+	}
+}
+
+/* -- Arena -- */
+
+/* Alignment of allocations from an arena */
+#define TINF_ARENA_ALIGN 16
+
+/* Size of huge pages, which slabs are rounded up to when using them */
+#define TINF_HUGEPAGE_SIZE (2 * 1024 * 1024U)
+
+struct tinf_arena_slab {
+	struct tinf_arena_slab *next;
+	size_t size; /* Size of data */
+	size_t used;
+	size_t last; /* Offset of last allocation in data */
+	int mapped;  /* Non-zero if allocated with mmap */
+};
+
+/* Allocations are preceded by their size */
+#define TINF_ARENA_HEADER TINF_ARENA_ALIGN
+
+static size_t tinf_arena_round(size_t size)
+{
+	return (size + (TINF_ARENA_ALIGN - 1)) & ~(size_t) (TINF_ARENA_ALIGN - 1);
+}
+
+/* Data of a slab follows the aligned slab header */
+#define TINF_SLAB_HEADER tinf_arena_round(sizeof(struct tinf_arena_slab))
+
+static struct tinf_arena_slab *tinf_arena_new_slab(struct tinf_arena *arena,
+                                                   size_t size)
+{
+	struct tinf_arena_slab *slab = NULL;
+	size_t total;
+
+	if (size < arena->slab_size) {
+		size = arena->slab_size;
+	}
+
+	total = TINF_SLAB_HEADER + size;
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	if (arena->flags & TINF_ARENA_HUGEPAGES) {
+		void *p;
+
+		total = (total + (TINF_HUGEPAGE_SIZE - 1))
+		      & ~(size_t) (TINF_HUGEPAGE_SIZE - 1);
+
+		p = mmap(NULL, total, PROT_READ | PROT_WRITE,
+		         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		if (p != MAP_FAILED) {
+			/* Only advice, so failure is not an error */
+			madvise(p, total, MADV_HUGEPAGE);
+
+			slab = (struct tinf_arena_slab *) p;
+			slab->mapped = 1;
+			size = total - TINF_SLAB_HEADER;
+		}
+	}
+#endif
+
+	if (slab == NULL) {
+		/*
+		 * Not tinf_malloc, since the arena may itself be the allocator
+		 * set with tinf_set_allocator
+		 */
+		slab = (struct tinf_arena_slab *) malloc(total);
+
+		if (slab == NULL) {
+			return NULL;
+		}
+
+		slab->mapped = 0;
+	}
+
+	slab->size = size;
+	slab->used = 0;
+	slab->last = 0;
+	slab->next = arena->slab;
+
+	arena->slab = slab;
+
+	return slab;
+}
+
+static void tinf_arena_free_slab(struct tinf_arena_slab *slab)
+{
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	if (slab->mapped) {
+		munmap(slab, TINF_SLAB_HEADER + slab->size);
+		return;
+	}
+#endif
+
+	free(slab);
+}
+
+static unsigned char *tinf_arena_data(struct tinf_arena_slab *slab)
+{
+	return (unsigned char *) slab + TINF_SLAB_HEADER;
+}
+
+static void *TINFCC tinf_arena_alloc(void *opaque, size_t size)
+{
+	struct tinf_arena *arena = (struct tinf_arena *) opaque;
+	struct tinf_arena_slab *slab = arena->slab;
+	size_t need;
+	unsigned char *p;
+
+	if (size > (size_t) -1 / 2) {
+		return NULL;
+	}
+
+	need = TINF_ARENA_HEADER + tinf_arena_round(size);
+
+	if (slab == NULL || slab->size - slab->used < need) {
+		slab = tinf_arena_new_slab(arena, need);
+
+		if (slab == NULL) {
+			return NULL;
+		}
+	}
+
+	p = tinf_arena_data(slab) + slab->used;
+
+	*(size_t *) p = size;
+
+	slab->last = slab->used;
+	slab->used += need;
+
+	return p + TINF_ARENA_HEADER;
+}
+
+static void *TINFCC tinf_arena_resize(void *opaque, void *ptr, size_t size)
+{
+	struct tinf_arena *arena = (struct tinf_arena *) opaque;
+	struct tinf_arena_slab *slab = arena->slab;
+	unsigned char *p = (unsigned char *) ptr;
+	size_t old;
+	void *q;
+
+	if (p == NULL) {
+		return tinf_arena_alloc(opaque, size);
+	}
+
+	old = *(size_t *) (p - TINF_ARENA_HEADER);
+
+	/* Grow or shrink the last allocation of the current slab in place */
+	if (slab != NULL && size <= (size_t) -1 / 2
+	 && p - TINF_ARENA_HEADER == tinf_arena_data(slab) + slab->last) {
+		size_t need = TINF_ARENA_HEADER + tinf_arena_round(size);
+
+		if (slab->size - slab->last >= need) {
+			*(size_t *) (p - TINF_ARENA_HEADER) = size;
+			slab->used = slab->last + need;
+
+			return p;
+		}
+	}
+
+	if (size <= old) {
+		*(size_t *) (p - TINF_ARENA_HEADER) = size;
+
+		return p;
+	}
+
+	q = tinf_arena_alloc(opaque, size);
+
+	if (q != NULL) {
+		memcpy(q, p, old);
+	}
+
+	return q;
+}
+
+static void TINFCC tinf_arena_release(void *opaque, void *ptr)
+{
+	struct tinf_arena *arena = (struct tinf_arena *) opaque;
+	struct tinf_arena_slab *slab = arena->slab;
+	unsigned char *p = (unsigned char *) ptr;
+
+	/* Only the last allocation of the current slab is given back */
+	if (slab != NULL && p != NULL
+	 && p - TINF_ARENA_HEADER == tinf_arena_data(slab) + slab->last) {
+		slab->used = slab->last;
+	}
+}
+
+void tinf_arena_init(struct tinf_arena *arena, size_t slabSize, int flags)
+{
+	arena->slab = NULL;
+	arena->slab_size = slabSize;
+	arena->flags = flags;
+}
+
+void tinf_arena_allocator(struct tinf_arena *arena,
+                          struct tinf_allocator *allocator)
+{
+	allocator->alloc = tinf_arena_alloc;
+	allocator->resize = tinf_arena_resize;
+	allocator->release = tinf_arena_release;
+	allocator->opaque = arena;
+}
+
+void tinf_arena_reset(struct tinf_arena *arena)
+{
+	struct tinf_arena_slab *slab = arena->slab;
+
+	if (slab == NULL) {
+		return;
+	}
+
+	/* Keep the current slab for the next request */
+	while (slab->next != NULL) {
+		struct tinf_arena_slab *next = slab->next->next;
+
+		tinf_arena_free_slab(slab->next);
+
+		slab->next = next;
+	}
+
+	slab->used = 0;
+	slab->last = 0;
+}
+
+void tinf_arena_destroy(struct tinf_arena *arena)
+{
+	while (arena->slab != NULL) {
+		struct tinf_arena_slab *next = arena->slab->next;
+
+		tinf_arena_free_slab(arena->slab);
+
+		arena->slab = next;
+	}
+}
@@ -0,0 +1,165 @@
+/*
+ * tinffixed.h - fixed Huffman trees of deflate
+ *
+ * Generated by tools/genfixed.py, do not edit.
+ *
+ * Included by tinflate.c after struct tinf_tree, the fast tables are for
+ * TINF_FAST_BITS = 9.
+ */
+
+static const struct tinf_tree tinf_fixed_ltree = {
+	{
+		0, 0, 0, 0, 0, 0, 0, 24, 152, 112, 0, 0, 0, 0, 0, 0
+	},
+	{
+		256, 257, 258, 259, 260, 261, 262, 263, 264, 265, 266, 267,
+		268, 269, 270, 271, 272, 273, 274, 275, 276, 277, 278, 279,
+		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11,
+		12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23,
+		24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35,
+		36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47,
+		48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59,
+		60, 61, 62, 63, 64, 65, 66, 67, 68, 69, 70, 71,
+		72, 73, 74, 75, 76, 77, 78, 79, 80, 81, 82, 83,
+		84, 85, 86, 87, 88, 89, 90, 91, 92, 93, 94, 95,
+		96, 97, 98, 99, 100, 101, 102, 103, 104, 105, 106, 107,
+		108, 109, 110, 111, 112, 113, 114, 115, 116, 117, 118, 119,
+		120, 121, 122, 123, 124, 125, 126, 127, 128, 129, 130, 131,
+		132, 133, 134, 135, 136, 137, 138, 139, 140, 141, 142, 143,
+		280, 281, 282, 283, 284, 285, 286, 287, 144, 145, 146, 147,
+		148, 149, 150, 151, 152, 153, 154, 155, 156, 157, 158, 159,
+		160, 161, 162, 163, 164, 165, 166, 167, 168, 169, 170, 171,
+		172, 173, 174, 175, 176, 177, 178, 179, 180, 181, 182, 183,
+		184, 185, 186, 187, 188, 189, 190, 191, 192, 193, 194, 195,
+		196, 197, 198, 199, 200, 201, 202, 203, 204, 205, 206, 207,
+		208, 209, 210, 211, 212, 213, 214, 215, 216, 217, 218, 219,
+		220, 221, 222, 223, 224, 225, 226, 227, 228, 229, 230, 231,
+		232, 233, 234, 235, 236, 237, 238, 239, 240, 241, 242, 243,
+		244, 245, 246, 247, 248, 249, 250, 251, 252, 253, 254, 255
+	},
+	285
+#if defined(TINF_ENGINE_FAST)
+	, {
+		3840, 4176, 4112, 4376, 3856, 4208, 4144, 4800, 3848, 4192,
+		4128, 4768, 4096, 4224, 4160, 4832, 3844, 4184, 4120, 4752,
+		3860, 4216, 4152, 4816, 3852, 4200, 4136, 4784, 4104, 4232,
+		4168, 4848, 3842, 4180, 4116, 4380, 3858, 4212, 4148, 4808,
+		3850, 4196, 4132, 4776, 4100, 4228, 4164, 4840, 3846, 4188,
+		4124, 4760, 3862, 4220, 4156, 4824, 3854, 4204, 4140, 4792,
+		4108, 4236, 4172, 4856, 3841, 4178, 4114, 4378, 3857, 4210,
+		4146, 4804, 3849, 4194, 4130, 4772, 4098, 4226, 4162, 4836,
+		3845, 4186, 4122, 4756, 3861, 4218, 4154, 4820, 3853, 4202,
+		4138, 4788, 4106, 4234, 4170, 4852, 3843, 4182, 4118, 4382,
+		3859, 4214, 4150, 4812, 3851, 4198, 4134, 4780, 4102, 4230,
+		4166, 4844, 3847, 4190, 4126, 4764, 3863, 4222, 4158, 4828,
+		3855, 4206, 4142, 4796, 4110, 4238, 4174, 4860, 3840, 4177,
+		4113, 4377, 3856, 4209, 4145, 4802, 3848, 4193, 4129, 4770,
+		4097, 4225, 4161, 4834, 3844, 4185, 4121, 4754, 3860, 4217,
+		4153, 4818, 3852, 4201, 4137, 4786, 4105, 4233, 4169, 4850,
+		3842, 4181, 4117, 4381, 3858, 4213, 4149, 4810, 3850, 4197,
+		4133, 4778, 4101, 4229, 4165, 4842, 3846, 4189, 4125, 4762,
+		3862, 4221, 4157, 4826, 3854, 4205, 4141, 4794, 4109, 4237,
+		4173, 4858, 3841, 4179, 4115, 4379, 3857, 4211, 4147, 4806,
+		3849, 4195, 4131, 4774, 4099, 4227, 4163, 4838, 3845, 4187,
+		4123, 4758, 3861, 4219, 4155, 4822, 3853, 4203, 4139, 4790,
+		4107, 4235, 4171, 4854, 3843, 4183, 4119, 4383, 3859, 4215,
+		4151, 4814, 3851, 4199, 4135, 4782, 4103, 4231, 4167, 4846,
+		3847, 4191, 4127, 4766, 3863, 4223, 4159, 4830, 3855, 4207,
+		4143, 4798, 4111, 4239, 4175, 4862, 3840, 4176, 4112, 4376,
+		3856, 4208, 4144, 4801, 3848, 4192, 4128, 4769, 4096, 4224,
+		4160, 4833, 3844, 4184, 4120, 4753, 3860, 4216, 4152, 4817,
+		3852, 4200, 4136, 4785, 4104, 4232, 4168, 4849, 3842, 4180,
+		4116, 4380, 3858, 4212, 4148, 4809, 3850, 4196, 4132, 4777,
+		4100, 4228, 4164, 4841, 3846, 4188, 4124, 4761, 3862, 4220,
+		4156, 4825, 3854, 4204, 4140, 4793, 4108, 4236, 4172, 4857,
+		3841, 4178, 4114, 4378, 3857, 4210, 4146, 4805, 3849, 4194,
+		4130, 4773, 4098, 4226, 4162, 4837, 3845, 4186, 4122, 4757,
+		3861, 4218, 4154, 4821, 3853, 4202, 4138, 4789, 4106, 4234,
+		4170, 4853, 3843, 4182, 4118, 4382, 3859, 4214, 4150, 4813,
+		3851, 4198, 4134, 4781, 4102, 4230, 4166, 4845, 3847, 4190,
+		4126, 4765, 3863, 4222, 4158, 4829, 3855, 4206, 4142, 4797,
+		4110, 4238, 4174, 4861, 3840, 4177, 4113, 4377, 3856, 4209,
+		4145, 4803, 3848, 4193, 4129, 4771, 4097, 4225, 4161, 4835,
+		3844, 4185, 4121, 4755, 3860, 4217, 4153, 4819, 3852, 4201,
+		4137, 4787, 4105, 4233, 4169, 4851, 3842, 4181, 4117, 4381,
+		3858, 4213, 4149, 4811, 3850, 4197, 4133, 4779, 4101, 4229,
+		4165, 4843, 3846, 4189, 4125, 4763, 3862, 4221, 4157, 4827,
+		3854, 4205, 4141, 4795, 4109, 4237, 4173, 4859, 3841, 4179,
+		4115, 4379, 3857, 4211, 4147, 4807, 3849, 4195, 4131, 4775,
+		4099, 4227, 4163, 4839, 3845, 4187, 4123, 4759, 3861, 4219,
+		4155, 4823, 3853, 4203, 4139, 4791, 4107, 4235, 4171, 4855,
+		3843, 4183, 4119, 4383, 3859, 4215, 4151, 4815, 3851, 4199,
+		4135, 4783, 4103, 4231, 4167, 4847, 3847, 4191, 4127, 4767,
+		3863, 4223, 4159, 4831, 3855, 4207, 4143, 4799, 4111, 4239,
+		4175, 4863
+	}, 1
+#endif
+};
+
+static const struct tinf_tree tinf_fixed_dtree = {
+	{
+		0, 0, 0, 0, 0, 32, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+	},
+	{
+		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11,
+		12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23,
+		24, 25, 26, 27, 28, 29, 30, 31
+	},
+	29
+#if defined(TINF_ENGINE_FAST)
+	, {
+		2560, 2576, 2568, 2584, 2564, 2580, 2572, 2588, 2562, 2578,
+		2570, 2586, 2566, 2582, 2574, 2590, 2561, 2577, 2569, 2585,
+		2565, 2581, 2573, 2589, 2563, 2579, 2571, 2587, 2567, 2583,
+		2575, 2591, 2560, 2576, 2568, 2584, 2564, 2580, 2572, 2588,
+		2562, 2578, 2570, 2586, 2566, 2582, 2574, 2590, 2561, 2577,
+		2569, 2585, 2565, 2581, 2573, 2589, 2563, 2579, 2571, 2587,
+		2567, 2583, 2575, 2591, 2560, 2576, 2568, 2584, 2564, 2580,
+		2572, 2588, 2562, 2578, 2570, 2586, 2566, 2582, 2574, 2590,
+		2561, 2577, 2569, 2585, 2565, 2581, 2573, 2589, 2563, 2579,
+		2571, 2587, 2567, 2583, 2575, 2591, 2560, 2576, 2568, 2584,
+		2564, 2580, 2572, 2588, 2562, 2578, 2570, 2586, 2566, 2582,
+		2574, 2590, 2561, 2577, 2569, 2585, 2565, 2581, 2573, 2589,
+		2563, 2579, 2571, 2587, 2567, 2583, 2575, 2591, 2560, 2576,
+		2568, 2584, 2564, 2580, 2572, 2588, 2562, 2578, 2570, 2586,
+		2566, 2582, 2574, 2590, 2561, 2577, 2569, 2585, 2565, 2581,
+		2573, 2589, 2563, 2579, 2571, 2587, 2567, 2583, 2575, 2591,
+		2560, 2576, 2568, 2584, 2564, 2580, 2572, 2588, 2562, 2578,
+		2570, 2586, 2566, 2582, 2574, 2590, 2561, 2577, 2569, 2585,
+		2565, 2581, 2573, 2589, 2563, 2579, 2571, 2587, 2567, 2583,
+		2575, 2591, 2560, 2576, 2568, 2584, 2564, 2580, 2572, 2588,
+		2562, 2578, 2570, 2586, 2566, 2582, 2574, 2590, 2561, 2577,
+		2569, 2585, 2565, 2581, 2573, 2589, 2563, 2579, 2571, 2587,
+		2567, 2583, 2575, 2591, 2560, 2576, 2568, 2584, 2564, 2580,
+		2572, 2588, 2562, 2578, 2570, 2586, 2566, 2582, 2574, 2590,
+		2561, 2577, 2569, 2585, 2565, 2581, 2573, 2589, 2563, 2579,
+		2571, 2587, 2567, 2583, 2575, 2591, 2560, 2576, 2568, 2584,
+		2564, 2580, 2572, 2588, 2562, 2578, 2570, 2586, 2566, 2582,
+		2574, 2590, 2561, 2577, 2569, 2585, 2565, 2581, 2573, 2589,
+		2563, 2579, 2571, 2587, 2567, 2583, 2575, 2591, 2560, 2576,
+		2568, 2584, 2564, 2580, 2572, 2588, 2562, 2578, 2570, 2586,
+		2566, 2582, 2574, 2590, 2561, 2577, 2569, 2585, 2565, 2581,
+		2573, 2589, 2563, 2579, 2571, 2587, 2567, 2583, 2575, 2591,
+		2560, 2576, 2568, 2584, 2564, 2580, 2572, 2588, 2562, 2578,
+		2570, 2586, 2566, 2582, 2574, 2590, 2561, 2577, 2569, 2585,
+		2565, 2581, 2573, 2589, 2563, 2579, 2571, 2587, 2567, 2583,
+		2575, 2591, 2560, 2576, 2568, 2584, 2564, 2580, 2572, 2588,
+		2562, 2578, 2570, 2586, 2566, 2582, 2574, 2590, 2561, 2577,
+		2569, 2585, 2565, 2581, 2573, 2589, 2563, 2579, 2571, 2587,
+		2567, 2583, 2575, 2591, 2560, 2576, 2568, 2584, 2564, 2580,
+		2572, 2588, 2562, 2578, 2570, 2586, 2566, 2582, 2574, 2590,
+		2561, 2577, 2569, 2585, 2565, 2581, 2573, 2589, 2563, 2579,
+		2571, 2587, 2567, 2583, 2575, 2591, 2560, 2576, 2568, 2584,
+		2564, 2580, 2572, 2588, 2562, 2578, 2570, 2586, 2566, 2582,
+		2574, 2590, 2561, 2577, 2569, 2585, 2565, 2581, 2573, 2589,
+		2563, 2579, 2571, 2587, 2567, 2583, 2575, 2591, 2560, 2576,
+		2568, 2584, 2564, 2580, 2572, 2588, 2562, 2578, 2570, 2586,
+		2566, 2582, 2574, 2590, 2561, 2577, 2569, 2585, 2565, 2581,
+		2573, 2589, 2563, 2579, 2571, 2587, 2567, 2583, 2575, 2591,
+		2560, 2576, 2568, 2584, 2564, 2580, 2572, 2588, 2562, 2578,
+		2570, 2586, 2566, 2582, 2574, 2590, 2561, 2577, 2569, 2585,
+		2565, 2581, 2573, 2589, 2563, 2579, 2571, 2587, 2567, 2583,
+		2575, 2591
+	}, 1
+#endif
+};
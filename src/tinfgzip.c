@@ -24,6 +24,9 @@
  */
 
 #include "tinf.h"
+#include "tinfpar.h"
+
+#include <stdlib.h>
 
 typedef enum {
 	FTEXT    = 1,
@@ -47,14 +50,12 @@ static unsigned int read_le32(const unsigned char *p)
 	     | ((unsigned int) p[3] << 24);
 }
 
-int tinf_gzip_uncompress(void *dest, unsigned int *destLen,
-                         const void *source, unsigned int sourceLen)
+/* Check header and find start of compressed data */
+static int tinf_gzip_parse_header(const unsigned char *src,
+                                  size_t sourceLen,
+                                  const unsigned char **startp)
 {
-	const unsigned char *src = (const unsigned char *) source;
-	unsigned char *dst = (unsigned char *) dest;
 	const unsigned char *start;
-	unsigned int dlen, crc32;
-	int res;
 	unsigned char flg;
 
 	/* -- Check header -- */
@@ -89,7 +90,7 @@ int tinf_gzip_uncompress(void *dest, unsigned int *destLen,
 
 	/* Skip extra data if present */
 	if (flg & FEXTRA) {
-		unsigned int xlen = read_le16(start);
+		size_t xlen = read_le16(start);
 
 		if (xlen > sourceLen - 12) {
 			return TINF_DATA_ERROR;
@@ -101,7 +102,7 @@ int tinf_gzip_uncompress(void *dest, unsigned int *destLen,
 	/* Skip file name if present */
 	if (flg & FNAME) {
 		do {
-			if (start - src >= sourceLen) {
+			if ((size_t) (start - src) >= sourceLen) {
 				return TINF_DATA_ERROR;
 			}
 		} while (*start++);
@@ -110,7 +111,7 @@ int tinf_gzip_uncompress(void *dest, unsigned int *destLen,
 	/* Skip file comment if present */
 	if (flg & FCOMMENT) {
 		do {
-			if (start - src >= sourceLen) {
+			if ((size_t) (start - src) >= sourceLen) {
 				return TINF_DATA_ERROR;
 			}
 		} while (*start++);
@@ -120,20 +121,152 @@ int tinf_gzip_uncompress(void *dest, unsigned int *destLen,
 	if (flg & FHCRC) {
 		unsigned int hcrc;
 
-		if (start - src > sourceLen - 2) {
+		if ((size_t) (start - src) > sourceLen - 2) {
 			return TINF_DATA_ERROR;
 		}
 
 		hcrc = read_le16(start);
 
-		if (hcrc != (tinf_crc32(src, start - src) & 0x0000FFFF)) {
+		if (hcrc != (tinf_crc32_z(src, start - src) & 0x0000FFFF)) {
 			return TINF_DATA_ERROR;
 		}
 
 		start += 2;
 	}
 
-	/* -- Get decompressed length -- */
+	/* Check room for trailer */
+	if ((src + sourceLen) - start < 8) {
+		return TINF_DATA_ERROR;
+	}
+
+	*startp = start;
+
+	return TINF_OK;
+}
+
+int tinf_gzip_uncompress(void *dest, unsigned int *destLen,
+                         const void *source, unsigned int sourceLen)
+{
+	size_t dlen = *destLen;
+	int res;
+
+	res = tinf_gzip_uncompress_z(dest, &dlen, source, sourceLen);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	*destLen = (unsigned int) dlen;
+
+	return TINF_OK;
+}
+
+/* Check header and find compressed data */
+int tinf_gzip_unwrap(const void *source, size_t sourceLen, size_t destLen,
+                     const unsigned char **start, size_t *length)
+{
+	const unsigned char *src = (const unsigned char *) source;
+	int res;
+
+	/* -- Check header and find start of compressed data -- */
+
+	res = tinf_gzip_parse_header(src, sourceLen, start);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	/* -- Check decompressed length modulo 2^32 -- */
+
+	/*
+	 * Since the size is stored modulo 2^32, the actual size of a member
+	 * larger than 4 GB is ISIZE plus a multiple of 2^32, so ISIZE is only
+	 * a lower bound, and we check the size after decompressing.
+	 */
+	if (read_le32(&src[sourceLen - 4]) > destLen) {
+		return TINF_BUF_ERROR;
+	}
+
+	*length = (src + sourceLen) - *start - 8;
+
+	return TINF_OK;
+}
+
+/* Check size and CRC32 checksum of decompressed data against trailer */
+int tinf_gzip_check(const void *dest, size_t destLen,
+                    const void *source, size_t sourceLen)
+{
+	return tinf_gzip_check_value(tinf_crc32_z(dest, destLen), destLen,
+	                             source, sourceLen);
+}
+
+/* Check size and CRC32 checksum against trailer */
+int tinf_gzip_check_value(unsigned int crc, size_t destLen,
+                          const void *source, size_t sourceLen)
+{
+	const unsigned char *src = (const unsigned char *) source;
+
+	if ((destLen & 0xFFFFFFFF) != read_le32(&src[sourceLen - 4])) {
+		return TINF_DATA_ERROR;
+	}
+
+	if (read_le32(&src[sourceLen - 8]) != crc) {
+		return TINF_DATA_ERROR;
+	}
+
+	return TINF_OK;
+}
+
+int tinf_gzip_uncompress_z(void *dest, size_t *destLen,
+                           const void *source, size_t sourceLen)
+{
+	const unsigned char *start;
+	size_t length;
+	int res;
+
+	/* -- Check header and find compressed data -- */
+
+	res = tinf_gzip_unwrap(source, sourceLen, *destLen, &start, &length);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	/* -- Decompress data -- */
+
+	res = tinf_uncompress_z(dest, destLen, start, length);
+
+	/*
+	 * Not enough room is reported as such, since the size may be larger
+	 * than ISIZE by a multiple of 2^32
+	 */
+	if (res != TINF_OK) {
+		return res == TINF_BUF_ERROR ? TINF_BUF_ERROR : TINF_DATA_ERROR;
+	}
+
+	/* -- Check size and CRC32 checksum -- */
+
+	return tinf_gzip_check(dest, *destLen, source, sourceLen);
+}
+
+int tinf_gzip_uncompress_parallel(void *dest, size_t *destLen,
+                                  const void *source, size_t sourceLen,
+                                  int threads)
+{
+	const unsigned char *src = (const unsigned char *) source;
+	const unsigned char *start;
+	unsigned int dlen, crc32, check;
+	int res;
+
+	/* -- Check header and find start of compressed data -- */
+
+	res = tinf_gzip_parse_header(src, sourceLen, &start);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	/* -- Get decompressed length modulo 2^32 -- */
 
 	dlen = read_le32(&src[sourceLen - 4]);
 
@@ -145,28 +278,394 @@ int tinf_gzip_uncompress(void *dest, unsigned int *destLen,
 
 	crc32 = read_le32(&src[sourceLen - 8]);
 
+	/* -- Decompress data, combining checksums of segments -- */
+
+	res = tinf_inflate_parallel(dest, destLen, start,
+	                            (src + sourceLen) - start - 8, threads,
+	                            tinf_crc32_z, tinf_crc32_combine, &check);
+
+	if (res != TINF_OK) {
+		return res == TINF_BUF_ERROR ? TINF_BUF_ERROR : TINF_DATA_ERROR;
+	}
+
+	if ((*destLen & 0xFFFFFFFF) != dlen) {
+		return TINF_DATA_ERROR;
+	}
+
+	/* -- Check CRC32 checksum -- */
+
+	if (crc32 != check) {
+		return TINF_DATA_ERROR;
+	}
+
+	return TINF_OK;
+}
+
+/* -- Sink -- */
+
+struct tinf_gzip_sink {
+	tinf_sink_func sink;
+	void *arg;
+	unsigned int crc;
+	size_t size;
+};
+
+/* Update CRC32 checksum and size and pass data on */
+static int TINFCC tinf_gzip_sink_func(void *arg, const unsigned char *data,
+                                      size_t length)
+{
+	struct tinf_gzip_sink *gs = (struct tinf_gzip_sink *) arg;
+
+	gs->crc = tinf_crc32_combine(gs->crc, tinf_crc32_z(data, length),
+	                             length);
+	gs->size += length;
+
+	return gs->sink(gs->arg, data, length);
+}
+
+int tinf_gzip_uncompress_sink(tinf_sink_func sink, void *sinkArg,
+                              const void *source, size_t sourceLen,
+                              void *window, size_t windowSize)
+{
+	const unsigned char *src = (const unsigned char *) source;
+	const unsigned char *start;
+	struct tinf_gzip_sink gs;
+	int res;
+
+	/* -- Check header and find start of compressed data -- */
+
+	res = tinf_gzip_parse_header(src, sourceLen, &start);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
 	/* -- Decompress data -- */
 
-	if ((src + sourceLen) - start < 8) {
+	gs.sink = sink;
+	gs.arg = sinkArg;
+	gs.crc = 0;
+	gs.size = 0;
+
+	res = tinf_uncompress_sink(tinf_gzip_sink_func, &gs, start,
+	                           (src + sourceLen) - start - 8,
+	                           window, windowSize);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	/* -- Check size and CRC32 checksum -- */
+
+	if ((gs.size & 0xFFFFFFFF) != read_le32(&src[sourceLen - 4])) {
 		return TINF_DATA_ERROR;
 	}
 
-	res = tinf_uncompress(dst, destLen, start,
-	                      (src + sourceLen) - start - 8);
+	if (read_le32(&src[sourceLen - 8]) != gs.crc) {
+		return TINF_DATA_ERROR;
+	}
+
+	return TINF_OK;
+}
+
+/* -- Spans -- */
+
+int tinf_gzip_uncompress_spans(void *dest, size_t *destLen,
+                               const void *source, size_t sourceLen,
+                               struct tinf_span *spans, size_t *spanCount)
+{
+	const unsigned char *src = (const unsigned char *) source;
+	const unsigned char *start;
+	size_t length;
+	unsigned int crc = 0;
+	size_t i;
+	int res;
+
+	/* -- Check header and find compressed data -- */
+
+	res = tinf_gzip_unwrap(source, sourceLen, *destLen, &start, &length);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	/* -- Decompress data -- */
+
+	res = tinf_uncompress_spans(dest, destLen, start, length,
+	                            spans, spanCount);
 
 	if (res != TINF_OK) {
+		return res == TINF_BUF_ERROR ? TINF_BUF_ERROR : TINF_DATA_ERROR;
+	}
+
+	/* -- Check size and CRC32 checksum computed over spans -- */
+
+	if ((*destLen & 0xFFFFFFFF) != read_le32(&src[sourceLen - 4])) {
 		return TINF_DATA_ERROR;
 	}
 
-	if (*destLen != dlen) {
+	for (i = 0; i < *spanCount; ++i) {
+		crc = tinf_crc32_combine(crc, tinf_crc32_z(spans[i].data,
+		                                           spans[i].len),
+		                         spans[i].len);
+	}
+
+	if (read_le32(&src[sourceLen - 8]) != crc) {
 		return TINF_DATA_ERROR;
 	}
 
-	/* -- Check CRC32 checksum -- */
+	return TINF_OK;
+}
+
+/* -- Limits -- */
+
+int tinf_gzip_uncompress_limited(void *dest, size_t *destLen,
+                                 const void *source, size_t sourceLen,
+                                 const struct tinf_limits *limits)
+{
+	const unsigned char *src = (const unsigned char *) source;
+	const unsigned char *start;
+	size_t length;
+	int res;
+
+	/* -- Check header and find compressed data -- */
+
+	res = tinf_gzip_unwrap(source, sourceLen, (size_t) -1, &start, &length);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	/* -- Check decompressed length against limits -- */
+
+	if (limits->max_output != 0
+	 && read_le32(&src[sourceLen - 4]) > limits->max_output) {
+		return TINF_LIMIT_ERROR;
+	}
+
+	if (read_le32(&src[sourceLen - 4]) > *destLen) {
+		return TINF_BUF_ERROR;
+	}
+
+	/* -- Decompress data -- */
+
+	res = tinf_uncompress_limited(dest, destLen, start, length, limits);
+
+	if (res != TINF_OK) {
+		return res == TINF_BUF_ERROR || res == TINF_LIMIT_ERROR
+		     ? res : TINF_DATA_ERROR;
+	}
+
+	/* -- Check size and CRC32 checksum -- */
+
+	return tinf_gzip_check(dest, *destLen, source, sourceLen);
+}
+
+/* -- Concatenated members -- */
+
+struct tinf_gzip_member {
+	const unsigned char *source;
+	size_t sourceLen;
+	unsigned char *dest;
+	size_t destLen;
+	int res;
+};
+
+/*
+ * Get size of member from BGZF extra subfield ('B', 'C') at start of src,
+ * returns 0 if there is none
+ */
+static size_t tinf_gzip_bgzf_size(const unsigned char *src, size_t sourceLen)
+{
+	const unsigned char *p, *end;
+
+	if (sourceLen < 18 || src[0] != 0x1F || src[1] != 0x8B
+	 || !(src[3] & FEXTRA)) {
+		return 0;
+	}
+
+	p = src + 12;
+	end = p + read_le16(src + 10);
+
+	if ((size_t) (end - src) > sourceLen) {
+		return 0;
+	}
+
+	while (end - p >= 4) {
+		unsigned int slen = read_le16(p + 2);
+
+		if ((size_t) (end - p) - 4 < slen) {
+			return 0;
+		}
+
+		if (p[0] == 'B' && p[1] == 'C' && slen == 2) {
+			return (size_t) read_le16(p + 4) + 1;
+		}
+
+		p += 4 + slen;
+	}
+
+	return 0;
+}
+
+static int tinf_gzip_member_uncompress(struct tinf_gzip_member *m)
+{
+	size_t dlen = m->destLen;
+	int res;
 
-	if (crc32 != tinf_crc32(dst, dlen)) {
+	res = tinf_gzip_uncompress_z(m->dest, &dlen, m->source, m->sourceLen);
+
+	/* ISIZE of a BGZF member is the exact size */
+	if (res != TINF_OK || dlen != m->destLen) {
+		return TINF_DATA_ERROR;
+	}
+
+	return TINF_OK;
+}
+
+static void tinf_gzip_member_task(void *arg, size_t index)
+{
+	struct tinf_gzip_member *m = (struct tinf_gzip_member *) arg + index;
+
+	m->res = tinf_gzip_member_uncompress(m);
+}
+
+/*
+ * Decompress member at src that does not state its size, returns size of
+ * member in *sourceLen and of output in *destLen
+ */
+static int tinf_gzip_member_scan(unsigned char *dst, size_t *destLen,
+                                 const unsigned char *src, size_t *sourceLen)
+{
+	const unsigned char *start;
+	size_t slen;
+	int final;
+	int res;
+
+	res = tinf_gzip_parse_header(src, *sourceLen, &start);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	slen = (src + *sourceLen) - start - 8;
+
+	res = tinf_uncompress_segment(dst, destLen, start, &slen,
+	                              (size_t) -1, &final);
+
+	if (res != TINF_OK) {
+		return res == TINF_BUF_ERROR ? TINF_BUF_ERROR : TINF_DATA_ERROR;
+	}
+
+	/* Trailer follows the deflate data */
+	*sourceLen = (start + slen + 8) - src;
+
+	return tinf_gzip_check(dst, *destLen, src, *sourceLen);
+}
+
+int tinf_gzip_uncompress_members(void *dest, size_t *destLen,
+                                 const void *source, size_t sourceLen,
+                                 int threads)
+{
+	const unsigned char *src = (const unsigned char *) source;
+	unsigned char *dst = (unsigned char *) dest;
+	struct tinf_gzip_member *members = NULL;
+	size_t num = 0, cap = 0;
+	size_t pos = 0, outLen = 0, i;
+	int res = TINF_OK;
+
+	if (sourceLen == 0) {
 		return TINF_DATA_ERROR;
 	}
 
+	/*
+	 * Members with a BGZF size are placed using their ISIZE and queued,
+	 * other members are decompressed as we go
+	 */
+	while (pos < sourceLen) {
+		size_t mlen = tinf_gzip_bgzf_size(src + pos, sourceLen - pos);
+
+		if (mlen != 0) {
+			struct tinf_gzip_member m;
+
+			if (mlen < 18 || mlen > sourceLen - pos) {
+				res = TINF_DATA_ERROR;
+				break;
+			}
+
+			m.source = src + pos;
+			m.sourceLen = mlen;
+			m.dest = dst + outLen;
+			m.destLen = read_le32(src + pos + mlen - 4);
+
+			if (m.destLen > *destLen - outLen) {
+				res = TINF_BUF_ERROR;
+				break;
+			}
+
+			if (num == cap) {
+				size_t ncap = cap ? 2 * cap : 64;
+				struct tinf_gzip_member *p;
+
+				p = (struct tinf_gzip_member *)
+				    tinf_realloc(members, ncap * sizeof(*p));
+
+				if (p != NULL) {
+					members = p;
+					cap = ncap;
+				}
+			}
+
+			/* Decompress now if there is no room in the queue */
+			if (num < cap) {
+				members[num++] = m;
+			}
+			else {
+				res = tinf_gzip_member_uncompress(&m);
+
+				if (res != TINF_OK) {
+					break;
+				}
+			}
+
+			outLen += m.destLen;
+		}
+		else {
+			size_t dlen = *destLen - outLen;
+
+			mlen = sourceLen - pos;
+
+			res = tinf_gzip_member_scan(dst + outLen, &dlen,
+			                            src + pos, &mlen);
+
+			if (res != TINF_OK) {
+				break;
+			}
+
+			outLen += dlen;
+		}
+
+		pos += mlen;
+	}
+
+	if (res == TINF_OK) {
+		tinf_parallel_for(tinf_gzip_member_task, members, num, threads);
+
+		for (i = 0; i < num; ++i) {
+			if (members[i].res != TINF_OK) {
+				res = members[i].res;
+				break;
+			}
+		}
+	}
+
+	tinf_free(members);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	*destLen = outLen;
+
 	return TINF_OK;
 }
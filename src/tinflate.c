@@ -24,35 +24,211 @@
  */
 
 #include "tinf.h"
+#include "tinfpar.h"
 
 #include <assert.h>
 #include <limits.h>
+#include <string.h>
 
 #if defined(UINT_MAX) && (UINT_MAX) < 0xFFFFFFFFUL
 #  error "tinf requires unsigned int to be at least 32-bit"
 #endif
 
+/*
+ * The small engine (default) decodes Huffman codes a bit at a time using
+ * only the canonical counts and symbols. The fast engine, selected with
+ * TINF_ENGINE_FAST, adds a lookup table for codes of up to TINF_FAST_BITS
+ * bits, reads input four bytes at a time, and copies matches eight bytes
+ * at a time.
+ */
+#if defined(TINF_ENGINE_FAST)
+#  define TINF_FAST_BITS 9
+#endif
+
+/*
+ * With the fast engine, the lookup tables for a dynamic block are only
+ * built if there are at least TINF_FAST_MIN_INPUT bytes of input left,
+ * since a short block is decoded faster than its tables are filled. The
+ * distance table also needs twice that, and at least TINF_FAST_MIN_DIST
+ * distance codes. The tables of the fixed trees are built in.
+ */
+#ifndef TINF_FAST_MIN_INPUT
+#  define TINF_FAST_MIN_INPUT 64
+#endif
+
+#ifndef TINF_FAST_MIN_DIST
+#  define TINF_FAST_MIN_DIST 4
+#endif
+
+/*
+ * With the fast engine, a tinf_cache keeps the trees of the last
+ * TINF_TREE_CACHE distinct dynamic block headers, with their tables, so a
+ * block with the same code lengths reuses them instead of building them
+ * again. The cache is owned by the caller, or by a stream, so it is kept
+ * across calls and is not on the stack of each call.
+ */
+#ifndef TINF_TREE_CACHE
+#  define TINF_TREE_CACHE 4
+#endif
+
+#if defined(TINF_ENGINE_FAST) && TINF_TREE_CACHE > 0
+#  define TINF_CACHE_TREES
+#endif
+
+/*
+ * With the fast engine on x86 with GCC or Clang, the block decoding loop
+ * is also compiled for BMI2, and for AVX2 with wider match copies, and the
+ * one to use is picked from the CPU features at load time. Define
+ * TINF_NO_DISPATCH to only build the portable one.
+ */
+#if defined(TINF_ENGINE_FAST) && !defined(TINF_NO_DISPATCH) \
+ && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define TINF_DISPATCH
+#  define TINF_TARGET(features) __attribute__((target(features)))
+#endif
+
+/*
+ * The functions in the block decoding loop are forced inline, so each
+ * variant of the loop (mode and kernel) gets its own copy of them, with
+ * the tests for other modes compiled out
+ */
+#if defined(__GNUC__)
+#  define TINF_INLINE __inline__ __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#  define TINF_INLINE __forceinline
+#else
+#  define TINF_INLINE
+#endif
+
+/* Functions for rare cases are kept out of the block decoding loop */
+#if defined(__GNUC__)
+#  define TINF_NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+#  define TINF_NOINLINE __declspec(noinline)
+#else
+#  define TINF_NOINLINE
+#endif
+
+/*
+ * Block decoding loop variants. The plain loop reads contiguous input a
+ * byte at a time, like the original decoder. The general loop also pulls
+ * input in parts and calls tinf_make_room before each symbol. The padded
+ * loop reads four bytes at a time without checking for the end, and the
+ * slop loop copies matches into the slop after dest_end.
+ */
+#define TINF_MODE_PLAIN   0
+#define TINF_MODE_GENERAL 1
+#define TINF_MODE_PADDED  2
+#define TINF_MODE_SLOP    3
+
+/* Bytes past dest_end that matches may be copied into */
+#define TINF_ROOM_PAST(mode) ((mode) == TINF_MODE_SLOP ? TINF_SLOP : 0)
+
 /* -- Internal data structures -- */
 
 struct tinf_tree {
 	unsigned short counts[16]; /* Number of codes with a given length */
 	unsigned short symbols[288]; /* Symbols sorted by code */
 	int max_sym;
+#if defined(TINF_ENGINE_FAST)
+	/* Symbol and length (<< 9) of short codes by next bits, or 0 */
+	unsigned short fast[1 << TINF_FAST_BITS];
+	int has_fast; /* Non-zero if fast is filled in */
+#endif
+};
+
+/* Fixed trees, with the tables of the fast engine, built by genfixed.py */
+#include "tinffixed.h"
+
+#if defined(TINF_CACHE_TREES)
+struct tinf_tree_entry {
+	unsigned int stamp; /* Time of last use, 0 if empty */
+	unsigned int hash;
+	unsigned int hlit;
+	unsigned int hdist;
+	unsigned char lengths[288 + 32];
+	struct tinf_tree ltree;
+	struct tinf_tree dtree;
+};
+#endif
+
+struct tinf_cache {
+#if defined(TINF_CACHE_TREES)
+	/* Least recently used entry is replaced */
+	struct tinf_tree_entry entries[TINF_TREE_CACHE];
+	unsigned int clock;
+#else
+	int unused;
+#endif
 };
 
 struct tinf_data {
 	const unsigned char *source;
 	const unsigned char *source_end;
+	tinf_source_func pull; /* Called for more input, if set */
+	void *pull_arg;
 	unsigned int tag;
 	int bitcount;
 	int overflow;
+	int padded; /* TINF_PADDING bytes after source_end can be read */
 
 	unsigned char *dest_start;
 	unsigned char *dest;
 	unsigned char *dest_end;
+	int slop; /* TINF_SLOP bytes after dest_end can be overwritten */
+
+	/*
+	 * In-place mode, where dest_end is kept at or below source, or the
+	 * maximum reach of output past input is measured for it
+	 */
+	int inplace;
+	const unsigned char *source_start;
+	size_t reach;
+
+	/* Limits checked every TINF_LIMIT_INTERVAL symbols, if set */
+	const struct tinf_limits *limits;
+	size_t symbols;
+	size_t check_at;
+
+	/* Non-zero if tinf_make_room is called before each symbol */
+	int hooks;
+
+	/* Output is passed to sink from dest_flushed, if sink is set */
+	tinf_sink_func sink;
+	void *sink_arg;
+	unsigned char *dest_flushed;
+
+	/*
+	 * Output is described by spans, if span_max is non-zero, with
+	 * uncompressed blocks passed as spans of source. Spans before
+	 * span_filled have been copied to dest where needed for history
+	 */
+	struct tinf_span *spans;
+	size_t span_max;
+	size_t span_count;
+	size_t span_filled;
+	unsigned char *span_start; /* Start of current span of dest */
+
+	/*
+	 * Output continues in the next buffer of out_iov when dest_end is
+	 * reached, if set, with dest_start the start of buffer out_index
+	 */
+	const struct tinf_iovec *out_iov;
+	size_t out_count;
+	size_t out_index;
+	size_t out_before; /* Size of output in buffers before out_index */
+
+	/* dest is reallocated with grow when full, up to grow_max, if set */
+	const struct tinf_allocator *grow;
+	size_t grow_max;
+	int grow_failed; /* Set if the allocator could not grow dest */
 
 	struct tinf_tree ltree; /* Literal/length tree */
 	struct tinf_tree dtree; /* Distance tree */
+
+#if defined(TINF_CACHE_TREES)
+	struct tinf_cache *cache; /* Trees of earlier blocks, or NULL */
+#endif
 };
 
 /* -- Utility functions -- */
@@ -63,48 +239,68 @@ static unsigned int read_le16(const unsigned char *p)
 	     | ((unsigned int) p[1] << 8);
 }
 
-/* Build fixed Huffman trees */
-static void tinf_build_fixed_trees(struct tinf_tree *lt, struct tinf_tree *dt)
+static unsigned int read_le32(const unsigned char *p)
 {
-	int i;
+	return ((unsigned int) p[0])
+	     | ((unsigned int) p[1] << 8)
+	     | ((unsigned int) p[2] << 16)
+	     | ((unsigned int) p[3] << 24);
+}
 
-	/* Build fixed literal/length tree */
-	for (i = 0; i < 16; ++i) {
-		lt->counts[i] = 0;
-	}
+static void write_le32(unsigned char *p, unsigned int value)
+{
+	p[0] = value & 0xFF;
+	p[1] = (value >> 8) & 0xFF;
+	p[2] = (value >> 16) & 0xFF;
+	p[3] = (value >> 24) & 0xFF;
+}
 
-	lt->counts[7] = 24;
-	lt->counts[8] = 152;
-	lt->counts[9] = 112;
+/* Read 64-bit value, returns 0 if it does not fit in size_t */
+static int read_le64(const unsigned char *p, size_t *value)
+{
+	size_t hi = read_le32(p + 4);
 
-	for (i = 0; i < 24; ++i) {
-		lt->symbols[i] = 256 + i;
-	}
-	for (i = 0; i < 144; ++i) {
-		lt->symbols[24 + i] = i;
-	}
-	for (i = 0; i < 8; ++i) {
-		lt->symbols[24 + 144 + i] = 280 + i;
-	}
-	for (i = 0; i < 112; ++i) {
-		lt->symbols[24 + 144 + 8 + i] = 144 + i;
-	}
+	*value = ((hi << 16) << 16) | read_le32(p);
 
-	lt->max_sym = 285;
+	return ((*value >> 16) >> 16) == hi;
+}
 
-	/* Build fixed distance tree */
-	for (i = 0; i < 16; ++i) {
-		dt->counts[i] = 0;
-	}
+static void write_le64(unsigned char *p, size_t value)
+{
+	write_le32(p, (unsigned int) (value & 0xFFFFFFFF));
+	write_le32(p + 4, (unsigned int) ((value >> 16) >> 16));
+}
 
-	dt->counts[5] = 32;
+#if defined(TINF_ENGINE_FAST)
+/* Fill lookup table of tree with codes of up to TINF_FAST_BITS bits */
+static void tinf_build_fast(struct tinf_tree *t)
+{
+	unsigned int code = 0, idx = 0;
+	unsigned int len, i;
+
+	memset(t->fast, 0, sizeof(t->fast));
+
+	for (len = 1; len <= TINF_FAST_BITS; ++len) {
+		for (i = 0; i < t->counts[len]; ++i, ++idx, ++code) {
+			unsigned int rev = 0, j;
+
+			/* Codes are read starting with the most significant bit */
+			for (j = 0; j < len; ++j) {
+				rev |= ((code >> j) & 1) << (len - 1 - j);
+			}
+
+			for (j = rev; j < (1U << TINF_FAST_BITS); j += 1U << len) {
+				t->fast[j] = (unsigned short) (t->symbols[idx]
+				                               | (len << 9));
+			}
+		}
 
-	for (i = 0; i < 32; ++i) {
-		dt->symbols[i] = i;
+		code <<= 1;
 	}
 
-	dt->max_sym = 29;
+	t->has_fast = 1;
 }
+#endif
 
 /* Given an array of code lengths, build a tree */
 static int tinf_build_tree(struct tinf_tree *t, const unsigned char *lengths,
@@ -170,17 +366,128 @@ static int tinf_build_tree(struct tinf_tree *t, const unsigned char *lengths,
 		t->symbols[1] = t->max_sym + 1;
 	}
 
+#if defined(TINF_ENGINE_FAST)
+	t->has_fast = 0;
+#endif
+
 	return TINF_OK;
 }
 
+/* Get the code lengths a tree was built from */
+static void tinf_tree_lengths(const struct tinf_tree *t,
+                              unsigned char *lengths, unsigned int num)
+{
+	unsigned int i, len, idx = 0;
+
+	for (i = 0; i < num; ++i) {
+		lengths[i] = 0;
+	}
+
+	for (len = 1; len < 16; ++len) {
+		for (i = 0; i < t->counts[len]; ++i, ++idx) {
+			int sym = t->symbols[idx];
+
+			/* Skip the code added for the case of a single code */
+			if ((unsigned int) sym < num
+			 && !(len == 1 && sym > t->max_sym)) {
+				lengths[sym] = (unsigned char) len;
+			}
+		}
+	}
+}
+
 /* -- Decode functions -- */
 
-static void tinf_refill(struct tinf_data *d, int num)
+/* Pull next non-empty segment of input, returns 0 at end of input */
+static int tinf_pull(struct tinf_data *d)
+{
+	while (d->source == d->source_end) {
+		const unsigned char *data;
+		size_t len;
+
+		if (d->pull == NULL) {
+			return 0;
+		}
+
+		len = d->pull(d->pull_arg, &data);
+
+		/* No more calls after the end of input */
+		if (len == 0) {
+			d->pull = NULL;
+			return 0;
+		}
+
+		d->source = data;
+		d->source_end = data + len;
+	}
+
+	return 1;
+}
+
+/*
+ * Read as many whole bytes as fit in tag with one load. The bits of the
+ * next byte that also land in tag are the same as those it will be or'ed
+ * in with later. Bytes read ahead are returned to source by tinf_unread,
+ * so this is only done with contiguous input.
+ */
+static TINF_INLINE void tinf_load_wide(struct tinf_data *d)
+{
+	d->tag |= read_le32(d->source) << d->bitcount;
+	d->source += (31 - d->bitcount) >> 3;
+	d->bitcount |= 24;
+}
+
+#if defined(TINF_ENGINE_FAST)
+/* Load wide if there are at least num bits missing, and input to load */
+static TINF_INLINE void tinf_refill_wide(struct tinf_data *d, int num,
+                                         int mode)
+{
+	if (d->bitcount >= num) {
+		return;
+	}
+
+	if (mode == TINF_MODE_PADDED) {
+		tinf_load_wide(d);
+	}
+	else if ((mode != TINF_MODE_GENERAL || d->pull == NULL)
+	      && d->source_end - d->source >= 4) {
+		tinf_load_wide(d);
+	}
+}
+#endif
+
+/*
+ * Read bytes until at least num bits are available. Only the general mode
+ * pulls input, so the other modes keep the byte loop of contiguous input.
+ */
+static TINF_INLINE void tinf_refill(struct tinf_data *d, int num, int mode)
 {
 	assert(num >= 0 && num <= 32);
 
-	/* Read bytes until at least num bits available */
+	/*
+	 * Padded input is loaded without checking for the end, which is
+	 * found later by tinf_overflowed
+	 */
+	if (mode == TINF_MODE_PADDED) {
+		assert(num <= 24);
+
+		if (d->bitcount < num) {
+			tinf_load_wide(d);
+		}
+
+		return;
+	}
+
+#if defined(TINF_ENGINE_FAST)
+	tinf_refill_wide(d, num, mode);
+#endif
+
 	while (d->bitcount < num) {
+		if (mode == TINF_MODE_GENERAL
+		 && d->source == d->source_end && d->pull != NULL) {
+			tinf_pull(d);
+		}
+
 		if (d->source != d->source_end) {
 			d->tag |= (unsigned int) *d->source++ << d->bitcount;
 		}
@@ -193,7 +500,8 @@ static void tinf_refill(struct tinf_data *d, int num)
 	assert(d->bitcount <= 32);
 }
 
-static unsigned int tinf_getbits_no_refill(struct tinf_data *d, int num)
+static TINF_INLINE unsigned int tinf_getbits_no_refill(struct tinf_data *d,
+                                                       int num)
 {
 	unsigned int bits;
 
@@ -209,25 +517,82 @@ static unsigned int tinf_getbits_no_refill(struct tinf_data *d, int num)
 	return bits;
 }
 
+/*
+ * Return whole bytes in tag to source, so the next byte of source is the
+ * one the bit position is in (or after, on a byte boundary)
+ */
+static void tinf_unread(struct tinf_data *d)
+{
+	d->source -= d->bitcount >> 3;
+	d->bitcount &= 7;
+	d->tag &= (1U << d->bitcount) - 1;
+}
+
+/*
+ * Check if the bit reader has used bits past the end of source. With
+ * padded input, that is when the position after the last byte used is
+ * past source_end.
+ */
+static TINF_INLINE int tinf_overflowed(const struct tinf_data *d, int mode)
+{
+	if (mode == TINF_MODE_PADDED) {
+		return d->source - (d->bitcount >> 3) > d->source_end;
+	}
+
+	return d->overflow;
+}
+
+/* Mode for reading headers and trees, outside the block decoding loop */
+static int tinf_header_mode(const struct tinf_data *d)
+{
+	return d->padded ? TINF_MODE_PADDED : TINF_MODE_GENERAL;
+}
+
 /* Get num bits from source stream */
-static unsigned int tinf_getbits(struct tinf_data *d, int num)
+static TINF_INLINE unsigned int tinf_read_bits(struct tinf_data *d, int num,
+                                               int mode)
 {
-	tinf_refill(d, num);
+	tinf_refill(d, num, mode);
 	return tinf_getbits_no_refill(d, num);
 }
 
+/* Get num bits from source stream, outside the block decoding loop */
+static unsigned int tinf_getbits(struct tinf_data *d, int num)
+{
+	return tinf_read_bits(d, num, tinf_header_mode(d));
+}
+
 /* Read a num bit value from stream and add base */
-static unsigned int tinf_getbits_base(struct tinf_data *d, int num, int base)
+static TINF_INLINE unsigned int tinf_getbits_base(struct tinf_data *d, int num,
+                                                  int base, int mode)
 {
-	return base + (num ? tinf_getbits(d, num) : 0);
+	return base + (num ? tinf_read_bits(d, num, mode) : 0);
 }
 
 /* Given a data stream and a tree, decode a symbol */
-static int tinf_decode_symbol(struct tinf_data *d, const struct tinf_tree *t)
+static TINF_INLINE int tinf_decode_symbol(struct tinf_data *d,
+                                          const struct tinf_tree *t,
+                                          int mode)
 {
 	int base = 0, offs = 0;
 	int len;
 
+#if defined(TINF_ENGINE_FAST)
+	/* Look up codes of up to TINF_FAST_BITS bits, if enough input */
+	if (t->has_fast) {
+		tinf_refill_wide(d, TINF_FAST_BITS, mode);
+	}
+
+	if (t->has_fast && d->bitcount >= TINF_FAST_BITS) {
+		unsigned int entry = t->fast[d->tag & ((1U << TINF_FAST_BITS) - 1)];
+
+		if (entry != 0) {
+			tinf_getbits_no_refill(d, entry >> 9);
+			return entry & 0x1FF;
+		}
+	}
+#endif
+
 	/*
 	 * Get more bits while code index is above number of codes
 	 *
@@ -242,7 +607,7 @@ static int tinf_decode_symbol(struct tinf_data *d, const struct tinf_tree *t)
 	 * of offs and add one more bit to it.
 	 */
 	for (len = 1; ; ++len) {
-		offs = 2 * offs + tinf_getbits(d, 1);
+		offs = 2 * offs + tinf_read_bits(d, 1, mode);
 
 		assert(len <= 15);
 
@@ -259,6 +624,98 @@ static int tinf_decode_symbol(struct tinf_data *d, const struct tinf_tree *t)
 	return t->symbols[base + offs];
 }
 
+#if defined(TINF_CACHE_TREES)
+static void tinf_clear_cache(struct tinf_cache *c)
+{
+	int i;
+
+	for (i = 0; i < TINF_TREE_CACHE; ++i) {
+		c->entries[i].stamp = 0;
+	}
+
+	c->clock = 0;
+}
+
+/* FNV-1a hash of code lengths */
+static unsigned int tinf_hash_lengths(const unsigned char *lengths,
+                                      unsigned int num)
+{
+	unsigned int hash = 2166136261U;
+	unsigned int i;
+
+	for (i = 0; i < num; ++i) {
+		hash = (hash ^ lengths[i]) * 16777619U;
+	}
+
+	return hash & 0xFFFFFFFF;
+}
+
+/*
+ * Find trees for code lengths in cache and copy them to lt and dt, or
+ * build the trees with tables and store them in place of the least
+ * recently used entry
+ */
+static int tinf_cached_trees(struct tinf_cache *c, struct tinf_tree *lt,
+                             struct tinf_tree *dt,
+                             const unsigned char *lengths,
+                             unsigned int hlit, unsigned int hdist)
+{
+	struct tinf_tree_entry *e, *lru = &c->entries[0];
+	unsigned int hash = tinf_hash_lengths(lengths, hlit + hdist);
+	int i, res;
+
+	/* Empty the cache when the clock wraps, so stamps stay ordered */
+	if (++c->clock == 0) {
+		tinf_clear_cache(c);
+		c->clock = 1;
+	}
+
+	for (i = 0; i < TINF_TREE_CACHE; ++i) {
+		e = &c->entries[i];
+
+		if (e->stamp != 0 && e->hash == hash && e->hlit == hlit
+		 && e->hdist == hdist
+		 && memcmp(e->lengths, lengths, hlit + hdist) == 0) {
+			e->stamp = c->clock;
+
+			memcpy(lt, &e->ltree, sizeof(*lt));
+			memcpy(dt, &e->dtree, sizeof(*dt));
+
+			return TINF_OK;
+		}
+
+		if (e->stamp < lru->stamp) {
+			lru = e;
+		}
+	}
+
+	res = tinf_build_tree(lt, lengths, hlit);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	res = tinf_build_tree(dt, lengths + hlit, hdist);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	tinf_build_fast(lt);
+	tinf_build_fast(dt);
+
+	lru->stamp = c->clock;
+	lru->hash = hash;
+	lru->hlit = hlit;
+	lru->hdist = hdist;
+	memcpy(lru->lengths, lengths, hlit + hdist);
+	memcpy(&lru->ltree, lt, sizeof(*lt));
+	memcpy(&lru->dtree, dt, sizeof(*dt));
+
+	return TINF_OK;
+}
+#endif
+
 /* Given a data stream, decode dynamic trees from it */
 static int tinf_decode_trees(struct tinf_data *d, struct tinf_tree *lt,
                              struct tinf_tree *dt)
@@ -273,16 +730,17 @@ static int tinf_decode_trees(struct tinf_data *d, struct tinf_tree *lt,
 
 	unsigned int hlit, hdist, hclen;
 	unsigned int i, num, length;
+	int mode = tinf_header_mode(d);
 	int res;
 
 	/* Get 5 bits HLIT (257-286) */
-	hlit = tinf_getbits_base(d, 5, 257);
+	hlit = tinf_getbits_base(d, 5, 257, mode);
 
 	/* Get 5 bits HDIST (1-32) */
-	hdist = tinf_getbits_base(d, 5, 1);
+	hdist = tinf_getbits_base(d, 5, 1, mode);
 
 	/* Get 4 bits HCLEN (4-19) */
-	hclen = tinf_getbits_base(d, 4, 4);
+	hclen = tinf_getbits_base(d, 4, 4, mode);
 
 	/*
 	 * The RFC limits the range of HLIT to 286, but lists HDIST as range
@@ -293,7 +751,8 @@ static int tinf_decode_trees(struct tinf_data *d, struct tinf_tree *lt,
 	 *
 	 * See also: https://github.com/madler/zlib/issues/82
 	 */
-	if (hlit > 286 || hdist > 30) {
+	if (hlit > 286 || hdist > 30
+	 || tinf_overflowed(d, mode)) {
 		return TINF_DATA_ERROR;
 	}
 
@@ -321,11 +780,17 @@ static int tinf_decode_trees(struct tinf_data *d, struct tinf_tree *lt,
 		return TINF_DATA_ERROR;
 	}
 
+#if defined(TINF_ENGINE_FAST)
+	/* There are at least 258 code lengths, so a table always pays off */
+	tinf_build_fast(lt);
+#endif
+
 	/* Decode code lengths for the dynamic trees */
 	for (num = 0; num < hlit + hdist; ) {
-		int sym = tinf_decode_symbol(d, lt);
+		int sym = tinf_decode_symbol(d, lt, mode);
 
-		if (sym > lt->max_sym) {
+		/* Stop early on padded input, which has no check per byte */
+		if (sym > lt->max_sym || tinf_overflowed(d, mode)) {
 			return TINF_DATA_ERROR;
 		}
 
@@ -336,17 +801,17 @@ static int tinf_decode_trees(struct tinf_data *d, struct tinf_tree *lt,
 				return TINF_DATA_ERROR;
 			}
 			sym = lengths[num - 1];
-			length = tinf_getbits_base(d, 2, 3);
+			length = tinf_getbits_base(d, 2, 3, mode);
 			break;
 		case 17:
 			/* Repeat code length 0 for 3-10 times (read 3 bits) */
 			sym = 0;
-			length = tinf_getbits_base(d, 3, 3);
+			length = tinf_getbits_base(d, 3, 3, mode);
 			break;
 		case 18:
 			/* Repeat code length 0 for 11-138 times (read 7 bits) */
 			sym = 0;
-			length = tinf_getbits_base(d, 7, 11);
+			length = tinf_getbits_base(d, 7, 11, mode);
 			break;
 		default:
 			/* Values 0-15 represent the actual code lengths */
@@ -368,6 +833,12 @@ static int tinf_decode_trees(struct tinf_data *d, struct tinf_tree *lt,
 		return TINF_DATA_ERROR;
 	}
 
+#if defined(TINF_CACHE_TREES)
+	if (d->cache != NULL) {
+		return tinf_cached_trees(d->cache, lt, dt, lengths, hlit, hdist);
+	}
+#endif
+
 	/* Build dynamic trees */
 	res = tinf_build_tree(lt, lengths, hlit);
 
@@ -384,237 +855,2026 @@ static int tinf_decode_trees(struct tinf_data *d, struct tinf_tree *lt,
 	return TINF_OK;
 }
 
-/* -- Block inflate functions -- */
+/* -- Output sink -- */
 
-/* Given a stream and two trees, inflate a block of data */
-static int tinf_inflate_block_data(struct tinf_data *d, struct tinf_tree *lt,
-                                   struct tinf_tree *dt)
-{
-	/* Extra bits and base tables for length codes */
-	static const unsigned char length_bits[30] = {
-		0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
-		1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
-		4, 4, 4, 4, 5, 5, 5, 5, 0, 127
-	};
+/* Size of history kept for back-references */
+#define TINF_HISTORY 32768
 
-	static const unsigned short length_base[30] = {
-		 3,  4,  5,   6,   7,   8,   9,  10,  11,  13,
-		15, 17, 19,  23,  27,  31,  35,  43,  51,  59,
-		67, 83, 99, 115, 131, 163, 195, 227, 258,   0
-	};
+/* Maximum length of a match */
+#define TINF_MATCH_MAX 258
 
-	/* Extra bits and base tables for distance codes */
-	static const unsigned char dist_bits[30] = {
-		0, 0,  0,  0,  1,  1,  2,  2,  3,  3,
-		4, 4,  5,  5,  6,  6,  7,  7,  8,  8,
-		9, 9, 10, 10, 11, 11, 12, 12, 13, 13
-	};
+/*
+ * Pass output not yet flushed to the sink, and slide the window down to
+ * keep the last 32 KB of history
+ */
+static int tinf_flush(struct tinf_data *d)
+{
+	size_t keep;
 
-	static const unsigned short dist_base[30] = {
-		   1,    2,    3,    4,    5,    7,    9,    13,    17,    25,
-		  33,   49,   65,   97,  129,  193,  257,   385,   513,   769,
-		1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
-	};
+	if (d->dest != d->dest_flushed) {
+		if (d->sink(d->sink_arg, d->dest_flushed,
+		            d->dest - d->dest_flushed)) {
+			return TINF_BUF_ERROR;
+		}
+	}
 
-	for (;;) {
-		int sym = tinf_decode_symbol(d, lt);
+	keep = d->dest - d->dest_start;
 
-		/* Check for overflow in bit reader */
-		if (d->overflow) {
-			return TINF_DATA_ERROR;
-		}
+	if (keep > TINF_HISTORY) {
+		memmove(d->dest_start, d->dest - TINF_HISTORY, TINF_HISTORY);
+		d->dest = d->dest_start + TINF_HISTORY;
+	}
 
-		if (sym < 256) {
-			if (d->dest == d->dest_end) {
-				return TINF_BUF_ERROR;
-			}
-			*d->dest++ = sym;
-		}
-		else {
-			int length, dist, offs;
-			int i;
+	d->dest_flushed = d->dest;
 
-			/* Check for end of block */
-			if (sym == 256) {
-				return TINF_OK;
-			}
+	return TINF_OK;
+}
 
-			/* Check sym is within range and distance tree is not empty */
-			if (sym > lt->max_sym || sym - 257 > 28 || dt->max_sym == -1) {
-				return TINF_DATA_ERROR;
-			}
+/* -- Limits -- */
 
-			sym -= 257;
+/* Number of symbols between checks of limits */
+#define TINF_LIMIT_INTERVAL 4096
 
-			/* Possibly get more bits from length code */
-			length = tinf_getbits_base(d, length_bits[sym],
-			                           length_base[sym]);
+/* Check limits on symbols decoded and expansion ratio */
+static int tinf_check_limits(struct tinf_data *d)
+{
+	const struct tinf_limits *lim = d->limits;
+	size_t out = d->dest - d->dest_start;
+	size_t in = d->source - d->source_start;
 
-			dist = tinf_decode_symbol(d, dt);
+	if (lim->max_symbols != 0 && d->symbols > lim->max_symbols) {
+		return TINF_LIMIT_ERROR;
+	}
 
-			/* Check dist is within range */
-			if (dist > dt->max_sym || dist > 29) {
-				return TINF_DATA_ERROR;
-			}
+	if (lim->max_ratio != 0 && out / lim->max_ratio > in) {
+		return TINF_LIMIT_ERROR;
+	}
 
-			/* Possibly get more bits from distance code */
-			offs = tinf_getbits_base(d, dist_bits[dist],
-			                         dist_base[dist]);
+	d->check_at = d->symbols + TINF_LIMIT_INTERVAL;
 
-			if (offs > d->dest - d->dest_start) {
-				return TINF_DATA_ERROR;
-			}
+	return TINF_OK;
+}
 
-			if (d->dest_end - d->dest < length) {
-				return TINF_BUF_ERROR;
-			}
+/* -- In-place output -- */
 
-			/* Copy match */
-			for (i = 0; i < length; ++i) {
-				d->dest[i] = d->dest[i - offs];
-			}
+#define TINF_INPLACE_LIMIT   1
+#define TINF_INPLACE_MEASURE 2
 
-			d->dest += length;
+/*
+ * Before a symbol, count it and check limits now and then. Flush to sink,
+ * or limit output to the part of source already read, while there may not
+ * be room for a match. When measuring, record how far output plus a match
+ * reaches past the input read
+ */
+static int tinf_make_room(struct tinf_data *d)
+{
+	if (d->limits != NULL && ++d->symbols >= d->check_at) {
+		int res = tinf_check_limits(d);
+
+		if (res != TINF_OK) {
+			return res;
 		}
 	}
-}
 
-/* Inflate an uncompressed block of data */
-static int tinf_inflate_uncompressed_block(struct tinf_data *d)
-{
-	unsigned int length, invlength;
+	if (d->inplace == TINF_INPLACE_MEASURE) {
+		size_t out = (d->dest - d->dest_start) + TINF_MATCH_MAX;
+		size_t in = d->source - d->source_start;
 
-	if (d->source_end - d->source < 4) {
-		return TINF_DATA_ERROR;
+		if (out > in && out - in > d->reach) {
+			d->reach = out - in;
+		}
+
+		return TINF_OK;
+	}
+
+	if (d->dest_end - d->dest >= TINF_MATCH_MAX) {
+		return TINF_OK;
+	}
+
+	if (d->sink != NULL) {
+		return tinf_flush(d);
+	}
+
+	/* Output may overwrite input that has been read */
+	if (d->inplace == TINF_INPLACE_LIMIT) {
+		d->dest_end = (unsigned char *) d->source;
+	}
+
+	return TINF_OK;
+}
+
+/* -- Scatter output functions -- */
+
+/* Move output to next non-empty buffer, returns 0 if there is none */
+static int tinf_next_out(struct tinf_data *d)
+{
+	size_t i;
+
+	if (d->out_iov == NULL) {
+		return 0;
+	}
+
+	for (i = d->out_index + 1; i < d->out_count; ++i) {
+		if (d->out_iov[i].len > 0) {
+			d->out_before += d->dest - d->dest_start;
+			d->out_index = i;
+
+			d->dest_start = (unsigned char *) d->out_iov[i].base;
+			d->dest = d->dest_start;
+			d->dest_end = d->dest_start + d->out_iov[i].len;
+
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* Copy match that reaches into an earlier buffer or past the current one */
+static int tinf_copy_match_iov(struct tinf_data *d, int offs, int length)
+{
+	const unsigned char *src, *src_end;
+	size_t back = (size_t) offs;
+	size_t avail = d->dest - d->dest_start;
+	size_t idx = d->out_index;
+
+	/* Check offs against all output so far */
+	if (back > d->out_before + avail) {
+		return TINF_DATA_ERROR;
+	}
+
+	/* Find buffer containing start of match */
+	while (back > avail) {
+		back -= avail;
+		avail = d->out_iov[--idx].len;
+	}
+
+	src = (const unsigned char *) d->out_iov[idx].base + (avail - back);
+	src_end = (const unsigned char *) d->out_iov[idx].base
+	        + d->out_iov[idx].len;
+
+	while (length-- > 0) {
+		while (src == src_end) {
+			src = (const unsigned char *) d->out_iov[++idx].base;
+			src_end = src + d->out_iov[idx].len;
+		}
+
+		if (d->dest == d->dest_end && !tinf_next_out(d)) {
+			return TINF_BUF_ERROR;
+		}
+
+		*d->dest++ = *src++;
+	}
+
+	return TINF_OK;
+}
+
+/* -- Growing output -- */
+
+/*
+ * Reallocate dest so there is room for at least need more bytes, growing
+ * it geometrically, returns 0 if not growing or the size would exceed
+ * grow_max
+ */
+static int tinf_grow(struct tinf_data *d, size_t need)
+{
+	size_t len = d->dest - d->dest_start;
+	size_t size = d->dest_end - d->dest_start;
+	unsigned char *p;
+
+	if (d->grow == NULL || d->grow_max - len < need) {
+		return 0;
+	}
+
+	size = size < d->grow_max / 2 ? 2 * size : d->grow_max;
+
+	if (size < len + need) {
+		size = len + need;
+	}
+
+	p = (unsigned char *) d->grow->resize(d->grow->opaque, d->dest_start,
+	                                      size);
+
+	if (p == NULL) {
+		d->grow_failed = 1;
+		return 0;
+	}
+
+	d->dest_start = p;
+	d->dest = p + len;
+	d->dest_end = p + size;
+
+	return 1;
+}
+
+/*
+ * Output a literal (length 0) or a match that does not fit in the rest of
+ * dest, or reaches back before dest_start, by moving to the next output
+ * buffer or growing dest
+ */
+static TINF_NOINLINE int tinf_output_slow(struct tinf_data *d, int sym,
+                                          int offs, int length)
+{
+	int i;
+
+	if (d->out_iov != NULL) {
+		if (length > 0) {
+			return tinf_copy_match_iov(d, offs, length);
+		}
+
+		if (!tinf_next_out(d)) {
+			return TINF_BUF_ERROR;
+		}
+
+		*d->dest++ = sym;
+
+		return TINF_OK;
+	}
+
+	if (offs > d->dest - d->dest_start) {
+		return TINF_DATA_ERROR;
+	}
+
+	if (!tinf_grow(d, length > 0 ? length : 1)) {
+		return TINF_BUF_ERROR;
+	}
+
+	if (length == 0) {
+		*d->dest++ = sym;
+
+		return TINF_OK;
+	}
+
+	for (i = 0; i < length; ++i) {
+		d->dest[i] = d->dest[i - offs];
+	}
+
+	d->dest += length;
+
+	return TINF_OK;
+}
+
+/* -- Span functions -- */
+
+/* End current span of decompressed data in dest */
+static void tinf_end_span(struct tinf_data *d)
+{
+	if (d->dest != d->span_start) {
+		d->spans[d->span_count].data = d->span_start;
+		d->spans[d->span_count].len = d->dest - d->span_start;
+		++d->span_count;
+
+		d->span_start = d->dest;
+	}
+}
+
+/*
+ * Copy the part of spans of source within the last 32 KB of output to
+ * dest, so a compressed block can refer to it
+ */
+static void tinf_fill_spans(struct tinf_data *d)
+{
+	unsigned char *p = d->span_start;
+	size_t i = d->span_count;
+
+	while (i > d->span_filled && (size_t) (d->dest - p) < TINF_HISTORY) {
+		const struct tinf_span *sp = &d->spans[--i];
+		size_t need = TINF_HISTORY - (d->dest - p);
+		size_t num = sp->len < need ? sp->len : need;
+
+		p -= sp->len;
+
+		if (sp->data != p) {
+			memcpy(p + (sp->len - num), sp->data + (sp->len - num), num);
+		}
+	}
+
+	d->span_filled = d->span_count;
+}
+
+/*
+ * Choose between the canonical decoder and lookup tables for the trees of
+ * a dynamic block, from its header and the input left for it
+ */
+static void tinf_select_decoder(struct tinf_data *d)
+{
+#if defined(TINF_ENGINE_FAST)
+	size_t left;
+
+	/* Fixed trees and trees from the cache have tables already */
+	if (d->ltree.has_fast) {
+		return;
+	}
+
+	/* Remaining input is unknown when pulling, so assume it is long */
+	left = d->pull != NULL ? (size_t) -1
+	     : (size_t) (d->source_end - d->source);
+
+	if (left < TINF_FAST_MIN_INPUT) {
+		return;
+	}
+
+	tinf_build_fast(&d->ltree);
+
+	/*
+	 * Distances are only decoded for matches, so the table needs a
+	 * longer block, and a block with no length codes (HLIT 257) or few
+	 * distance codes (HDIST) is decoded in a few steps without it
+	 */
+	if (d->ltree.max_sym > 256 && d->dtree.max_sym + 1 >= TINF_FAST_MIN_DIST
+	 && left / 2 >= TINF_FAST_MIN_INPUT) {
+		tinf_build_fast(&d->dtree);
+	}
+#else
+	(void) d;
+#endif
+}
+
+/* -- Block inflate functions -- */
+
+/* Internal status for end of block, distinct from the public codes */
+#define TINF_EOB 1
+
+/* Extra bits and base tables for length codes */
+static const unsigned char length_bits[30] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+	1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+	4, 4, 4, 4, 5, 5, 5, 5, 0, 127
+};
+
+static const unsigned short length_base[30] = {
+	 3,  4,  5,   6,   7,   8,   9,  10,  11,  13,
+	15, 17, 19,  23,  27,  31,  35,  43,  51,  59,
+	67, 83, 99, 115, 131, 163, 195, 227, 258,   0
+};
+
+/* Extra bits and base tables for distance codes */
+static const unsigned char dist_bits[30] = {
+	0, 0,  0,  0,  1,  1,  2,  2,  3,  3,
+	4, 4,  5,  5,  6,  6,  7,  7,  8,  8,
+	9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static const unsigned short dist_base[30] = {
+	   1,    2,    3,    4,    5,    7,    9,    13,    17,    25,
+	  33,   49,   65,   97,  129,  193,  257,   385,   513,   769,
+	1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+
+/*
+ * Given a stream and two trees, inflate one literal or match, returns
+ * TINF_EOB at the end of the block. With the fast engine, matches are
+ * copied chunk bytes at a time where possible, chunk is 8 or 32.
+ */
+static TINF_INLINE int tinf_inflate_symbol(struct tinf_data *d,
+                                           const struct tinf_tree *lt,
+                                           const struct tinf_tree *dt,
+                                           int chunk, int mode)
+{
+	int sym = tinf_decode_symbol(d, lt, mode);
+
+	/* Check for overflow in bit reader */
+	if (tinf_overflowed(d, mode)) {
+		return TINF_DATA_ERROR;
+	}
+
+	if (sym < 256) {
+		if (d->dest == d->dest_end) {
+			return tinf_output_slow(d, sym, 0, 0);
+		}
+		*d->dest++ = sym;
+	}
+	else {
+		int length, dist, offs;
+		int i;
+
+		/* Check for end of block */
+		if (sym == 256) {
+			return TINF_EOB;
+		}
+
+		/* Check sym is within range and distance tree is not empty */
+		if (sym > lt->max_sym || sym - 257 > 28 || dt->max_sym == -1) {
+			return TINF_DATA_ERROR;
+		}
+
+		sym -= 257;
+
+		/* Possibly get more bits from length code */
+		length = tinf_getbits_base(d, length_bits[sym],
+		                           length_base[sym], mode);
+
+		dist = tinf_decode_symbol(d, dt, mode);
+
+		/* Check dist is within range */
+		if (dist > dt->max_sym || dist > 29) {
+			return TINF_DATA_ERROR;
+		}
+
+		/* Possibly get more bits from distance code */
+		offs = tinf_getbits_base(d, dist_bits[dist],
+		                         dist_base[dist], mode);
+
+		if (offs > d->dest - d->dest_start
+		 || d->dest_end - d->dest < length) {
+			return tinf_output_slow(d, 0, offs, length);
+		}
+
+#if defined(TINF_ENGINE_FAST)
+		/*
+		 * Copy match chunk bytes at a time when the chunks do not
+		 * overlap and there is room, or slop, for the bytes past it
+		 */
+		if (chunk > 8 && offs >= chunk
+		 && d->dest_end - d->dest + TINF_ROOM_PAST(mode) >= length + chunk - 1) {
+			for (i = 0; i < length; i += chunk) {
+				memcpy(d->dest + i, d->dest + i - offs, chunk);
+			}
+
+			d->dest += length;
+
+			return TINF_OK;
+		}
+
+		if (offs >= 8 && d->dest_end - d->dest + TINF_ROOM_PAST(mode) >= length + 7) {
+			for (i = 0; i < length; i += 8) {
+				memcpy(d->dest + i, d->dest + i - offs, 8);
+			}
+
+			d->dest += length;
+
+			return TINF_OK;
+		}
+#else
+		(void) chunk;
+#endif
+
+		/* Copy match */
+		for (i = 0; i < length; ++i) {
+			d->dest[i] = d->dest[i - offs];
+		}
+
+		d->dest += length;
+	}
+
+	return TINF_OK;
+}
+
+/* Given a stream and two trees, inflate a block of data */
+static TINF_INLINE int tinf_inflate_block_loop(struct tinf_data *d,
+                                               const struct tinf_tree *lt,
+                                               const struct tinf_tree *dt,
+                                               int chunk, int mode)
+{
+	for (;;) {
+		int res;
+
+		/* Flush to sink, limit in-place output, or check limits */
+		if (mode == TINF_MODE_GENERAL && d->hooks) {
+			res = tinf_make_room(d);
+
+			if (res != TINF_OK) {
+				return res;
+			}
+		}
+
+		res = tinf_inflate_symbol(d, lt, dt, chunk, mode);
+
+		if (res != TINF_OK) {
+			return res == TINF_EOB ? TINF_OK : res;
+		}
+	}
+}
+
+/* -- Decode kernels -- */
+
+/* Kernel used by tinf_inflate_block_data */
+static int tinf_active_kernel = TINF_KERNEL_PORTABLE;
+
+#if defined(TINF_DISPATCH)
+TINF_TARGET("bmi2")
+static int tinf_inflate_block_bmi2(struct tinf_data *d,
+                                   const struct tinf_tree *lt,
+                                   const struct tinf_tree *dt)
+{
+	return tinf_inflate_block_loop(d, lt, dt, 8, TINF_MODE_PLAIN);
+}
+
+TINF_TARGET("avx2,bmi2")
+static int tinf_inflate_block_avx2(struct tinf_data *d,
+                                   const struct tinf_tree *lt,
+                                   const struct tinf_tree *dt)
+{
+	return tinf_inflate_block_loop(d, lt, dt, 32, TINF_MODE_PLAIN);
+}
+
+TINF_TARGET("avx2,bmi2")
+static int tinf_inflate_slop_avx2(struct tinf_data *d,
+                                  const struct tinf_tree *lt,
+                                  const struct tinf_tree *dt)
+{
+	return tinf_inflate_block_loop(d, lt, dt, 32, TINF_MODE_SLOP);
+}
+
+/* Select the best kernel once, before main */
+__attribute__((constructor))
+static void tinf_kernel_init(void)
+{
+	tinf_set_kernel(TINF_KERNEL_AUTO);
+}
+#endif
+
+/* Check if kernel is built and supported by the CPU */
+static int tinf_kernel_supported(int kernel)
+{
+#if defined(TINF_DISPATCH)
+	__builtin_cpu_init();
+
+	if (kernel == TINF_KERNEL_BMI2) {
+		return __builtin_cpu_supports("bmi2");
+	}
+
+	if (kernel == TINF_KERNEL_AVX2) {
+		return __builtin_cpu_supports("avx2")
+		    && __builtin_cpu_supports("bmi2");
+	}
+#endif
+
+	return kernel == TINF_KERNEL_PORTABLE;
+}
+
+/*
+ * Inflate a block with pulled input, or with hooks, which is kept out of
+ * the other loops
+ */
+static int tinf_inflate_block_general(struct tinf_data *d,
+                                      const struct tinf_tree *lt,
+                                      const struct tinf_tree *dt)
+{
+	return tinf_inflate_block_loop(d, lt, dt, 8, TINF_MODE_GENERAL);
+}
+
+/* Inflate a block of padded input without hooks */
+static int tinf_inflate_block_padded(struct tinf_data *d,
+                                     const struct tinf_tree *lt,
+                                     const struct tinf_tree *dt)
+{
+	return tinf_inflate_block_loop(d, lt, dt, 8, TINF_MODE_PADDED);
+}
+
+#if defined(TINF_ENGINE_FAST)
+/* Inflate a block of input to dest followed by slop, without hooks */
+static int tinf_inflate_block_slop(struct tinf_data *d,
+                                   const struct tinf_tree *lt,
+                                   const struct tinf_tree *dt)
+{
+	return tinf_inflate_block_loop(d, lt, dt, 8, TINF_MODE_SLOP);
+}
+#endif
+
+/* Inflate a block of contiguous input without hooks */
+static int tinf_inflate_block_plain(struct tinf_data *d,
+                                    const struct tinf_tree *lt,
+                                    const struct tinf_tree *dt)
+{
+	return tinf_inflate_block_loop(d, lt, dt, 8, TINF_MODE_PLAIN);
+}
+
+/* Inflate a block of data with the selected loop and kernel */
+static int tinf_inflate_block_data(struct tinf_data *d,
+                                   const struct tinf_tree *lt,
+                                   const struct tinf_tree *dt)
+{
+	if (d->hooks || d->pull != NULL) {
+		return tinf_inflate_block_general(d, lt, dt);
+	}
+
+	if (d->padded) {
+		return tinf_inflate_block_padded(d, lt, dt);
+	}
+
+#if defined(TINF_ENGINE_FAST)
+	if (d->slop) {
+#  if defined(TINF_DISPATCH)
+		if (tinf_active_kernel == TINF_KERNEL_AVX2) {
+			return tinf_inflate_slop_avx2(d, lt, dt);
+		}
+#  endif
+
+		return tinf_inflate_block_slop(d, lt, dt);
+	}
+#endif
+
+#if defined(TINF_DISPATCH)
+	if (tinf_active_kernel == TINF_KERNEL_AVX2) {
+		return tinf_inflate_block_avx2(d, lt, dt);
+	}
+
+	if (tinf_active_kernel == TINF_KERNEL_BMI2) {
+		return tinf_inflate_block_bmi2(d, lt, dt);
+	}
+#endif
+
+	return tinf_inflate_block_plain(d, lt, dt);
+}
+
+/* Inflate an uncompressed block of data */
+static int tinf_inflate_uncompressed_block(struct tinf_data *d)
+{
+	unsigned char header[4];
+	unsigned int length, invlength;
+	int i;
+
+	/* The header starts at the byte after the block type */
+	tinf_unread(d);
+
+	if (d->pull == NULL && d->source_end - d->source < 4) {
+		return TINF_DATA_ERROR;
+	}
+
+	/* Read header, which may span segments of input */
+	for (i = 0; i < 4; ++i) {
+		if (!tinf_pull(d)) {
+			return TINF_DATA_ERROR;
+		}
+
+		header[i] = *d->source++;
+	}
+
+	/* Get length */
+	length = read_le16(header);
+
+	/* Get one's complement of length */
+	invlength = read_le16(header + 2);
+
+	/* Check length */
+	if (length != (~invlength & 0x0000FFFF)) {
+		return TINF_DATA_ERROR;
+	}
+
+	if (d->pull == NULL && d->source_end - d->source < length) {
+		return TINF_DATA_ERROR;
+	}
+
+	/* In-place, the block may overwrite its own input as it is copied */
+	if (d->inplace == TINF_INPLACE_LIMIT) {
+		d->dest_end = (unsigned char *) d->source + length;
+	}
+
+	if (d->sink == NULL && d->out_iov == NULL
+	 && d->dest_end - d->dest < length && !tinf_grow(d, length)) {
+		return TINF_BUF_ERROR;
+	}
+
+	/* Pass block as a span of source, if there are spans left */
+	if (length > 0 && d->span_max - d->span_count >= 3) {
+		tinf_end_span(d);
+
+		d->spans[d->span_count].data = d->source;
+		d->spans[d->span_count].len = length;
+		++d->span_count;
+
+		d->source += length;
+		d->dest += length;
+		d->span_start = d->dest;
+
+		length = 0;
+	}
+
+	/*
+	 * Copy block, flushing to sink or moving to the next output buffer
+	 * when the current one is full, and pulling input when a segment is
+	 * used up
+	 */
+	while (length > 0) {
+		unsigned int num;
+
+		if (d->dest == d->dest_end) {
+			int res = d->sink != NULL ? tinf_flush(d)
+			        : tinf_next_out(d) ? TINF_OK : TINF_BUF_ERROR;
+
+			if (res != TINF_OK) {
+				return res;
+			}
+		}
+
+		if (!tinf_pull(d)) {
+			return TINF_DATA_ERROR;
+		}
+
+		num = d->dest_end - d->dest < length
+		    ? (unsigned int) (d->dest_end - d->dest) : length;
+
+		if (d->source_end - d->source < num) {
+			num = (unsigned int) (d->source_end - d->source);
+		}
+
+		length -= num;
+
+		memmove(d->dest, d->source, num);
+
+		d->dest += num;
+		d->source += num;
+	}
+
+	/* Make sure we start next block on a byte boundary */
+	d->tag = 0;
+	d->bitcount = 0;
+
+	return TINF_OK;
+}
+
+/* Inflate a block of data compressed with fixed Huffman trees */
+static int tinf_inflate_fixed_block(struct tinf_data *d)
+{
+	/* Decode block using fixed trees, which have tables already */
+	return tinf_inflate_block_data(d, &tinf_fixed_ltree, &tinf_fixed_dtree);
+}
+
+/* Inflate a block of data compressed with dynamic Huffman trees */
+static int tinf_inflate_dynamic_block(struct tinf_data *d)
+{
+	/* Decode trees from stream */
+	int res = tinf_decode_trees(d, &d->ltree, &d->dtree);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	tinf_select_decoder(d);
+
+	/* Decode block using decoded trees */
+	return tinf_inflate_block_data(d, &d->ltree, &d->dtree);
+}
+
+/* Inflate blocks until the final block, or a sync point at or after sync */
+static int tinf_inflate_blocks(struct tinf_data *d, size_t sync,
+                               int *final)
+{
+	const unsigned char *start = d->source;
+	int bfinal;
+
+	do {
+		unsigned char *dest = d->dest;
+		unsigned int btype;
+		int res;
+
+		/* Read final block flag */
+		bfinal = tinf_getbits(d, 1);
+
+		/* Read block type (2 bits) */
+		btype = tinf_getbits(d, 2);
+
+		/* Make sure history from spans of source is in dest */
+		if (btype != 0 && d->span_filled != d->span_count) {
+			tinf_fill_spans(d);
+		}
+
+		/* Decompress block */
+		switch (btype) {
+		case 0:
+			/* Decompress uncompressed block */
+			res = tinf_inflate_uncompressed_block(d);
+			break;
+		case 1:
+			/* Decompress block with fixed Huffman trees */
+			res = tinf_inflate_fixed_block(d);
+			break;
+		case 2:
+			/* Decompress block with dynamic Huffman trees */
+			res = tinf_inflate_dynamic_block(d);
+			break;
+		default:
+			res = TINF_DATA_ERROR;
+			break;
+		}
+
+		if (res != TINF_OK) {
+			return res;
+		}
+
+		if (d->limits != NULL) {
+			res = tinf_check_limits(d);
+
+			if (res != TINF_OK) {
+				return res;
+			}
+		}
+
+		/* An empty non-final uncompressed block is a sync point */
+		if (btype == 0 && d->dest == dest && d->pull == NULL
+		 && (size_t) (d->source - start) >= sync) {
+			break;
+		}
+	} while (!bfinal);
+
+	/* Check for overflow in bit reader */
+	if (tinf_overflowed(d, tinf_header_mode(d))) {
+		return TINF_DATA_ERROR;
+	}
+
+	/* Leave source at the end of the data, for callers that use it */
+	tinf_unread(d);
+
+	*final = bfinal;
+
+	return TINF_OK;
+}
+
+/* Set up d for decoding source to dest, keeping its tree cache */
+static void tinf_init_state(struct tinf_data *d, void *dest, size_t destLen,
+                            const void *source, size_t sourceLen)
+{
+	d->source = (const unsigned char *) source;
+	d->source_end = d->source + sourceLen;
+	d->pull = NULL;
+	d->pull_arg = NULL;
+	d->tag = 0;
+	d->bitcount = 0;
+	d->overflow = 0;
+	d->padded = 0;
+
+	d->dest = (unsigned char *) dest;
+	d->dest_start = d->dest;
+	d->dest_end = d->dest + destLen;
+	d->slop = 0;
+
+	d->inplace = 0;
+	d->source_start = d->source;
+	d->reach = 0;
+
+	d->limits = NULL;
+	d->symbols = 0;
+	d->check_at = 0;
+
+	d->hooks = 0;
+
+	d->sink = NULL;
+	d->sink_arg = NULL;
+	d->dest_flushed = d->dest;
+
+	d->out_iov = NULL;
+	d->out_count = 0;
+	d->out_index = 0;
+	d->out_before = 0;
+
+	d->grow = NULL;
+	d->grow_max = 0;
+	d->grow_failed = 0;
+
+	d->spans = NULL;
+	d->span_max = 0;
+	d->span_count = 0;
+	d->span_filled = 0;
+	d->span_start = d->dest;
+}
+
+static void tinf_init_data(struct tinf_data *d, void *dest, size_t destLen,
+                           const void *source, size_t sourceLen)
+{
+	tinf_init_state(d, dest, destLen, source, sourceLen);
+
+#if defined(TINF_CACHE_TREES)
+	d->cache = NULL;
+#endif
+}
+
+/* Decode with trees from cache, which is emptied */
+static void tinf_use_cache(struct tinf_data *d, struct tinf_cache *cache)
+{
+#if defined(TINF_CACHE_TREES)
+	tinf_clear_cache(cache);
+	d->cache = cache;
+#else
+	(void) d;
+	(void) cache;
+#endif
+}
+
+/*
+ * Output to dest as the second of two buffers after history, so matches
+ * that reach into the history are copied from there
+ */
+static void tinf_init_history(struct tinf_data *d, struct tinf_iovec *iov,
+                              const void *history, size_t historyLen)
+{
+	/* Only the last 32 KB can be referenced */
+	if (historyLen > TINF_HISTORY) {
+		history = (const unsigned char *) history
+		        + (historyLen - TINF_HISTORY);
+		historyLen = TINF_HISTORY;
+	}
+
+	/* The history is never written to */
+	iov[0].base = (void *) history;
+	iov[0].len = historyLen;
+	iov[1].base = d->dest_start;
+	iov[1].len = d->dest_end - d->dest_start;
+
+	d->out_iov = iov;
+	d->out_count = 2;
+	d->out_index = 1;
+	d->out_before = historyLen;
+}
+
+/* -- Lanes -- */
+
+/* Decoder state advanced one block header or symbol at a time */
+struct tinf_lane {
+	struct tinf_data d;
+	int bfinal;
+	int in_block;
+};
+
+/* Find the deflate data in source of format */
+static int tinf_unwrap(int format, const void *source, size_t sourceLen,
+                       size_t destLen, const unsigned char **start,
+                       size_t *length)
+{
+	switch (format) {
+	case TINF_FORMAT_DEFLATE:
+		*start = (const unsigned char *) source;
+		*length = sourceLen;
+		return TINF_OK;
+	case TINF_FORMAT_ZLIB:
+		return tinf_zlib_unwrap(source, sourceLen, start, length);
+	case TINF_FORMAT_GZIP:
+		return tinf_gzip_unwrap(source, sourceLen, destLen,
+		                        start, length);
+	default:
+		return TINF_DATA_ERROR;
+	}
+}
+
+/* Find the deflate data in source of format and start decoding it in lane */
+static int tinf_lane_start(struct tinf_lane *l, int format,
+                           void *dest, size_t destLen,
+                           const void *source, size_t sourceLen)
+{
+	const unsigned char *start;
+	size_t length;
+	int res;
+
+	res = tinf_unwrap(format, source, sourceLen, destLen, &start, &length);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	/* The tree cache of the lane is kept */
+	tinf_init_state(&l->d, dest, destLen, start, length);
+
+	l->bfinal = 0;
+	l->in_block = 0;
+
+	return TINF_OK;
+}
+
+/*
+ * Advance lane by one block header or symbol, returns TINF_EOB at the end
+ * of the final block
+ */
+static int tinf_lane_step(struct tinf_lane *l)
+{
+	struct tinf_data *d = &l->d;
+	unsigned int btype;
+	int res;
+
+	if (l->in_block) {
+		res = tinf_inflate_symbol(d, &d->ltree, &d->dtree, 8,
+		                          TINF_MODE_GENERAL);
+
+		if (res != TINF_EOB) {
+			return res;
+		}
+
+		l->in_block = 0;
+
+		return l->bfinal ? TINF_EOB : TINF_OK;
+	}
+
+	/* Read final block flag */
+	l->bfinal = tinf_getbits(d, 1);
+
+	/* Read block type (2 bits) */
+	btype = tinf_getbits(d, 2);
+
+	switch (btype) {
+	case 0:
+		/* Decompress uncompressed block */
+		res = tinf_inflate_uncompressed_block(d);
+
+		if (res == TINF_OK && l->bfinal) {
+			return TINF_EOB;
+		}
+		return res;
+	case 1:
+		/* Use fixed Huffman trees */
+		d->ltree = tinf_fixed_ltree;
+		d->dtree = tinf_fixed_dtree;
+		break;
+	case 2:
+		/* Decode trees from stream */
+		res = tinf_decode_trees(d, &d->ltree, &d->dtree);
+
+		if (res != TINF_OK) {
+			return res;
+		}
+		break;
+	default:
+		return TINF_DATA_ERROR;
+	}
+
+	tinf_select_decoder(d);
+
+	l->in_block = 1;
+
+	return TINF_OK;
+}
+
+/* -- Stepwise decoding -- */
+
+/* Stream decoded a step at a time with a lane, which keeps its state */
+struct tinf_stream {
+	/* Arguments the stream was created with */
+	int format;
+	const void *source;
+	size_t source_len;
+	void *dest;
+	size_t dest_len;
+
+	struct tinf_lane lane;
+	int result; /* TINF_MORE until finished */
+
+	const unsigned char *start; /* Start of deflate data */
+
+	/* Checksum and size of output before checked */
+	unsigned int check;
+	size_t check_len;
+	unsigned char *checked;
+
+	/* Output before dest, for a stream restored from a checkpoint */
+	struct tinf_iovec iov[2];
+	unsigned char window[TINF_HISTORY];
+
+	struct tinf_cache cache; /* Trees of earlier blocks of the stream */
+};
+
+/* Checkpoint layout, all values little-endian */
+#define TINF_CP_MAGIC    0x464E4954 /* "TINF" */
+#define TINF_CP_VERSION  1
+#define TINF_CP_HEADER   48
+#define TINF_CP_LENGTHS  ((288 + 32) / 2)
+
+/* Update checksum with output up to dest */
+static void tinf_stream_update_check(struct tinf_stream *s)
+{
+	struct tinf_data *d = &s->lane.d;
+	size_t num = d->dest - s->checked;
+
+	if (num == 0) {
+		return;
+	}
+
+	switch (s->format) {
+	case TINF_FORMAT_ZLIB:
+		s->check = tinf_adler32_combine(s->check,
+		                                tinf_adler32_z(s->checked, num),
+		                                num);
+		break;
+	case TINF_FORMAT_GZIP:
+		s->check = tinf_crc32_combine(s->check,
+		                              tinf_crc32_z(s->checked, num), num);
+		break;
+	default:
+		break;
+	}
+
+	s->check_len += num;
+	s->checked = d->dest;
+}
+
+/* Finish stream given the status of its last step */
+static int tinf_stream_finish(struct tinf_stream *s, int res)
+{
+	/* Check for overflow in bit reader */
+	if (res == TINF_EOB) {
+		res = s->lane.d.overflow ? TINF_DATA_ERROR : TINF_OK;
+	}
+
+	tinf_stream_update_check(s);
+
+	switch (s->format) {
+	case TINF_FORMAT_ZLIB:
+		if (res != TINF_OK) {
+			return TINF_DATA_ERROR;
+		}
+		return tinf_zlib_check_value(s->check, s->source,
+		                             s->source_len);
+	case TINF_FORMAT_GZIP:
+		if (res != TINF_OK) {
+			return res == TINF_BUF_ERROR ? TINF_BUF_ERROR
+			                             : TINF_DATA_ERROR;
+		}
+		return tinf_gzip_check_value(s->check, s->check_len,
+		                             s->source, s->source_len);
+	default:
+		return res;
+	}
+}
+
+/* Start stream, with output counted and checked from dest */
+static void tinf_stream_init(struct tinf_stream *s, int format,
+                             void *dest, size_t destLen,
+                             const void *source, size_t sourceLen)
+{
+	s->format = format;
+	s->source = source;
+	s->source_len = sourceLen;
+	s->dest = dest;
+	s->dest_len = destLen;
+
+	s->start = NULL;
+	s->check = format == TINF_FORMAT_ZLIB ? 1 : 0;
+	s->check_len = 0;
+	s->checked = (unsigned char *) dest;
+
+	/* No output until started, for the size reported by steps */
+	tinf_init_data(&s->lane.d, dest, 0, source, 0);
+	tinf_use_cache(&s->lane.d, &s->cache);
+	s->lane.bfinal = 0;
+	s->lane.in_block = 0;
+}
+
+/* Restore decoder state from checkpoint cp of cpLen bytes */
+static int tinf_stream_load(struct tinf_stream *s, const unsigned char *cp,
+                            size_t cpLen)
+{
+	struct tinf_data *d = &s->lane.d;
+	const unsigned char *start;
+	unsigned char lengths[288 + 32];
+	size_t length, sourceLen, offset, total, window;
+	unsigned int flags, bitcount, i;
+	int res;
+
+	if (cpLen < TINF_CP_HEADER + 4
+	 || read_le32(cp) != TINF_CP_MAGIC || cp[4] != TINF_CP_VERSION
+	 || read_le32(cp + cpLen - 4) != tinf_crc32_z(cp, cpLen - 4)) {
+		return TINF_DATA_ERROR;
+	}
+
+	flags = cp[6];
+	bitcount = cp[7];
+	window = read_le32(cp + 40);
+
+	if (!read_le64(cp + 16, &sourceLen) || !read_le64(cp + 24, &offset)
+	 || !read_le64(cp + 32, &total)
+	 || sourceLen != s->source_len
+	 || bitcount > 32 || window > TINF_HISTORY || window > total
+	 || cpLen != TINF_CP_HEADER + ((flags & 2) ? TINF_CP_LENGTHS : 0)
+	           + window + 4) {
+		return TINF_DATA_ERROR;
+	}
+
+	/* The size in the gzip trailer is checked at the end */
+	res = tinf_unwrap(s->format, s->source, s->source_len,
+	                  (size_t) -1, &start, &length);
+
+	if (res != TINF_OK || offset > length) {
+		return TINF_DATA_ERROR;
+	}
+
+	tinf_init_state(d, s->dest, s->dest_len, start + offset,
+	                length - offset);
+
+	d->source_start = start;
+	d->tag = read_le32(cp + 8);
+	d->bitcount = (int) bitcount;
+	d->overflow = (flags & 4) != 0;
+
+	s->start = start;
+	s->check = read_le32(cp + 12);
+	s->check_len = total;
+	s->lane.bfinal = flags & 1;
+	s->lane.in_block = (flags & 2) != 0;
+
+	cp += TINF_CP_HEADER;
+
+	/* Rebuild trees of current block from code lengths */
+	if (s->lane.in_block) {
+		for (i = 0; i < 288 + 32; ++i) {
+			lengths[i] = (cp[i / 2] >> (4 * (i & 1))) & 0x0F;
+		}
+
+		if (tinf_build_tree(&d->ltree, lengths, 288) != TINF_OK
+		 || tinf_build_tree(&d->dtree, lengths + 288, 32) != TINF_OK) {
+			return TINF_DATA_ERROR;
+		}
+
+		tinf_select_decoder(d);
+
+		cp += TINF_CP_LENGTHS;
+	}
+
+	/* Last output is history for matches */
+	memcpy(s->window, cp, window);
+	tinf_init_history(d, s->iov, s->window, window);
+
+	return TINF_OK;
+}
+
+/* -- Public functions -- */
+
+/* Initialize global (static) data */
+void tinf_init(void)
+{
+	return;
+}
+
+/* Select decode kernel, or the best supported one */
+int tinf_set_kernel(int kernel)
+{
+	if (kernel == TINF_KERNEL_AUTO) {
+		kernel = TINF_KERNEL_AVX2;
+
+		while (!tinf_kernel_supported(kernel)) {
+			--kernel;
+		}
+	}
+	else if (!tinf_kernel_supported(kernel)) {
+		kernel = TINF_KERNEL_PORTABLE;
+	}
+
+	tinf_active_kernel = kernel;
+
+	return kernel;
+}
+
+/* Inflate stream from source to dest */
+int tinf_uncompress(void *dest, unsigned int *destLen,
+                    const void *source, unsigned int sourceLen)
+{
+	size_t dlen = *destLen;
+	int res;
+
+	res = tinf_uncompress_z(dest, &dlen, source, sourceLen);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	*destLen = (unsigned int) dlen;
+
+	return TINF_OK;
+}
+
+int tinf_uncompress_z(void *dest, size_t *destLen,
+                      const void *source, size_t sourceLen)
+{
+	struct tinf_data d;
+	int final;
+	int res;
+
+	tinf_init_data(&d, dest, *destLen, source, sourceLen);
+
+	res = tinf_inflate_blocks(&d, (size_t) -1, &final);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	*destLen = d.dest - d.dest_start;
+
+	return TINF_OK;
+}
+
+/* -- Tree cache -- */
+
+struct tinf_cache *tinf_cache_create(void)
+{
+	struct tinf_cache *cache;
+
+	cache = (struct tinf_cache *) tinf_malloc(sizeof(*cache));
+
+#if defined(TINF_CACHE_TREES)
+	if (cache != NULL) {
+		tinf_clear_cache(cache);
+	}
+#endif
+
+	return cache;
+}
+
+void tinf_cache_destroy(struct tinf_cache *cache)
+{
+	tinf_free(cache);
+}
+
+/* Inflate data in format from source to dest, reusing trees from cache */
+int tinf_uncompress_cached(struct tinf_cache *cache, int format,
+                           void *dest, size_t *destLen,
+                           const void *source, size_t sourceLen)
+{
+	struct tinf_data d;
+	const unsigned char *start;
+	size_t length;
+	int final;
+	int res;
+
+	res = tinf_unwrap(format, source, sourceLen, *destLen, &start, &length);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	tinf_init_data(&d, dest, *destLen, start, length);
+
+#if defined(TINF_CACHE_TREES)
+	d.cache = cache;
+#else
+	(void) cache;
+#endif
+
+	res = tinf_inflate_blocks(&d, (size_t) -1, &final);
+
+	switch (format) {
+	case TINF_FORMAT_ZLIB:
+		if (res != TINF_OK) {
+			return TINF_DATA_ERROR;
+		}
+		res = tinf_zlib_check(dest, d.dest - d.dest_start,
+		                      source, sourceLen);
+		break;
+	case TINF_FORMAT_GZIP:
+		if (res != TINF_OK) {
+			return res == TINF_BUF_ERROR ? TINF_BUF_ERROR
+			                             : TINF_DATA_ERROR;
+		}
+		res = tinf_gzip_check(dest, d.dest - d.dest_start,
+		                      source, sourceLen);
+		break;
+	default:
+		break;
+	}
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	*destLen = d.dest - d.dest_start;
+
+	return TINF_OK;
+}
+
+/* Inflate stream from padded source to dest */
+int tinf_uncompress_padded(void *dest, size_t *destLen,
+                           const void *source, size_t sourceLen)
+{
+	struct tinf_data d;
+	int final;
+	int res;
+
+	tinf_init_data(&d, dest, *destLen, source, sourceLen);
+
+	d.padded = 1;
+
+	res = tinf_inflate_blocks(&d, (size_t) -1, &final);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	*destLen = d.dest - d.dest_start;
+
+	return TINF_OK;
+}
+
+/* Inflate stream from source to dest, which is followed by slop */
+int tinf_uncompress_slop(void *dest, size_t *destLen,
+                         const void *source, size_t sourceLen)
+{
+	struct tinf_data d;
+	int final;
+	int res;
+
+	tinf_init_data(&d, dest, *destLen, source, sourceLen);
+
+	d.slop = 1;
+
+	res = tinf_inflate_blocks(&d, (size_t) -1, &final);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	*destLen = d.dest - d.dest_start;
+
+	return TINF_OK;
+}
+
+/* Inflate stream from source to dest, stopping at a sync point */
+int tinf_uncompress_segment(void *dest, size_t *destLen,
+                            const void *source, size_t *sourceLen,
+                            size_t syncOffset, int *final)
+{
+	struct tinf_data d;
+	int res;
+
+	tinf_init_data(&d, dest, *destLen, source, *sourceLen);
+
+	res = tinf_inflate_blocks(&d, syncOffset, final);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	*sourceLen = d.source - (const unsigned char *) source;
+	*destLen = d.dest - d.dest_start;
+
+	return TINF_OK;
+}
+
+/* Inflate stream to a growing buffer, stopping at a sync point */
+int tinf_uncompress_segment_alloc(void **dest, size_t *destSize,
+                                  size_t *destLen,
+                                  const void *source, size_t *sourceLen,
+                                  size_t syncOffset, int *final,
+                                  size_t maxLen)
+{
+	struct tinf_data d;
+	int res;
+
+	tinf_init_data(&d, *dest, *destSize, source, *sourceLen);
+
+	d.grow = tinf_get_allocator();
+	d.grow_max = maxLen;
+
+	res = tinf_inflate_blocks(&d, syncOffset, final);
+
+	/* The buffer may have moved even if decompression failed */
+	*dest = d.dest_start;
+	*destSize = d.dest_end - d.dest_start;
+
+	if (res != TINF_OK) {
+		return res == TINF_BUF_ERROR && d.grow_failed ? TINF_MEM_ERROR
+		                                              : res;
+	}
+
+	*sourceLen = d.source - (const unsigned char *) source;
+	*destLen = d.dest - d.dest_start;
+
+	return TINF_OK;
+}
+
+/* Inflate stream pulled from source function to dest */
+int tinf_uncompress_source(void *dest, size_t *destLen,
+                           tinf_source_func source, void *sourceArg)
+{
+	struct tinf_data d;
+	int final;
+	int res;
+
+	tinf_init_data(&d, dest, *destLen, NULL, 0);
+
+	d.pull = source;
+	d.pull_arg = sourceArg;
+
+	res = tinf_inflate_blocks(&d, (size_t) -1, &final);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	*destLen = d.dest - d.dest_start;
+
+	return TINF_OK;
+}
+
+struct tinf_iov_source {
+	const struct tinf_iovec *iov;
+	size_t count;
+	size_t next;
+};
+
+/* Return next non-empty buffer of iovec array */
+static size_t TINFCC tinf_iov_pull(void *arg, const unsigned char **data)
+{
+	struct tinf_iov_source *is = (struct tinf_iov_source *) arg;
+
+	while (is->next < is->count) {
+		const struct tinf_iovec *v = &is->iov[is->next++];
+
+		if (v->len > 0) {
+			*data = (const unsigned char *) v->base;
+			return v->len;
+		}
 	}
 
-	/* Get length */
-	length = read_le16(d->source);
+	return 0;
+}
 
-	/* Get one's complement of length */
-	invlength = read_le16(d->source + 2);
+/* Inflate stream from array of buffers to dest */
+int tinf_uncompress_iov(void *dest, size_t *destLen,
+                        const struct tinf_iovec *iov, size_t iovcnt)
+{
+	struct tinf_iov_source is;
 
-	/* Check length */
-	if (length != (~invlength & 0x0000FFFF)) {
-		return TINF_DATA_ERROR;
+	is.iov = iov;
+	is.count = iovcnt;
+	is.next = 0;
+
+	return tinf_uncompress_source(dest, destLen, tinf_iov_pull, &is);
+}
+
+/* Inflate stream from source to dest, describing output with spans */
+int tinf_uncompress_spans(void *dest, size_t *destLen,
+                          const void *source, size_t sourceLen,
+                          struct tinf_span *spans, size_t *spanCount)
+{
+	struct tinf_data d;
+	int final;
+	int res;
+
+	if (*spanCount == 0) {
+		return TINF_BUF_ERROR;
 	}
 
-	d->source += 4;
+	tinf_init_data(&d, dest, *destLen, source, sourceLen);
 
-	if (d->source_end - d->source < length) {
-		return TINF_DATA_ERROR;
+	d.spans = spans;
+	d.span_max = *spanCount;
+
+	res = tinf_inflate_blocks(&d, (size_t) -1, &final);
+
+	if (res != TINF_OK) {
+		return res;
 	}
 
-	if (d->dest_end - d->dest < length) {
-		return TINF_BUF_ERROR;
+	tinf_end_span(&d);
+
+	*destLen = d.dest - d.dest_start;
+	*spanCount = d.span_count;
+
+	return TINF_OK;
+}
+
+/* Inflate stream from source to dest, within limits */
+int tinf_uncompress_limited(void *dest, size_t *destLen,
+                            const void *source, size_t sourceLen,
+                            const struct tinf_limits *limits)
+{
+	struct tinf_data d;
+	int clamped = 0;
+	int final;
+	int res;
+
+	tinf_init_data(&d, dest, *destLen, source, sourceLen);
+
+	d.limits = limits;
+	d.check_at = TINF_LIMIT_INTERVAL;
+	d.hooks = 1;
+
+	/* Output limit is exact, through the end of dest */
+	if (limits->max_output != 0 && limits->max_output <= *destLen) {
+		d.dest_end = d.dest_start + limits->max_output;
+		clamped = 1;
 	}
 
-	/* Copy block */
-	while (length--) {
-		*d->dest++ = *d->source++;
+	res = tinf_inflate_blocks(&d, (size_t) -1, &final);
+
+	if (res != TINF_OK) {
+		/* Output reached the limit before the end of dest */
+		if (res == TINF_BUF_ERROR && clamped) {
+			return TINF_LIMIT_ERROR;
+		}
+
+		return res;
 	}
 
-	/* Make sure we start next block on a byte boundary */
-	d->tag = 0;
-	d->bitcount = 0;
+	*destLen = d.dest - d.dest_start;
 
 	return TINF_OK;
 }
 
-/* Inflate a block of data compressed with fixed Huffman trees */
-static int tinf_inflate_fixed_block(struct tinf_data *d)
+/* Inflate stream from source to a buffer grown as needed */
+int tinf_uncompress_alloc(void **dest, size_t *destLen,
+                          const void *source, size_t sourceLen,
+                          size_t sizeHint, size_t maxLen,
+                          const struct tinf_allocator *allocator)
 {
-	/* Build fixed Huffman trees */
-	tinf_build_fixed_trees(&d->ltree, &d->dtree);
+	struct tinf_data d;
+	unsigned char *p;
+	int final;
+	int res;
 
-	/* Decode block using fixed trees */
-	return tinf_inflate_block_data(d, &d->ltree, &d->dtree);
+	if (allocator == NULL) {
+		allocator = tinf_get_allocator();
+	}
+
+	if (maxLen == 0) {
+		maxLen = (size_t) -1;
+	}
+
+	/* Start at the hint, or a guess based on a typical ratio */
+	if (sizeHint == 0) {
+		sizeHint = sourceLen < ((size_t) -1) / 4 ? 4 * sourceLen : sourceLen;
+	}
+
+	if (sizeHint < 1024) {
+		sizeHint = 1024;
+	}
+
+	if (sizeHint > maxLen) {
+		sizeHint = maxLen;
+	}
+
+	*dest = NULL;
+
+	p = (unsigned char *) allocator->alloc(allocator->opaque, sizeHint);
+
+	if (p == NULL) {
+		return TINF_MEM_ERROR;
+	}
+
+	tinf_init_data(&d, p, sizeHint, source, sourceLen);
+
+	d.grow = allocator;
+	d.grow_max = maxLen;
+
+	res = tinf_inflate_blocks(&d, (size_t) -1, &final);
+
+	if (res != TINF_OK) {
+		allocator->release(allocator->opaque, d.dest_start);
+		return res == TINF_BUF_ERROR && d.grow_failed ? TINF_MEM_ERROR
+		                                              : res;
+	}
+
+	*dest = d.dest_start;
+	*destLen = d.dest - d.dest_start;
+
+	return TINF_OK;
 }
 
-/* Inflate a block of data compressed with dynamic Huffman trees */
-static int tinf_inflate_dynamic_block(struct tinf_data *d)
+/* Inflate stream from source to array of buffers */
+int tinf_uncompress_to_iov(const struct tinf_iovec *iov, size_t iovcnt,
+                           size_t *destLen,
+                           const void *source, size_t sourceLen)
 {
-	/* Decode trees from stream */
-	int res = tinf_decode_trees(d, &d->ltree, &d->dtree);
+	struct tinf_data d;
+	int final;
+	int res;
+
+	tinf_init_data(&d, NULL, 0, source, sourceLen);
+
+	d.out_iov = iov;
+	d.out_count = iovcnt;
+
+	if (iovcnt > 0) {
+		d.dest_start = (unsigned char *) iov[0].base;
+		d.dest = d.dest_start;
+		d.dest_end = d.dest_start + iov[0].len;
+	}
+
+	res = tinf_inflate_blocks(&d, (size_t) -1, &final);
 
 	if (res != TINF_OK) {
 		return res;
 	}
 
-	/* Decode block using decoded trees */
-	return tinf_inflate_block_data(d, &d->ltree, &d->dtree);
+	*destLen = d.out_before + (d.dest - d.dest_start);
+
+	return TINF_OK;
 }
 
-/* -- Public functions -- */
+/* Inflate stream from source to dest, with dict as preceding output */
+int tinf_uncompress_dict(void *dest, size_t *destLen,
+                         const void *source, size_t sourceLen,
+                         const void *dict, size_t dictLen)
+{
+	struct tinf_data d;
+	struct tinf_iovec iov[2];
+	int final;
+	int res;
 
-/* Initialize global (static) data */
-void tinf_init(void)
+	tinf_init_data(&d, dest, *destLen, source, sourceLen);
+	tinf_init_history(&d, iov, dict, dictLen);
+
+	res = tinf_inflate_blocks(&d, (size_t) -1, &final);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	*destLen = d.dest - d.dest_start;
+
+	return TINF_OK;
+}
+
+void tinf_session_init(struct tinf_session *s)
 {
-	return;
+	s->have = 0;
 }
 
-/* Inflate stream from source to dest */
-int tinf_uncompress(void *dest, unsigned int *destLen,
-                    const void *source, unsigned int sourceLen)
+/* Inflate message from source to dest, with history from earlier messages */
+int tinf_session_uncompress(struct tinf_session *s,
+                            void *dest, size_t *destLen,
+                            const void *source, size_t sourceLen)
 {
 	struct tinf_data d;
-	int bfinal;
+	struct tinf_iovec iov[2];
+	size_t len;
+	int final;
+	int res;
 
-	/* Initialise data */
-	d.source = (const unsigned char *) source;
-	d.source_end = d.source + sourceLen;
-	d.tag = 0;
-	d.bitcount = 0;
-	d.overflow = 0;
+	tinf_init_data(&d, dest, *destLen, source, sourceLen);
+	tinf_init_history(&d, iov, s->window, s->have);
 
-	d.dest = (unsigned char *) dest;
-	d.dest_start = d.dest;
-	d.dest_end = d.dest + *destLen;
+	/* Stop only at a sync point at the end of the message */
+	res = tinf_inflate_blocks(&d, sourceLen, &final);
 
-	do {
-		unsigned int btype;
-		int res;
+	if (res != TINF_OK) {
+		return res;
+	}
 
-		/* Read final block flag */
-		bfinal = tinf_getbits(&d, 1);
+	len = d.dest - d.dest_start;
 
-		/* Read block type (2 bits) */
-		btype = tinf_getbits(&d, 2);
+	/* Keep last 32 KB of output as history */
+	if (len >= TINF_HISTORY) {
+		memcpy(s->window, d.dest - TINF_HISTORY, TINF_HISTORY);
+		s->have = TINF_HISTORY;
+	}
+	else {
+		size_t keep = s->have < TINF_HISTORY - len
+		            ? s->have : TINF_HISTORY - len;
 
-		/* Decompress block */
-		switch (btype) {
-		case 0:
-			/* Decompress uncompressed block */
-			res = tinf_inflate_uncompressed_block(&d);
-			break;
-		case 1:
-			/* Decompress block with fixed Huffman trees */
-			res = tinf_inflate_fixed_block(&d);
-			break;
-		case 2:
-			/* Decompress block with dynamic Huffman trees */
-			res = tinf_inflate_dynamic_block(&d);
-			break;
-		default:
-			res = TINF_DATA_ERROR;
+		memmove(s->window, s->window + (s->have - keep), keep);
+		memcpy(s->window + keep, d.dest_start, len);
+		s->have = keep + len;
+	}
+
+	*destLen = len;
+
+	return TINF_OK;
+}
+
+/* Inflate stream at end of buf to start of buf */
+int tinf_uncompress_inplace(void *buf, size_t bufLen, size_t sourceLen,
+                            size_t *destLen)
+{
+	struct tinf_data d;
+	int final;
+	int res;
+
+	if (sourceLen > bufLen) {
+		return TINF_BUF_ERROR;
+	}
+
+	tinf_init_data(&d, buf, 0, (unsigned char *) buf + (bufLen - sourceLen),
+	               sourceLen);
+
+	d.inplace = TINF_INPLACE_LIMIT;
+	d.hooks = 1;
+	d.dest_end = (unsigned char *) d.source;
+
+	res = tinf_inflate_blocks(&d, (size_t) -1, &final);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	*destLen = d.dest - d.dest_start;
+
+	return TINF_OK;
+}
+
+/* Inflate stream from source to dest, finding buffer size for in-place */
+int tinf_uncompress_inplace_size(void *dest, size_t *destLen,
+                                 const void *source, size_t sourceLen,
+                                 size_t *bufLen)
+{
+	struct tinf_data d;
+	int final;
+	int res;
+
+	tinf_init_data(&d, dest, *destLen, source, sourceLen);
+
+	d.inplace = TINF_INPLACE_MEASURE;
+	d.hooks = 1;
+
+	res = tinf_inflate_blocks(&d, (size_t) -1, &final);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	*destLen = d.dest - d.dest_start;
+
+	/*
+	 * Room for all output, and for the input placed so output plus a
+	 * match never reaches past the input read
+	 */
+	*bufLen = sourceLen + d.reach > *destLen ? sourceLen + d.reach : *destLen;
+
+	return TINF_OK;
+}
+
+/* Inflate stream from source, passing output to sink through window */
+int tinf_uncompress_sink(tinf_sink_func sink, void *sinkArg,
+                         const void *source, size_t sourceLen,
+                         void *window, size_t windowSize)
+{
+	struct tinf_data d;
+	int final;
+	int res;
+
+	if (windowSize < TINF_WINDOW_MIN) {
+		return TINF_BUF_ERROR;
+	}
+
+	tinf_init_data(&d, window, windowSize, source, sourceLen);
+
+	d.sink = sink;
+	d.sink_arg = sinkArg;
+	d.hooks = 1;
+
+	res = tinf_inflate_blocks(&d, (size_t) -1, &final);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	/* Pass remaining output to sink */
+	return tinf_flush(&d);
+}
+
+/* Create stream decoding source to dest a step at a time */
+struct tinf_stream *tinf_stream_create(int format, void *dest, size_t destLen,
+                                       const void *source, size_t sourceLen)
+{
+	struct tinf_stream *s;
+
+	s = (struct tinf_stream *) tinf_malloc(sizeof(*s));
+
+	if (s == NULL) {
+		return NULL;
+	}
+
+	tinf_stream_init(s, format, dest, destLen, source, sourceLen);
+
+	/* A header error is returned by the first step */
+	s->result = tinf_lane_start(&s->lane, format, dest, destLen,
+	                            source, sourceLen);
+
+	if (s->result == TINF_OK) {
+		s->result = TINF_MORE;
+		s->start = s->lane.d.source;
+	}
+
+	return s;
+}
+
+/* Advance stream until maxOutput bytes or maxSymbols steps, or the end */
+int tinf_stream_step(struct tinf_stream *s, size_t maxOutput,
+                     size_t maxSymbols, size_t *destLen)
+{
+	struct tinf_data *d = &s->lane.d;
+	unsigned char *dest = d->dest;
+	size_t num = 0;
+
+	while (s->result == TINF_MORE) {
+		int res;
+
+		if ((maxOutput != 0 && (size_t) (d->dest - dest) >= maxOutput)
+		 || (maxSymbols != 0 && num >= maxSymbols)) {
 			break;
 		}
 
+		res = tinf_lane_step(&s->lane);
+		++num;
+
 		if (res != TINF_OK) {
-			return res;
+			s->result = tinf_stream_finish(s, res);
 		}
-	} while (!bfinal);
+	}
 
-	/* Check for overflow in bit reader */
-	if (d.overflow) {
+	*destLen = d->dest - d->dest_start;
+
+	return s->result;
+}
+
+/* Save decoder state, checksum and last 32 KB of output to cp */
+int tinf_stream_save(struct tinf_stream *s, void *cp, size_t *cpLen)
+{
+	struct tinf_data *d = &s->lane.d;
+	unsigned char *p = (unsigned char *) cp;
+	size_t window, len, num, i;
+
+	if (s->result != TINF_MORE) {
 		return TINF_DATA_ERROR;
 	}
 
-	*destLen = d.dest - d.dest_start;
+	tinf_stream_update_check(s);
+
+	window = s->check_len < TINF_HISTORY ? s->check_len : TINF_HISTORY;
+
+	len = TINF_CP_HEADER + (s->lane.in_block ? TINF_CP_LENGTHS : 0)
+	    + window + 4;
+
+	if (*cpLen < len) {
+		return TINF_BUF_ERROR;
+	}
+
+	write_le32(p, TINF_CP_MAGIC);
+	p[4] = TINF_CP_VERSION;
+	p[5] = (unsigned char) s->format;
+	p[6] = (unsigned char) (s->lane.bfinal
+	                      | (s->lane.in_block << 1)
+	                      | (d->overflow << 2));
+	p[7] = (unsigned char) d->bitcount;
+	write_le32(p + 8, d->tag);
+	write_le32(p + 12, s->check);
+	write_le64(p + 16, s->source_len);
+	write_le64(p + 24, d->source - s->start);
+	write_le64(p + 32, s->check_len);
+	write_le32(p + 40, (unsigned int) window);
+	write_le32(p + 44, 0);
+
+	p += TINF_CP_HEADER;
+
+	/* Code lengths of current block, two to a byte */
+	if (s->lane.in_block) {
+		unsigned char lengths[288 + 32];
+
+		tinf_tree_lengths(&d->ltree, lengths, 288);
+		tinf_tree_lengths(&d->dtree, lengths + 288, 32);
+
+		for (i = 0; i < TINF_CP_LENGTHS; ++i) {
+			p[i] = (unsigned char) (lengths[2 * i]
+			                      | (lengths[2 * i + 1] << 4));
+		}
+
+		p += TINF_CP_LENGTHS;
+	}
+
+	/* Last output, which may begin in the history before dest */
+	num = d->dest - d->dest_start;
+
+	if (window > num) {
+		size_t from = window - num;
+
+		memcpy(p, s->window + (s->iov[0].len - from), from);
+		p += from;
+	}
+	else {
+		num = window;
+	}
+
+	memcpy(p, d->dest - num, num);
+	p += num;
+
+	write_le32(p, tinf_crc32_z(cp, len - 4));
+
+	*cpLen = len;
 
 	return TINF_OK;
 }
 
+/* Create stream continuing from checkpoint, with output from there to dest */
+struct tinf_stream *tinf_stream_restore(const void *cp, size_t cpLen,
+                                        void *dest, size_t destLen,
+                                        const void *source, size_t sourceLen)
+{
+	const unsigned char *p = (const unsigned char *) cp;
+	struct tinf_stream *s;
+
+	s = (struct tinf_stream *) tinf_malloc(sizeof(*s));
+
+	if (s == NULL) {
+		return NULL;
+	}
+
+	tinf_stream_init(s, cpLen > 5 ? p[5] : TINF_FORMAT_DEFLATE,
+	                 dest, destLen, source, sourceLen);
+
+	/* An invalid checkpoint is returned by the first step */
+	s->result = tinf_stream_load(s, p, cpLen);
+
+	if (s->result == TINF_OK) {
+		s->result = TINF_MORE;
+	}
+	else {
+		tinf_stream_init(s, s->format, dest, destLen,
+		                 source, sourceLen);
+	}
+
+	return s;
+}
+
+void tinf_stream_destroy(struct tinf_stream *s)
+{
+	tinf_free(s);
+}
+
 /* clang -g -O1 -fsanitize=fuzzer,address -DTINF_FUZZING tinflate.c */
 #if defined(TINF_FUZZING)
 #include <limits.h>
@@ -628,9 +2888,8 @@ unsigned char depacked[64 * 1024];
 extern int
 LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
 {
-	if (size > UINT_MAX / 2) { return 0; }
-	unsigned int destLen = sizeof(depacked);
-	tinf_uncompress(depacked, &destLen, data, size);
+	size_t destLen = sizeof(depacked);
+	tinf_uncompress_z(depacked, &destLen, data, size);
 	return 0;
 }
 #endif
@@ -0,0 +1,1325 @@
+/*
+ * tinfpar - parallel decompression
+ *
+ * Copyright (c) 2003-2019 Joergen Ibsen
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *   1. The origin of this software must not be misrepresented; you must
+ *      not claim that you wrote the original software. If you use this
+ *      software in a product, an acknowledgment in the product
+ *      documentation would be appreciated but is not required.
+ *
+ *   2. Altered source versions must be plainly marked as such, and must
+ *      not be misrepresented as being the original software.
+ *
+ *   3. This notice may not be removed or altered from any source
+ *      distribution.
+ */
+
+#include "tinfpar.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(TINF_USE_PTHREADS)
+#  include <pthread.h>
+#endif
+
+#if defined(TINF_USE_LIBNUMA)
+#  include <numa.h>
+#  include <numaif.h>
+#endif
+
+/* Maximum number of threads used by one call */
+#define TINF_THREADS_MAX 256
+
+/* Minimum amount of compressed data in a segment */
+#define TINF_SEGMENT_MIN (64 * 1024U)
+
+struct tinf_segment {
+	const unsigned char *source;
+	size_t sourceLen; /* Size of data from source to end of input */
+	size_t sync; /* Offset of next segment start */
+	size_t consumed;
+	unsigned char *dest;
+	size_t destSize; /* Size of buffer, unless in place */
+	size_t destLen;
+	unsigned int check;
+	int inplace; /* Output is in its final place in dest of call */
+	int done;
+	int final;
+	int res;
+};
+
+struct tinf_segment_list {
+	struct tinf_segment *seg;
+	size_t count;
+	unsigned char *dest;
+	size_t maxLen; /* Size of dest */
+	tinf_check_func check;
+	size_t placed; /* Number of leading segments that join up in dest */
+	size_t placedLen; /* Size of their output */
+#if defined(TINF_USE_PTHREADS)
+	pthread_mutex_t lock;
+#endif
+};
+
+/* -- Work-stealing scheduler -- */
+
+/*
+ * Worker threads are started on first use and kept for the lifetime of the
+ * process, so the cost of creating threads is not paid on every call.
+ *
+ * Each thread taking part has a deque of tasks, where a task is a range of
+ * indexes of a call to tinf_parallel_for. The owner splits a range by
+ * pushing the upper half onto the bottom of its deque and keeps the lower
+ * half, until a single index is left to run. It then pops tasks from the
+ * bottom of its deque. Idle workers steal from the top of the deques of
+ * other threads, which holds the largest remaining ranges, and split them
+ * in turn.
+ *
+ * This balances the load when task sizes vary a lot, and tasks may call
+ * tinf_parallel_for again to split large work into subtasks that idle
+ * workers can steal. The calling thread of tinf_parallel_for works on its
+ * own deque, and then waits for the stolen parts to finish.
+ *
+ * A worker that steals a task is counted as a thief of the call until its
+ * deque is empty again, and the number of thieves of a call is limited to
+ * the number of threads it may use. A thief that finds the oldest task of
+ * a deque belongs to a call at its limit looks further down the deque, so
+ * tasks of other calls are not held up behind it.
+ *
+ * On NUMA machines, workers are spread over the nodes and pinned to them.
+ * A call may give the node of the buffers of each index, and workers steal
+ * tasks on their own node first. Decoder state lives on the stack of the
+ * worker, and buffers allocated while decoding are first touched by it, so
+ * both are placed on the node of the worker.
+ */
+
+#if defined(TINF_USE_PTHREADS)
+/* Maximum number of tasks in a deque */
+#define TINF_DEQUE_SIZE 256
+
+struct tinf_group {
+	tinf_task_func func;
+	void *arg;
+	const int *nodes; /* Node of each index, or NULL */
+	size_t pending; /* Number of indexes not finished */
+	int thieves; /* Number of workers holding a stolen task */
+	int max_thieves;
+	pthread_mutex_t lock;
+	pthread_cond_t finished;
+};
+
+struct tinf_task {
+	struct tinf_group *group;
+	size_t lo; /* Range of indexes [lo, hi) */
+	size_t hi;
+};
+
+struct tinf_deque {
+	pthread_mutex_t lock;
+	size_t top; /* Position of oldest task, which is stolen first */
+	size_t bottom; /* Position after newest task */
+	int node; /* Node of owner, or -1 if unknown */
+	struct tinf_task tasks[TINF_DEQUE_SIZE];
+	struct tinf_deque *next;
+};
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	struct tinf_deque *deques; /* Deques of all threads taking part */
+	int num_threads;
+} tinf_pool = {
+	PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, 0
+};
+
+static pthread_key_t tinf_pool_key; /* Deque of the current thread */
+static pthread_once_t tinf_pool_once = PTHREAD_ONCE_INIT;
+static int tinf_pool_key_ok = 0;
+
+/*
+ * NUMA topology, found on first use of the pool. The environment variable
+ * TINF_NUMA_NODES emulates a number of nodes for testing, where addresses
+ * are spread over the nodes in 2 MB blocks and workers are not pinned.
+ */
+static struct {
+	int nodes;
+	int emulated;
+} tinf_numa = { 1, 0 };
+
+static void tinf_pool_init(void)
+{
+	const char *env = getenv("TINF_NUMA_NODES");
+
+	tinf_pool_key_ok = pthread_key_create(&tinf_pool_key, NULL) == 0;
+
+	if (env != NULL && atoi(env) > 1) {
+		tinf_numa.nodes = atoi(env) < 64 ? atoi(env) : 64;
+		tinf_numa.emulated = 1;
+		return;
+	}
+
+#if defined(TINF_USE_LIBNUMA)
+	if (numa_available() >= 0 && numa_max_node() > 0) {
+		tinf_numa.nodes = numa_max_node() + 1;
+	}
+#endif
+}
+
+/*
+ * Get node of the memory at each of count addresses in pages, or -1 if
+ * unknown. The addresses are rounded down to their page in place, so all
+ * of them are queried with a single system call.
+ */
+static void tinf_numa_nodes_of(void **pages, size_t count, int *nodes)
+{
+	size_t i;
+
+	for (i = 0; i < count; ++i) {
+		nodes[i] = -1;
+	}
+
+	if (tinf_numa.nodes == 1) {
+		return;
+	}
+
+	if (tinf_numa.emulated) {
+		for (i = 0; i < count; ++i) {
+			if (pages[i] != NULL) {
+				nodes[i] = (int) (((size_t) pages[i] >> 21)
+				                  % (size_t) tinf_numa.nodes);
+			}
+		}
+		return;
+	}
+
+#if defined(TINF_USE_LIBNUMA)
+	for (i = 0; i < count; ++i) {
+		pages[i] = (void *) ((size_t) pages[i] & ~((size_t) 4095));
+	}
+
+	/* Query pages without moving them, fails for pages not yet touched */
+	if (numa_move_pages(0, (unsigned long) count, pages, NULL, nodes, 0)) {
+		for (i = 0; i < count; ++i) {
+			nodes[i] = -1;
+		}
+		return;
+	}
+
+	for (i = 0; i < count; ++i) {
+		if (nodes[i] < 0) {
+			nodes[i] = -1;
+		}
+	}
+#endif
+}
+
+/* Pin calling thread to node */
+static void tinf_numa_pin(int node)
+{
+#if defined(TINF_USE_LIBNUMA)
+	if (!tinf_numa.emulated && tinf_numa.nodes > 1) {
+		numa_run_on_node(node);
+	}
+#else
+	(void) node;
+#endif
+}
+
+/* Add deque to pool, lock must be held */
+static void tinf_pool_register(struct tinf_deque *dq)
+{
+	dq->next = tinf_pool.deques;
+	tinf_pool.deques = dq;
+}
+
+/* Remove deque from pool, lock must be held */
+static void tinf_pool_unregister(struct tinf_deque *dq)
+{
+	struct tinf_deque **pp;
+
+	for (pp = &tinf_pool.deques; *pp != NULL; pp = &(*pp)->next) {
+		if (*pp == dq) {
+			*pp = dq->next;
+			break;
+		}
+	}
+}
+
+static int tinf_deque_init(struct tinf_deque *dq, int node)
+{
+	dq->top = 0;
+	dq->bottom = 0;
+	dq->node = node;
+	dq->next = NULL;
+
+	return pthread_mutex_init(&dq->lock, NULL) == 0;
+}
+
+/* Push task onto bottom of deque, returns 0 if full */
+static int tinf_deque_push(struct tinf_deque *dq, struct tinf_group *g,
+                           size_t lo, size_t hi)
+{
+	struct tinf_task *task;
+
+	pthread_mutex_lock(&dq->lock);
+
+	if (dq->bottom - dq->top == TINF_DEQUE_SIZE) {
+		pthread_mutex_unlock(&dq->lock);
+		return 0;
+	}
+
+	task = &dq->tasks[dq->bottom % TINF_DEQUE_SIZE];
+	task->group = g;
+	task->lo = lo;
+	task->hi = hi;
+	dq->bottom++;
+
+	pthread_mutex_unlock(&dq->lock);
+
+	/* Wake an idle worker to steal it */
+	pthread_mutex_lock(&tinf_pool.lock);
+	pthread_cond_signal(&tinf_pool.work);
+	pthread_mutex_unlock(&tinf_pool.lock);
+
+	return 1;
+}
+
+/*
+ * Pop task from bottom of deque, if there is one above position base.
+ * Slots emptied by thieves are skipped.
+ */
+static int tinf_deque_pop(struct tinf_deque *dq, size_t base,
+                          struct tinf_task *task)
+{
+	int res = 0;
+
+	pthread_mutex_lock(&dq->lock);
+
+	while (dq->bottom > dq->top && dq->bottom > base) {
+		dq->bottom--;
+		*task = dq->tasks[dq->bottom % TINF_DEQUE_SIZE];
+
+		if (task->group != NULL) {
+			res = 1;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&dq->lock);
+
+	return res;
+}
+
+/* Position of bottom of deque */
+static size_t tinf_deque_bottom(struct tinf_deque *dq)
+{
+	size_t bottom;
+
+	pthread_mutex_lock(&dq->lock);
+	bottom = dq->bottom;
+	pthread_mutex_unlock(&dq->lock);
+
+	return bottom;
+}
+
+/* Get node of the buffers of task, or -1 if unknown */
+static int tinf_task_node(const struct tinf_task *task)
+{
+	return task->group->nodes != NULL ? task->group->nodes[task->lo] : -1;
+}
+
+/*
+ * Steal the oldest task of a deque other than self, where the call it
+ * belongs to is below its limit of thieves. Tasks below one of a call
+ * that is saturated are also considered, and a task taken from below the
+ * top leaves an empty slot, so the positions of the other tasks do not
+ * change. Tasks on the node of self are taken first. Pool lock must be
+ * held.
+ */
+static int tinf_pool_steal(struct tinf_deque *self, struct tinf_task *task)
+{
+	struct tinf_deque *dq;
+	int pass;
+
+	for (pass = 0; pass < 2; ++pass) {
+		for (dq = tinf_pool.deques; dq != NULL; dq = dq->next) {
+			struct tinf_group *full = NULL;
+			size_t pos;
+			int res = 0;
+
+			if (dq == self) {
+				continue;
+			}
+
+			pthread_mutex_lock(&dq->lock);
+
+			for (pos = dq->top; pos < dq->bottom && !res; ++pos) {
+				struct tinf_task *t;
+				struct tinf_group *g;
+				int node;
+
+				t = &dq->tasks[pos % TINF_DEQUE_SIZE];
+				g = t->group;
+
+				if (g == NULL || g == full) {
+					continue;
+				}
+
+				node = tinf_task_node(t);
+
+				if (pass == 0 && node != -1 && node != self->node) {
+					continue;
+				}
+
+				pthread_mutex_lock(&g->lock);
+
+				if (g->thieves < g->max_thieves) {
+					g->thieves++;
+					*task = *t;
+					t->group = NULL;
+					res = 1;
+				}
+				else {
+					full = g;
+				}
+
+				pthread_mutex_unlock(&g->lock);
+			}
+
+			/* Drop empty slots at the top */
+			while (dq->top < dq->bottom
+			    && dq->tasks[dq->top % TINF_DEQUE_SIZE].group == NULL) {
+				dq->top++;
+			}
+
+			pthread_mutex_unlock(&dq->lock);
+
+			if (res) {
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* Signal waiting caller if all of call is finished, group lock must be held */
+static void tinf_group_check(struct tinf_group *g)
+{
+	if (g->pending == 0 && g->thieves == 0) {
+		pthread_cond_signal(&g->finished);
+	}
+}
+
+/* Split task onto deque until one index is left, and run it */
+static void tinf_run_task(struct tinf_deque *dq, struct tinf_task task)
+{
+	struct tinf_group *g = task.group;
+
+	while (task.hi - task.lo > 1) {
+		size_t mid = task.lo + (task.hi - task.lo) / 2;
+
+		/* If the deque is full, we run the whole range */
+		if (!tinf_deque_push(dq, g, mid, task.hi)) {
+			break;
+		}
+
+		task.hi = mid;
+	}
+
+	for (; task.lo < task.hi; ++task.lo) {
+		g->func(g->arg, task.lo);
+
+		pthread_mutex_lock(&g->lock);
+		g->pending--;
+		tinf_group_check(g);
+		pthread_mutex_unlock(&g->lock);
+	}
+}
+
+static void *tinf_pool_worker(void *arg)
+{
+	struct tinf_deque *dq = (struct tinf_deque *) arg;
+
+	/* Pin before touching the stack, so it is placed on the node */
+	tinf_numa_pin(dq->node);
+
+	pthread_setspecific(tinf_pool_key, dq);
+
+	for (;;) {
+		struct tinf_task task;
+		struct tinf_group *g;
+
+		pthread_mutex_lock(&tinf_pool.lock);
+
+		while (!tinf_pool_steal(dq, &task)) {
+			pthread_cond_wait(&tinf_pool.work, &tinf_pool.lock);
+		}
+
+		pthread_mutex_unlock(&tinf_pool.lock);
+
+		/* Run stolen task and the parts of it left on our deque */
+		g = task.group;
+
+		do {
+			tinf_run_task(dq, task);
+		} while (tinf_deque_pop(dq, 0, &task));
+
+		pthread_mutex_lock(&g->lock);
+		g->thieves--;
+		tinf_group_check(g);
+		pthread_mutex_unlock(&g->lock);
+
+		/* The call may now accept another thief */
+		pthread_mutex_lock(&tinf_pool.lock);
+		pthread_cond_signal(&tinf_pool.work);
+		pthread_mutex_unlock(&tinf_pool.lock);
+	}
+
+	return NULL;
+}
+
+/* Make sure the pool has at least num workers, lock must be held */
+static void tinf_pool_grow(int num)
+{
+	while (tinf_pool.num_threads < num) {
+		struct tinf_deque *dq;
+		pthread_attr_t attr;
+		pthread_t tid;
+		int res;
+
+		/*
+		 * Workers live as long as the process, so their deques do not
+		 * come from the allocator set with tinf_set_allocator
+		 */
+		dq = (struct tinf_deque *) malloc(sizeof(struct tinf_deque));
+
+		if (dq == NULL) {
+			break;
+		}
+
+		/* Spread workers over the nodes */
+		if (!tinf_deque_init(dq, tinf_pool.num_threads % tinf_numa.nodes)) {
+			free(dq);
+			break;
+		}
+
+		if (pthread_attr_init(&attr)) {
+			pthread_mutex_destroy(&dq->lock);
+			free(dq);
+			break;
+		}
+
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+		res = pthread_create(&tid, &attr, tinf_pool_worker, dq);
+
+		pthread_attr_destroy(&attr);
+
+		if (res) {
+			pthread_mutex_destroy(&dq->lock);
+			free(dq);
+			break;
+		}
+
+		tinf_pool_register(dq);
+		tinf_pool.num_threads++;
+	}
+}
+
+/* Run call on the pool, returns 0 if unable to set up */
+static int tinf_pool_run(tinf_task_func func, void *arg, size_t count,
+                         int threads, const int *nodes)
+{
+	struct tinf_deque local;
+	struct tinf_deque *dq;
+	struct tinf_group g;
+	struct tinf_task task;
+	size_t base;
+
+	pthread_once(&tinf_pool_once, tinf_pool_init);
+
+	if (!tinf_pool_key_ok) {
+		return 0;
+	}
+
+	if (pthread_mutex_init(&g.lock, NULL)) {
+		return 0;
+	}
+
+	if (pthread_cond_init(&g.finished, NULL)) {
+		pthread_mutex_destroy(&g.lock);
+		return 0;
+	}
+
+	/* Use the deque of the current thread, if it has one */
+	dq = (struct tinf_deque *) pthread_getspecific(tinf_pool_key);
+
+	if (dq == NULL) {
+		if (!tinf_deque_init(&local, -1)) {
+			pthread_cond_destroy(&g.finished);
+			pthread_mutex_destroy(&g.lock);
+			return 0;
+		}
+
+		dq = &local;
+		pthread_setspecific(tinf_pool_key, dq);
+	}
+
+	g.func = func;
+	g.arg = arg;
+	g.nodes = tinf_numa.nodes > 1 ? nodes : NULL;
+	g.pending = count;
+	g.thieves = 0;
+	g.max_thieves = threads - 1;
+
+	pthread_mutex_lock(&tinf_pool.lock);
+
+	tinf_pool_grow(threads - 1);
+
+	if (dq == &local) {
+		tinf_pool_register(dq);
+	}
+
+	pthread_mutex_unlock(&tinf_pool.lock);
+
+	/* Work on our own part, which is above base on our deque */
+	base = tinf_deque_bottom(dq);
+
+	task.group = &g;
+	task.lo = 0;
+	task.hi = count;
+
+	do {
+		tinf_run_task(dq, task);
+	} while (tinf_deque_pop(dq, base, &task));
+
+	/* Wait for stolen parts to finish */
+	pthread_mutex_lock(&g.lock);
+
+	while (g.pending > 0 || g.thieves > 0) {
+		pthread_cond_wait(&g.finished, &g.lock);
+	}
+
+	pthread_mutex_unlock(&g.lock);
+
+	if (dq == &local) {
+		pthread_mutex_lock(&tinf_pool.lock);
+		tinf_pool_unregister(dq);
+		pthread_mutex_unlock(&tinf_pool.lock);
+
+		pthread_setspecific(tinf_pool_key, NULL);
+		pthread_mutex_destroy(&local.lock);
+	}
+
+	pthread_cond_destroy(&g.finished);
+	pthread_mutex_destroy(&g.lock);
+
+	return 1;
+}
+#endif
+
+void tinf_parallel_for(tinf_task_func func, void *arg, size_t count,
+                       int threads)
+{
+	tinf_parallel_for_nodes(func, arg, count, threads, NULL);
+}
+
+void tinf_parallel_for_nodes(tinf_task_func func, void *arg, size_t count,
+                             int threads, const int *nodes)
+{
+	size_t i;
+
+#if defined(TINF_USE_PTHREADS)
+	if (threads > TINF_THREADS_MAX) {
+		threads = TINF_THREADS_MAX;
+	}
+
+	if ((size_t) threads > count) {
+		threads = (int) count;
+	}
+
+	if (threads > 1 && tinf_pool_run(func, arg, count, threads, nodes)) {
+		return;
+	}
+#else
+	(void) threads;
+	(void) nodes;
+#endif
+
+	for (i = 0; i < count; ++i) {
+		func(arg, i);
+	}
+}
+
+void tinf_parallel_nodes_of(void **pages, size_t count, int *nodes)
+{
+#if defined(TINF_USE_PTHREADS)
+	pthread_once(&tinf_pool_once, tinf_pool_init);
+
+	tinf_numa_nodes_of(pages, count, nodes);
+#else
+	size_t i;
+
+	(void) pages;
+
+	for (i = 0; i < count; ++i) {
+		nodes[i] = -1;
+	}
+#endif
+}
+
+/* -- Batch decompression -- */
+
+/* Amount of compressed data to group into one task */
+#define TINF_BATCH_CHUNK (256 * 1024U)
+
+struct tinf_batch {
+	struct tinf_batch_job *jobs;
+	size_t *chunks; /* Index of first job in each chunk, and end */
+	size_t *order; /* Chunks grouped by node, or NULL */
+	int threads;
+};
+
+/*
+ * Decompress a large job, split at sync points into subtasks that idle
+ * workers can steal
+ */
+static int tinf_batch_split(struct tinf_batch_job *job, int threads)
+{
+	switch (job->format) {
+	case TINF_FORMAT_DEFLATE:
+		return tinf_inflate_parallel(job->dest, &job->dest_len,
+		                             job->source, job->source_len,
+		                             threads, NULL, NULL, NULL);
+	case TINF_FORMAT_ZLIB:
+		return tinf_zlib_uncompress_parallel(job->dest, &job->dest_len,
+		                                     job->source,
+		                                     job->source_len, threads);
+	case TINF_FORMAT_GZIP:
+		return tinf_gzip_uncompress_parallel(job->dest, &job->dest_len,
+		                                     job->source,
+		                                     job->source_len, threads);
+	case TINF_FORMAT_GZIP_MEMBERS:
+		return tinf_gzip_uncompress_members(job->dest, &job->dest_len,
+		                                    job->source,
+		                                    job->source_len, threads);
+	default:
+		return TINF_DATA_ERROR;
+	}
+}
+
+static void tinf_batch_task(void *arg, size_t index)
+{
+	struct tinf_batch *batch = (struct tinf_batch *) arg;
+	struct tinf_cache *cache = NULL;
+	size_t i;
+
+	if (batch->order != NULL) {
+		index = batch->order[index];
+	}
+
+	/* Jobs of a chunk share trees, as messages often repeat them */
+	if (batch->chunks[index + 1] - batch->chunks[index] > 1) {
+		cache = tinf_cache_create();
+	}
+
+	for (i = batch->chunks[index]; i < batch->chunks[index + 1]; ++i) {
+		struct tinf_batch_job *job = &batch->jobs[i];
+
+		if (batch->threads > 1 && job->source_len >= TINF_SPLIT_MIN) {
+			job->result = tinf_batch_split(job, batch->threads);
+			continue;
+		}
+
+		if (cache != NULL && job->format != TINF_FORMAT_GZIP_MEMBERS) {
+			job->result = tinf_uncompress_cached(cache, job->format,
+			                                     job->dest,
+			                                     &job->dest_len,
+			                                     job->source,
+			                                     job->source_len);
+			continue;
+		}
+
+		switch (job->format) {
+		case TINF_FORMAT_DEFLATE:
+			job->result = tinf_uncompress_z(job->dest, &job->dest_len,
+			                                job->source,
+			                                job->source_len);
+			break;
+		case TINF_FORMAT_ZLIB:
+			job->result = tinf_zlib_uncompress_z(job->dest,
+			                                     &job->dest_len,
+			                                     job->source,
+			                                     job->source_len);
+			break;
+		case TINF_FORMAT_GZIP:
+			job->result = tinf_gzip_uncompress_z(job->dest,
+			                                     &job->dest_len,
+			                                     job->source,
+			                                     job->source_len);
+			break;
+		case TINF_FORMAT_GZIP_MEMBERS:
+			job->result = tinf_gzip_uncompress_members(job->dest,
+			                                           &job->dest_len,
+			                                           job->source,
+			                                           job->source_len,
+			                                           1);
+			break;
+		default:
+			job->result = TINF_DATA_ERROR;
+			break;
+		}
+	}
+
+	tinf_cache_destroy(cache);
+}
+
+/*
+ * Group chunks by the node of their output, so workers on a node can take
+ * the chunks on that node. Returns node of each task in order, or NULL if
+ * the nodes are not known.
+ */
+static int *tinf_batch_group_nodes(struct tinf_batch *batch,
+                                   const int *chunk_nodes, size_t num)
+{
+	size_t *order;
+	int *nodes;
+	size_t i, k;
+	int node, max_node = -1;
+
+	for (i = 0; i < num; ++i) {
+		if (chunk_nodes[i] > max_node) {
+			max_node = chunk_nodes[i];
+		}
+	}
+
+	if (max_node == -1) {
+		return NULL;
+	}
+
+	order = (size_t *) tinf_malloc(num * sizeof(size_t));
+	nodes = (int *) tinf_malloc(num * sizeof(int));
+
+	if (order == NULL || nodes == NULL) {
+		tinf_free(order);
+		tinf_free(nodes);
+		return NULL;
+	}
+
+	for (k = 0, node = -1; node <= max_node; ++node) {
+		for (i = 0; i < num; ++i) {
+			if (chunk_nodes[i] == node) {
+				order[k] = i;
+				nodes[k] = node;
+				++k;
+			}
+		}
+	}
+
+	batch->order = order;
+
+	return nodes;
+}
+
+/* Get node of the output of each job, or NULL if unable to allocate */
+static int *tinf_batch_nodes(const struct tinf_batch_job *jobs, size_t count)
+{
+	void **pages;
+	int *nodes;
+	size_t i;
+
+	pages = (void **) tinf_malloc(count * sizeof(void *));
+	nodes = (int *) tinf_malloc(count * sizeof(int));
+
+	if (pages == NULL || nodes == NULL) {
+		tinf_free(pages);
+		tinf_free(nodes);
+		return NULL;
+	}
+
+	for (i = 0; i < count; ++i) {
+		pages[i] = jobs[i].dest;
+	}
+
+	tinf_parallel_nodes_of(pages, count, nodes);
+
+	tinf_free(pages);
+
+	return nodes;
+}
+
+int tinf_batch_uncompress(struct tinf_batch_job *jobs, size_t count,
+                          int threads)
+{
+	struct tinf_batch batch;
+	size_t all[2];
+	size_t num, size, total, chunk, i;
+	int *chunk_nodes = NULL;
+	int *nodes = NULL;
+	int res = TINF_OK;
+
+	if (count == 0) {
+		return TINF_OK;
+	}
+
+	batch.jobs = jobs;
+	batch.order = NULL;
+	batch.threads = threads;
+	batch.chunks = (size_t *) tinf_malloc((count + 1) * sizeof(size_t));
+
+	if (batch.chunks == NULL) {
+		/* Run all jobs as one chunk */
+		all[0] = 0;
+		all[1] = count;
+		batch.chunks = all;
+		num = 1;
+	}
+	else {
+		int prev_node = -1;
+
+		/*
+		 * Group consecutive jobs into chunks, so small jobs do not go
+		 * through the pool one at a time, while leaving a few chunks
+		 * per thread to balance the load. Large jobs get a chunk of
+		 * their own, since they are split further, and a chunk does
+		 * not span output on different NUMA nodes.
+		 */
+		for (total = 0, i = 0; i < count; ++i) {
+			total += jobs[i].source_len;
+		}
+
+		chunk = threads > 1 ? total / (4 * (size_t) threads) : total;
+
+		/* Small batches are not worth grouping by node */
+		if (threads > 1 && total >= TINF_SPLIT_MIN) {
+			chunk_nodes = tinf_batch_nodes(jobs, count);
+		}
+
+		if (chunk > TINF_BATCH_CHUNK) {
+			chunk = TINF_BATCH_CHUNK;
+		}
+
+		/*
+		 * chunk_nodes holds the node of each job, and is overwritten
+		 * with the node of each chunk, which is never ahead of the job
+		 */
+		for (num = 0, size = 0, i = 0; i < count; ++i) {
+			int node = chunk_nodes != NULL ? chunk_nodes[i] : -1;
+
+			if (i == 0 || size >= chunk || node != prev_node
+			 || jobs[i].source_len >= TINF_SPLIT_MIN) {
+				if (chunk_nodes != NULL) {
+					chunk_nodes[num] = node;
+				}
+				batch.chunks[num++] = i;
+				size = 0;
+			}
+			size += jobs[i].source_len;
+			prev_node = node;
+		}
+
+		batch.chunks[num] = count;
+
+		if (chunk_nodes != NULL) {
+			nodes = tinf_batch_group_nodes(&batch, chunk_nodes, num);
+		}
+	}
+
+	tinf_parallel_for_nodes(tinf_batch_task, &batch, num, threads, nodes);
+
+	if (batch.chunks != all) {
+		tinf_free(batch.chunks);
+	}
+
+	tinf_free(batch.order);
+	tinf_free(chunk_nodes);
+	tinf_free(nodes);
+
+	/* Return the first error, if any */
+	for (i = 0; i < count; ++i) {
+		if (jobs[i].result != TINF_OK) {
+			res = jobs[i].result;
+			break;
+		}
+	}
+
+	return res;
+}
+
+/* -- Segments -- */
+
+/*
+ * Check if a segment could start after a sync marker at src + pos.
+ *
+ * The marker 00 00 FF FF must end at pos. zlib writes zero padding after
+ * the header of the empty uncompressed block, so the top three bits of the
+ * byte before the marker are zero. The cheap filters are confirmed by
+ * decoding the header of the next block and its first symbol with no room
+ * for output, which fails with a data error if the block is invalid or
+ * starts with a back-reference.
+ */
+static int tinf_is_segment_start(const unsigned char *src, size_t pos,
+                                 size_t sourceLen)
+{
+	unsigned char dummy;
+	size_t dlen = 0;
+	size_t slen = sourceLen - pos;
+	int final;
+
+	if (src[pos - 1] != 0xFF || src[pos - 2] != 0xFF
+	 || src[pos - 3] != 0x00 || src[pos - 4] != 0x00
+	 || (src[pos - 5] & 0xE0) != 0) {
+		return 0;
+	}
+
+	return tinf_uncompress_segment(&dummy, &dlen, src + pos, &slen, 0,
+	                               &final) != TINF_DATA_ERROR;
+}
+
+/*
+ * Decompress a segment to a buffer of its own.
+ *
+ * The size of the output is not known, so we start from an estimate based
+ * on the size of the compressed data, and grow the buffer as needed.
+ */
+static void tinf_decode_segment(struct tinf_segment *seg, size_t maxLen,
+                                tinf_check_func check)
+{
+	seg->destSize = seg->sync < maxLen / 4 ? 4 * seg->sync : maxLen;
+	seg->dest = (unsigned char *) tinf_malloc(seg->destSize ? seg->destSize
+	                                                        : 1);
+	seg->inplace = 0;
+
+	if (seg->dest == NULL) {
+		seg->res = TINF_MEM_ERROR;
+		return;
+	}
+
+	seg->consumed = seg->sourceLen;
+
+	seg->res = tinf_uncompress_segment_alloc((void **) &seg->dest,
+	                                         &seg->destSize, &seg->destLen,
+	                                         seg->source, &seg->consumed,
+	                                         seg->sync, &seg->final, maxLen);
+
+	if (seg->res == TINF_OK && check != NULL) {
+		seg->check = check(seg->dest, seg->destLen);
+	}
+}
+
+static void tinf_segment_lock(struct tinf_segment_list *list)
+{
+#if defined(TINF_USE_PTHREADS)
+	pthread_mutex_lock(&list->lock);
+#else
+	(void) list;
+#endif
+}
+
+static void tinf_segment_unlock(struct tinf_segment_list *list)
+{
+#if defined(TINF_USE_PTHREADS)
+	pthread_mutex_unlock(&list->lock);
+#else
+	(void) list;
+#endif
+}
+
+/*
+ * Move finished segments that join up with those before them to their
+ * place in dest, freeing their buffers. List lock must be held.
+ */
+static void tinf_place_segments(struct tinf_segment_list *list)
+{
+	while (list->placed < list->count) {
+		struct tinf_segment *seg = &list->seg[list->placed];
+
+		if (!seg->done || seg->res != TINF_OK
+		 || seg->destLen > list->maxLen - list->placedLen) {
+			break;
+		}
+
+		if (!seg->inplace) {
+			memcpy(list->dest + list->placedLen, seg->dest,
+			       seg->destLen);
+			tinf_free(seg->dest);
+			seg->dest = list->dest + list->placedLen;
+			seg->inplace = 1;
+		}
+
+		list->placedLen += seg->destLen;
+		list->placed++;
+
+		/* The next segment follows if this one stopped at its start */
+		if (seg->final || seg->consumed != seg->sync) {
+			list->placed = list->count;
+			break;
+		}
+	}
+}
+
+/*
+ * Decompress segment index. If all segments before it are in place in
+ * dest, its place is known and it is decompressed there. Otherwise it goes
+ * to a buffer of its own, which is moved to dest as soon as the segments
+ * before it are, so the buffers are short-lived.
+ */
+static void tinf_decode_segment_task(void *arg, size_t index)
+{
+	struct tinf_segment_list *list = (struct tinf_segment_list *) arg;
+	struct tinf_segment *seg = &list->seg[index];
+	size_t offset;
+	int inplace;
+
+	tinf_segment_lock(list);
+	inplace = list->placed == index;
+	offset = list->placedLen;
+	tinf_segment_unlock(list);
+
+	if (inplace) {
+		seg->inplace = 1;
+		seg->dest = list->dest + offset;
+		seg->destLen = list->maxLen - offset;
+		seg->consumed = seg->sourceLen;
+
+		seg->res = tinf_uncompress_segment(seg->dest, &seg->destLen,
+		                                   seg->source, &seg->consumed,
+		                                   seg->sync, &seg->final);
+
+		if (seg->res == TINF_OK && list->check != NULL) {
+			seg->check = list->check(seg->dest, seg->destLen);
+		}
+	}
+	else {
+		tinf_decode_segment(seg, list->maxLen, list->check);
+	}
+
+	tinf_segment_lock(list);
+	seg->done = 1;
+	tinf_place_segments(list);
+	tinf_segment_unlock(list);
+}
+
+/*
+ * Find the next likely segment start at or after pos, or return sourceLen.
+ * The 0xFF bytes of sync markers are found with memchr.
+ */
+static size_t tinf_find_segment_start(const unsigned char *src, size_t pos,
+                                      size_t sourceLen)
+{
+	while (pos < sourceLen) {
+		const unsigned char *p;
+
+		/* The marker ends with 0xFF 0xFF at pos - 2 and pos - 1 */
+		p = (const unsigned char *) memchr(src + pos - 1, 0xFF,
+		                                   sourceLen - pos);
+
+		if (p == NULL) {
+			break;
+		}
+
+		pos = (size_t) (p - src) + 1;
+
+		if (tinf_is_segment_start(src, pos, sourceLen)) {
+			return pos;
+		}
+
+		++pos;
+	}
+
+	return sourceLen;
+}
+
+int tinf_inflate_parallel(void *dest, size_t *destLen,
+                          const void *source, size_t sourceLen,
+                          int threads, tinf_check_func check,
+                          tinf_combine_func combine, unsigned int *checkValue)
+{
+	const unsigned char *src = (const unsigned char *) source;
+	unsigned char *dst = (unsigned char *) dest;
+	struct tinf_segment_list list;
+	struct tinf_segment fill;
+	size_t num, count, pos, step, outLen, i;
+	unsigned int value;
+	int res;
+
+	list.seg = NULL;
+	list.dest = dst;
+	list.maxLen = *destLen;
+	list.check = check;
+	list.placed = 0;
+	list.placedLen = 0;
+
+	fill.dest = NULL;
+	num = 0;
+
+	if (threads < 2 || sourceLen < 2 * TINF_SEGMENT_MIN) {
+		goto sequential;
+	}
+
+	/* Spread segments so each thread gets a few of them */
+	step = sourceLen / (4 * (size_t) threads);
+
+	if (step < TINF_SEGMENT_MIN) {
+		step = TINF_SEGMENT_MIN;
+	}
+
+	list.seg = (struct tinf_segment *) tinf_malloc((sourceLen / step + 1)
+	                                          * sizeof(struct tinf_segment));
+
+	if (list.seg == NULL) {
+		goto sequential;
+	}
+
+	/* -- Find segment starts at likely sync points -- */
+
+	list.seg[0].source = src;
+	count = 1;
+
+	for (pos = step; pos < sourceLen; pos += step) {
+		pos = tinf_find_segment_start(src, pos, sourceLen);
+
+		if (pos == sourceLen) {
+			break;
+		}
+
+		list.seg[count++].source = src + pos;
+
+		if (sourceLen - pos <= step) {
+			break;
+		}
+	}
+
+	if (count < 2) {
+		goto sequential;
+	}
+
+	for (num = 0; num < count; ++num) {
+		struct tinf_segment *seg = &list.seg[num];
+
+		seg->sourceLen = (src + sourceLen) - seg->source;
+		seg->sync = num + 1 < count
+		          ? (size_t) (list.seg[num + 1].source - seg->source)
+		          : seg->sourceLen;
+		seg->dest = NULL;
+		seg->inplace = 0;
+		seg->done = 0;
+		seg->res = TINF_DATA_ERROR;
+	}
+
+	list.count = count;
+
+	/* -- Decompress segments -- */
+
+#if defined(TINF_USE_PTHREADS)
+	if (pthread_mutex_init(&list.lock, NULL)) {
+		goto sequential;
+	}
+#endif
+
+	tinf_parallel_for(tinf_decode_segment_task, &list, num, threads);
+
+#if defined(TINF_USE_PTHREADS)
+	pthread_mutex_destroy(&list.lock);
+#endif
+
+	/* -- Join segments that start where the previous one stopped -- */
+
+	/*
+	 * Segments that start at a false sync point are skipped. If the
+	 * previous segment stops at a sync point that is not the start of a
+	 * segment, we decompress from there to the next one here.
+	 */
+	value = check != NULL ? check(NULL, 0) : 0;
+	outLen = 0;
+	pos = 0;
+	i = 0;
+
+	for (;;) {
+		struct tinf_segment *seg;
+
+		while (i < num && list.seg[i].source < src + pos) {
+			++i;
+		}
+
+		if (i < num && list.seg[i].source == src + pos) {
+			seg = &list.seg[i];
+		}
+		else {
+			seg = &fill;
+			seg->source = src + pos;
+			seg->sourceLen = sourceLen - pos;
+			seg->sync = i < num
+			          ? (size_t) (list.seg[i].source - seg->source)
+			          : seg->sourceLen;
+			tinf_decode_segment(seg, list.maxLen, check);
+		}
+
+		/*
+		 * An error in a segment may be a back-reference across a sync
+		 * flush, so we retry the whole stream with one thread
+		 */
+		if (seg->res != TINF_OK || seg->destLen > *destLen - outLen) {
+			goto sequential;
+		}
+
+		/* Segments in place are only reached in order */
+		if (!seg->inplace) {
+			memcpy(dst + outLen, seg->dest, seg->destLen);
+			tinf_free(seg->dest);
+			seg->dest = NULL;
+		}
+
+		if (check != NULL) {
+			value = combine(value, seg->check, seg->destLen);
+		}
+
+		outLen += seg->destLen;
+		pos += seg->consumed;
+
+		if (seg->final) {
+			break;
+		}
+	}
+
+	*destLen = outLen;
+
+	if (check != NULL) {
+		*checkValue = value;
+	}
+
+	res = TINF_OK;
+
+	goto out;
+
+sequential:
+	res = tinf_uncompress_z(dest, destLen, source, sourceLen);
+
+	if (res == TINF_OK && check != NULL) {
+		*checkValue = check(dest, *destLen);
+	}
+
+out:
+	for (i = 0; i < num; ++i) {
+		if (!list.seg[i].inplace) {
+			tinf_free(list.seg[i].dest);
+		}
+	}
+
+	tinf_free(list.seg);
+
+	tinf_free(fill.dest);
+
+	return res;
+}
@@ -0,0 +1,166 @@
+/*
+ * tinfpar - internal interface for parallel decompression
+ *
+ * Copyright (c) 2003-2019 Joergen Ibsen
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *   1. The origin of this software must not be misrepresented; you must
+ *      not claim that you wrote the original software. If you use this
+ *      software in a product, an acknowledgment in the product
+ *      documentation would be appreciated but is not required.
+ *
+ *   2. Altered source versions must be plainly marked as such, and must
+ *      not be misrepresented as being the original software.
+ *
+ *   3. This notice may not be removed or altered from any source
+ *      distribution.
+ */
+
+#ifndef TINFPAR_H_INCLUDED
+#define TINFPAR_H_INCLUDED
+
+#include "tinf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Minimum amount of compressed data in one stream before the batch and
+ * parallel entry points split it into subtasks
+ */
+#define TINF_SPLIT_MIN (1024 * 1024U)
+
+typedef void (*tinf_task_func)(void *arg, size_t index);
+
+typedef unsigned int (TINFCC *tinf_check_func)(const void *data,
+                                               size_t length);
+
+typedef unsigned int (TINFCC *tinf_combine_func)(unsigned int check1,
+                                                 unsigned int check2,
+                                                 size_t length2);
+
+/*
+ * Allocate, resize and free memory with the allocator set with
+ * `tinf_set_allocator()`. `tinf_free(NULL)` does nothing.
+ */
+void *tinf_malloc(size_t size);
+
+void *tinf_realloc(void *ptr, size_t size);
+
+void tinf_free(void *ptr);
+
+/*
+ * Get the allocator set with `tinf_set_allocator()`.
+ */
+const struct tinf_allocator *tinf_get_allocator(void);
+
+/*
+ * Check the zlib header of `source` and find the deflate data in it.
+ */
+int tinf_zlib_unwrap(const void *source, size_t sourceLen,
+                     const unsigned char **start, size_t *length);
+
+/*
+ * Check the Adler-32 checksum in the zlib trailer of `source` against the
+ * decompressed data.
+ */
+int tinf_zlib_check(const void *dest, size_t destLen,
+                    const void *source, size_t sourceLen);
+
+/*
+ * Check the Adler-32 checksum in the zlib trailer of `source` against
+ * `a32`.
+ */
+int tinf_zlib_check_value(unsigned int a32,
+                          const void *source, size_t sourceLen);
+
+/*
+ * Check the gzip header of `source` and find the deflate data in it.
+ *
+ * Returns `TINF_BUF_ERROR` if ISIZE shows the data cannot fit in
+ * `destLen` bytes.
+ */
+int tinf_gzip_unwrap(const void *source, size_t sourceLen, size_t destLen,
+                     const unsigned char **start, size_t *length);
+
+/*
+ * Check the size and CRC32 checksum in the gzip trailer of `source` against
+ * the decompressed data.
+ */
+int tinf_gzip_check(const void *dest, size_t destLen,
+                    const void *source, size_t sourceLen);
+
+/*
+ * Check the size and CRC32 checksum in the gzip trailer of `source` against
+ * `destLen` and `crc`.
+ */
+int tinf_gzip_check_value(unsigned int crc, size_t destLen,
+                          const void *source, size_t sourceLen);
+
+/*
+ * Call `func(arg, i)` for each `i` in [0, `count`), using up to `threads`
+ * threads. The calling thread takes part, and all calls are finished on
+ * return.
+ *
+ * Without thread support the calls are made in order by the calling thread.
+ */
+void tinf_parallel_for(tinf_task_func func, void *arg, size_t count,
+                       int threads);
+
+/*
+ * Like `tinf_parallel_for`, with the NUMA node of the buffers used by each
+ * index in `nodes` (-1 if unknown). Workers prefer indexes on their own
+ * node, so consecutive indexes should be grouped by node.
+ */
+void tinf_parallel_for_nodes(tinf_task_func func, void *arg, size_t count,
+                             int threads, const int *nodes);
+
+/*
+ * Get the NUMA node of the memory at each of `count` addresses in `pages`
+ * into `nodes`, -1 if unknown or not a NUMA machine. The addresses are
+ * rounded down to their page in place, and all of them are looked up with
+ * one system call.
+ */
+void tinf_parallel_nodes_of(void **pages, size_t count, int *nodes);
+
+/*
+ * Decompress deflate data from `source` like `tinf_uncompress_segment`, to
+ * a buffer from the allocator set with `tinf_set_allocator()`.
+ *
+ * `*dest` is a buffer of `*destSize` bytes, or NULL. It is grown as needed,
+ * up to `maxLen` bytes, and decompression continues where it was. On
+ * return, `*dest` and `*destSize` are set to the buffer, which the caller
+ * must free with `tinf_free()`, also on error. Returns `TINF_MEM_ERROR` if
+ * the buffer could not be grown.
+ */
+int tinf_uncompress_segment_alloc(void **dest, size_t *destSize,
+                                  size_t *destLen,
+                                  const void *source, size_t *sourceLen,
+                                  size_t syncOffset, int *final,
+                                  size_t maxLen);
+
+/*
+ * Decompress deflate data from `source` to `dest`, splitting it at full
+ * flush sync points, and compute the checksum `check` of the output if
+ * `check` is not NULL.
+ *
+ * Falls back to decompressing with one thread if the data cannot be split.
+ */
+int tinf_inflate_parallel(void *dest, size_t *destLen,
+                          const void *source, size_t sourceLen,
+                          int threads, tinf_check_func check,
+                          tinf_combine_func combine, unsigned int *checkValue);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* TINFPAR_H_INCLUDED */
@@ -0,0 +1,488 @@
+/*
+ * tinfzip - tiny zip archive reader
+ *
+ * Copyright (c) 2003-2019 Joergen Ibsen
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *   1. The origin of this software must not be misrepresented; you must
+ *      not claim that you wrote the original software. If you use this
+ *      software in a product, an acknowledgment in the product
+ *      documentation would be appreciated but is not required.
+ *
+ *   2. Altered source versions must be plainly marked as such, and must
+ *      not be misrepresented as being the original software.
+ *
+ *   3. This notice may not be removed or altered from any source
+ *      distribution.
+ */
+
+#include "tinf.h"
+#include "tinfpar.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ZIP_LOCAL_SIG       0x04034B50
+#define ZIP_CENTRAL_SIG     0x02014B50
+#define ZIP_EOCD_SIG        0x06054B50
+#define ZIP64_EOCD_SIG      0x06064B50
+#define ZIP64_LOCATOR_SIG   0x07064B50
+
+#define ZIP_LOCAL_SIZE      30
+#define ZIP_CENTRAL_SIZE    46
+#define ZIP_EOCD_SIZE       22
+#define ZIP64_EOCD_SIZE     56
+#define ZIP64_LOCATOR_SIZE  20
+
+#define ZIP64_EXTRA_ID      0x0001
+
+typedef enum {
+	ZIP_ENCRYPTED = 1
+} tinf_zip_flag;
+
+static unsigned int read_le16(const unsigned char *p)
+{
+	return ((unsigned int) p[0])
+	     | ((unsigned int) p[1] << 8);
+}
+
+static unsigned int read_le32(const unsigned char *p)
+{
+	return ((unsigned int) p[0])
+	     | ((unsigned int) p[1] << 8)
+	     | ((unsigned int) p[2] << 16)
+	     | ((unsigned int) p[3] << 24);
+}
+
+/* Read 64-bit value, returns 0 if it does not fit in a size_t */
+static int read_le64(const unsigned char *p, size_t *value)
+{
+	size_t lo = read_le32(p);
+	size_t hi = read_le32(p + 4);
+
+	if (hi != 0 && sizeof(size_t) <= 4) {
+		return 0;
+	}
+
+	/* Shift in two steps to avoid warning when size_t is 32-bit */
+	*value = lo | ((hi << 16) << 16);
+
+	return 1;
+}
+
+/* Find end of central directory record */
+static const unsigned char *tinf_zip_find_eocd(const unsigned char *src,
+                                               size_t sourceLen)
+{
+	size_t pos, limit;
+
+	if (sourceLen < ZIP_EOCD_SIZE) {
+		return NULL;
+	}
+
+	/* The record is followed by a comment of up to 65535 bytes */
+	pos = sourceLen - ZIP_EOCD_SIZE;
+	limit = pos > 0xFFFF ? pos - 0xFFFF : 0;
+
+	for (;;) {
+		if (read_le32(src + pos) == ZIP_EOCD_SIG
+		 && read_le16(src + pos + 20) == sourceLen - ZIP_EOCD_SIZE - pos) {
+			return src + pos;
+		}
+
+		if (pos == limit) {
+			return NULL;
+		}
+
+		--pos;
+	}
+}
+
+/* Get 64-bit values from Zip64 extended information extra field */
+static int tinf_zip_read_zip64(const unsigned char *extra, size_t extraLen,
+                               struct tinf_zip_entry *entry,
+                               int need_size, int need_csize, int need_offset)
+{
+	while (extraLen >= 4) {
+		unsigned int id = read_le16(extra);
+		size_t len = read_le16(extra + 2);
+		const unsigned char *p = extra + 4;
+
+		if (len > extraLen - 4) {
+			return TINF_DATA_ERROR;
+		}
+
+		if (id == ZIP64_EXTRA_ID) {
+			/* Only values that overflowed are present, in order */
+			if (need_size) {
+				if (len < 8 || !read_le64(p, &entry->size)) {
+					return TINF_DATA_ERROR;
+				}
+				p += 8;
+				len -= 8;
+			}
+			if (need_csize) {
+				if (len < 8 || !read_le64(p, &entry->compressed_size)) {
+					return TINF_DATA_ERROR;
+				}
+				p += 8;
+				len -= 8;
+			}
+			if (need_offset) {
+				if (len < 8 || !read_le64(p, &entry->offset)) {
+					return TINF_DATA_ERROR;
+				}
+			}
+
+			return TINF_OK;
+		}
+
+		extra += 4 + len;
+		extraLen -= 4 + len;
+	}
+
+	return TINF_DATA_ERROR;
+}
+
+int tinf_zip_read_directory(struct tinf_zip_entry *entries, size_t *count,
+                            const void *source, size_t sourceLen)
+{
+	const unsigned char *src = (const unsigned char *) source;
+	const unsigned char *eocd, *p;
+	size_t num, cdir_offs, cdir_size, i;
+
+	/* -- Find end of central directory -- */
+
+	eocd = tinf_zip_find_eocd(src, sourceLen);
+
+	if (eocd == NULL) {
+		return TINF_DATA_ERROR;
+	}
+
+	num = read_le16(eocd + 10);
+	cdir_size = read_le32(eocd + 12);
+	cdir_offs = read_le32(eocd + 16);
+
+	/* Multi-disk archives are not supported */
+	if (read_le16(eocd + 4) != 0 || read_le16(eocd + 6) != 0
+	 || read_le16(eocd + 8) != num) {
+		return TINF_DATA_ERROR;
+	}
+
+	/* -- Use Zip64 end of central directory if present -- */
+
+	if (eocd - src >= ZIP64_LOCATOR_SIZE
+	 && read_le32(eocd - ZIP64_LOCATOR_SIZE) == ZIP64_LOCATOR_SIG) {
+		const unsigned char *loc = eocd - ZIP64_LOCATOR_SIZE;
+		const unsigned char *eocd64;
+		size_t offs;
+
+		if (!read_le64(loc + 8, &offs)
+		 || offs > (size_t) (loc - src)
+		 || (size_t) (loc - src) - offs < ZIP64_EOCD_SIZE) {
+			return TINF_DATA_ERROR;
+		}
+
+		eocd64 = src + offs;
+
+		if (read_le32(eocd64) != ZIP64_EOCD_SIG
+		 || read_le32(eocd64 + 16) != 0 || read_le32(eocd64 + 20) != 0
+		 || !read_le64(eocd64 + 32, &num)
+		 || !read_le64(eocd64 + 40, &cdir_size)
+		 || !read_le64(eocd64 + 48, &cdir_offs)) {
+			return TINF_DATA_ERROR;
+		}
+	}
+
+	if (cdir_offs > sourceLen || cdir_size > sourceLen - cdir_offs) {
+		return TINF_DATA_ERROR;
+	}
+
+	/* Each entry takes at least the fixed size of a central header */
+	if (num > cdir_size / ZIP_CENTRAL_SIZE) {
+		return TINF_DATA_ERROR;
+	}
+
+	if (entries == NULL || *count < num) {
+		*count = num;
+		return TINF_BUF_ERROR;
+	}
+
+	/* -- Read central directory headers -- */
+
+	p = src + cdir_offs;
+
+	for (i = 0; i < num; ++i) {
+		struct tinf_zip_entry *entry = &entries[i];
+		size_t left = (src + cdir_offs + cdir_size) - p;
+		size_t name_len, extra_len, comment_len;
+		int need_size, need_csize, need_offset;
+
+		if (left < ZIP_CENTRAL_SIZE || read_le32(p) != ZIP_CENTRAL_SIG) {
+			return TINF_DATA_ERROR;
+		}
+
+		name_len = read_le16(p + 28);
+		extra_len = read_le16(p + 30);
+		comment_len = read_le16(p + 32);
+
+		if (name_len + extra_len + comment_len > left - ZIP_CENTRAL_SIZE) {
+			return TINF_DATA_ERROR;
+		}
+
+		entry->name = p + ZIP_CENTRAL_SIZE;
+		entry->name_len = (unsigned int) name_len;
+		entry->flags = read_le16(p + 8);
+		entry->method = read_le16(p + 10);
+		entry->crc32 = read_le32(p + 16);
+		entry->compressed_size = read_le32(p + 20);
+		entry->size = read_le32(p + 24);
+		entry->offset = read_le32(p + 42);
+
+		need_size = entry->size == 0xFFFFFFFF;
+		need_csize = entry->compressed_size == 0xFFFFFFFF;
+		need_offset = entry->offset == 0xFFFFFFFF;
+
+		if (need_size || need_csize || need_offset) {
+			int res = tinf_zip_read_zip64(entry->name + name_len,
+			                              extra_len, entry, need_size,
+			                              need_csize, need_offset);
+
+			if (res != TINF_OK) {
+				return res;
+			}
+		}
+
+		p += ZIP_CENTRAL_SIZE + name_len + extra_len + comment_len;
+	}
+
+	*count = num;
+
+	return TINF_OK;
+}
+
+/*
+ * Extract entry, splitting large deflate data at sync points into subtasks
+ * if threads is larger than one
+ */
+static int tinf_zip_extract(void *dest, size_t destLen,
+                            const void *source, size_t sourceLen,
+                            const struct tinf_zip_entry *entry, int threads)
+{
+	const unsigned char *src = (const unsigned char *) source;
+	const unsigned char *data;
+	unsigned int crc;
+	size_t offs;
+
+	/* -- Check entry can be extracted -- */
+
+	if (entry->flags & ZIP_ENCRYPTED) {
+		return TINF_DATA_ERROR;
+	}
+
+	if (entry->method != 0 && entry->method != 8) {
+		return TINF_DATA_ERROR;
+	}
+
+	if (entry->size > destLen) {
+		return TINF_BUF_ERROR;
+	}
+
+	/* -- Find data following local header -- */
+
+	if (entry->offset > sourceLen
+	 || sourceLen - entry->offset < ZIP_LOCAL_SIZE) {
+		return TINF_DATA_ERROR;
+	}
+
+	data = src + entry->offset;
+
+	if (read_le32(data) != ZIP_LOCAL_SIG) {
+		return TINF_DATA_ERROR;
+	}
+
+	offs = entry->offset + ZIP_LOCAL_SIZE
+	     + read_le16(data + 26) + read_le16(data + 28);
+
+	if (offs > sourceLen || entry->compressed_size > sourceLen - offs) {
+		return TINF_DATA_ERROR;
+	}
+
+	data = src + offs;
+
+	/* -- Decompress data -- */
+
+	if (entry->method == 0) {
+		if (entry->compressed_size != entry->size) {
+			return TINF_DATA_ERROR;
+		}
+
+		if (entry->size > 0) {
+			memcpy(dest, data, entry->size);
+		}
+
+		crc = tinf_crc32_z(dest, entry->size);
+	}
+	else {
+		size_t dlen = entry->size;
+		int res;
+
+		if (threads > 1 && entry->compressed_size >= TINF_SPLIT_MIN) {
+			res = tinf_inflate_parallel(dest, &dlen, data,
+			                            entry->compressed_size,
+			                            threads, tinf_crc32_z,
+			                            tinf_crc32_combine, &crc);
+		}
+		else {
+			res = tinf_uncompress_z(dest, &dlen, data,
+			                        entry->compressed_size);
+
+			if (res == TINF_OK) {
+				crc = tinf_crc32_z(dest, dlen);
+			}
+		}
+
+		if (res != TINF_OK) {
+			return TINF_DATA_ERROR;
+		}
+
+		if (dlen != entry->size) {
+			return TINF_DATA_ERROR;
+		}
+	}
+
+	/* -- Check CRC32 checksum -- */
+
+	if (entry->crc32 != crc) {
+		return TINF_DATA_ERROR;
+	}
+
+	return TINF_OK;
+}
+
+int tinf_zip_uncompress(void *dest, size_t destLen,
+                        const void *source, size_t sourceLen,
+                        const struct tinf_zip_entry *entry)
+{
+	return tinf_zip_extract(dest, destLen, source, sourceLen, entry, 1);
+}
+
+/* -- Parallel extraction -- */
+
+struct tinf_zip_order {
+	size_t size;
+	size_t index;
+};
+
+struct tinf_zip_job {
+	void * const *dests;
+	int *results;
+	const unsigned char *source;
+	size_t sourceLen;
+	const struct tinf_zip_entry *entries;
+	struct tinf_zip_order *order;
+	int threads;
+};
+
+static void tinf_zip_task(void *arg, size_t index)
+{
+	struct tinf_zip_job *job = (struct tinf_zip_job *) arg;
+	size_t i = job->order != NULL ? job->order[index].index : index;
+
+	if (job->dests[i] == NULL) {
+		job->results[i] = TINF_OK;
+		return;
+	}
+
+	job->results[i] = tinf_zip_extract(job->dests[i],
+	                                   job->entries[i].size,
+	                                   job->source, job->sourceLen,
+	                                   &job->entries[i], job->threads);
+}
+
+/* Compare function for sorting largest entries first */
+static int tinf_zip_compare(const void *a, const void *b)
+{
+	size_t sa = ((const struct tinf_zip_order *) a)->size;
+	size_t sb = ((const struct tinf_zip_order *) b)->size;
+
+	return sa < sb ? 1 : sa > sb ? -1 : 0;
+}
+
+int tinf_zip_uncompress_all(void * const *dests, int *results,
+                            const void *source, size_t sourceLen,
+                            const struct tinf_zip_entry *entries,
+                            size_t count, int threads)
+{
+	struct tinf_zip_job job;
+	int *nodes = NULL;
+	size_t i;
+
+	job.dests = dests;
+	job.results = results;
+	job.source = (const unsigned char *) source;
+	job.sourceLen = sourceLen;
+	job.entries = entries;
+	job.order = NULL;
+	job.threads = threads;
+
+	/*
+	 * Start the largest entries first, so a large entry does not end
+	 * up running alone at the end
+	 */
+	if (threads > 1 && count > 1) {
+		job.order = (struct tinf_zip_order *)
+		            tinf_malloc(count * sizeof(struct tinf_zip_order));
+
+		if (job.order != NULL) {
+			for (i = 0; i < count; ++i) {
+				job.order[i].size = entries[i].compressed_size;
+				job.order[i].index = i;
+			}
+
+			qsort(job.order, count, sizeof(struct tinf_zip_order),
+			      tinf_zip_compare);
+		}
+	}
+
+	/* Let workers on the node of the output of an entry take it first */
+	if (job.order != NULL) {
+		void **pages = (void **) tinf_malloc(count * sizeof(void *));
+
+		nodes = (int *) tinf_malloc(count * sizeof(int));
+
+		if (pages != NULL && nodes != NULL) {
+			for (i = 0; i < count; ++i) {
+				pages[i] = dests[job.order[i].index];
+			}
+
+			tinf_parallel_nodes_of(pages, count, nodes);
+		}
+		else {
+			tinf_free(nodes);
+			nodes = NULL;
+		}
+
+		tinf_free(pages);
+	}
+
+	tinf_parallel_for_nodes(tinf_zip_task, &job, count, threads, nodes);
+
+	tinf_free(job.order);
+	tinf_free(nodes);
+
+	for (i = 0; i < count; ++i) {
+		if (results[i] != TINF_OK) {
+			return results[i];
+		}
+	}
+
+	return TINF_OK;
+}
@@ -24,6 +24,9 @@
  */
 
 #include "tinf.h"
+#include "tinfpar.h"
+
+#include <stdlib.h>
 
 static unsigned int read_be32(const unsigned char *p)
 {
@@ -33,17 +36,12 @@ static unsigned int read_be32(const unsigned char *p)
 	     | ((unsigned int) p[3]);
 }
 
-int tinf_zlib_uncompress(void *dest, unsigned int *destLen,
-                         const void *source, unsigned int sourceLen)
+/* Check header, allowing a preset dictionary if allowDict is non-zero */
+static int tinf_zlib_check_header(const unsigned char *src,
+                                  size_t sourceLen, int allowDict)
 {
-	const unsigned char *src = (const unsigned char *) source;
-	unsigned char *dst = (unsigned char *) dest;
-	unsigned int a32;
-	int res;
 	unsigned char cmf, flg;
 
-	/* -- Check header -- */
-
 	/* Check room for at least 2 byte header and 4 byte trailer */
 	if (sourceLen < 6) {
 		return TINF_DATA_ERROR;
@@ -69,27 +67,363 @@ int tinf_zlib_uncompress(void *dest, unsigned int *destLen,
 	}
 
 	/* Check there is no preset dictionary */
-	if (flg & 0x20) {
+	if ((flg & 0x20) && !allowDict) {
+		return TINF_DATA_ERROR;
+	}
+
+	return TINF_OK;
+}
+
+int tinf_zlib_uncompress(void *dest, unsigned int *destLen,
+                         const void *source, unsigned int sourceLen)
+{
+	size_t dlen = *destLen;
+	int res;
+
+	res = tinf_zlib_uncompress_z(dest, &dlen, source, sourceLen);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	*destLen = (unsigned int) dlen;
+
+	return TINF_OK;
+}
+
+/* Check header and find compressed data */
+int tinf_zlib_unwrap(const void *source, size_t sourceLen,
+                     const unsigned char **start, size_t *length)
+{
+	const unsigned char *src = (const unsigned char *) source;
+	int res;
+
+	res = tinf_zlib_check_header(src, sourceLen, 0);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	*start = src + 2;
+	*length = sourceLen - 6;
+
+	return TINF_OK;
+}
+
+/* Check Adler-32 checksum of decompressed data against trailer */
+int tinf_zlib_check(const void *dest, size_t destLen,
+                    const void *source, size_t sourceLen)
+{
+	return tinf_zlib_check_value(tinf_adler32_z(dest, destLen),
+	                             source, sourceLen);
+}
+
+/* Check Adler-32 checksum against trailer */
+int tinf_zlib_check_value(unsigned int a32,
+                          const void *source, size_t sourceLen)
+{
+	const unsigned char *src = (const unsigned char *) source;
+
+	if (read_be32(&src[sourceLen - 4]) != a32) {
+		return TINF_DATA_ERROR;
+	}
+
+	return TINF_OK;
+}
+
+int tinf_zlib_uncompress_z(void *dest, size_t *destLen,
+                           const void *source, size_t sourceLen)
+{
+	const unsigned char *start;
+	size_t length;
+	int res;
+
+	/* -- Check header -- */
+
+	res = tinf_zlib_unwrap(source, sourceLen, &start, &length);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	/* -- Decompress data -- */
+
+	res = tinf_uncompress_z(dest, destLen, start, length);
+
+	if (res != TINF_OK) {
 		return TINF_DATA_ERROR;
 	}
 
+	/* -- Check Adler-32 checksum -- */
+
+	return tinf_zlib_check(dest, *destLen, source, sourceLen);
+}
+
+int tinf_zlib_uncompress_parallel(void *dest, size_t *destLen,
+                                  const void *source, size_t sourceLen,
+                                  int threads)
+{
+	const unsigned char *src = (const unsigned char *) source;
+	unsigned int a32, check;
+	int res;
+
+	/* -- Check header -- */
+
+	res = tinf_zlib_check_header(src, sourceLen, 0);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
 	/* -- Get Adler-32 checksum of original data -- */
 
 	a32 = read_be32(&src[sourceLen - 4]);
 
-	/* -- Decompress data -- */
+	/* -- Decompress data, combining checksums of segments -- */
 
-	res = tinf_uncompress(dst, destLen, src + 2, sourceLen - 6);
+	res = tinf_inflate_parallel(dest, destLen, src + 2, sourceLen - 6,
+	                            threads, tinf_adler32_z, tinf_adler32_combine,
+	                            &check);
 
 	if (res != TINF_OK) {
+		return res == TINF_BUF_ERROR ? TINF_BUF_ERROR : TINF_DATA_ERROR;
+	}
+
+	/* -- Check Adler-32 checksum -- */
+
+	if (a32 != check) {
 		return TINF_DATA_ERROR;
 	}
 
+	return TINF_OK;
+}
+
+/* -- Sink -- */
+
+struct tinf_zlib_sink {
+	tinf_sink_func sink;
+	void *arg;
+	unsigned int a32;
+};
+
+/* Update Adler-32 checksum and pass data on */
+static int TINFCC tinf_zlib_sink_func(void *arg, const unsigned char *data,
+                                      size_t length)
+{
+	struct tinf_zlib_sink *zs = (struct tinf_zlib_sink *) arg;
+
+	zs->a32 = tinf_adler32_combine(zs->a32, tinf_adler32_z(data, length),
+	                               length);
+
+	return zs->sink(zs->arg, data, length);
+}
+
+int tinf_zlib_uncompress_sink(tinf_sink_func sink, void *sinkArg,
+                              const void *source, size_t sourceLen,
+                              void *window, size_t windowSize)
+{
+	const unsigned char *src = (const unsigned char *) source;
+	const unsigned char *start;
+	struct tinf_zlib_sink zs;
+	size_t length;
+	int res;
+
+	/* -- Check header -- */
+
+	res = tinf_zlib_unwrap(source, sourceLen, &start, &length);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	/* -- Decompress data -- */
+
+	zs.sink = sink;
+	zs.arg = sinkArg;
+	zs.a32 = 1;
+
+	res = tinf_uncompress_sink(tinf_zlib_sink_func, &zs, start, length,
+	                           window, windowSize);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
 	/* -- Check Adler-32 checksum -- */
 
-	if (a32 != tinf_adler32(dst, *destLen)) {
+	if (read_be32(&src[sourceLen - 4]) != zs.a32) {
 		return TINF_DATA_ERROR;
 	}
 
 	return TINF_OK;
 }
+
+/* -- Growing output -- */
+
+int tinf_zlib_uncompress_alloc(void **dest, size_t *destLen,
+                               const void *source, size_t sourceLen,
+                               size_t sizeHint, size_t maxLen,
+                               const struct tinf_allocator *allocator)
+{
+	const unsigned char *start;
+	size_t length;
+	int res;
+
+	/* -- Check header -- */
+
+	res = tinf_zlib_unwrap(source, sourceLen, &start, &length);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	/* -- Decompress data -- */
+
+	res = tinf_uncompress_alloc(dest, destLen, start, length,
+	                            sizeHint, maxLen, allocator);
+
+	/* Not enough room is reported as such, since there is no size */
+	if (res != TINF_OK) {
+		return res == TINF_BUF_ERROR || res == TINF_MEM_ERROR
+		     ? res : TINF_DATA_ERROR;
+	}
+
+	/* -- Check Adler-32 checksum -- */
+
+	res = tinf_zlib_check(*dest, *destLen, source, sourceLen);
+
+	if (res != TINF_OK) {
+		if (allocator == NULL) {
+			allocator = tinf_get_allocator();
+		}
+
+		allocator->release(allocator->opaque, *dest);
+		*dest = NULL;
+	}
+
+	return res;
+}
+
+/* -- Limits -- */
+
+int tinf_zlib_uncompress_limited(void *dest, size_t *destLen,
+                                 const void *source, size_t sourceLen,
+                                 const struct tinf_limits *limits)
+{
+	const unsigned char *start;
+	size_t length;
+	int res;
+
+	/* -- Check header -- */
+
+	res = tinf_zlib_unwrap(source, sourceLen, &start, &length);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	/* -- Decompress data -- */
+
+	res = tinf_uncompress_limited(dest, destLen, start, length, limits);
+
+	if (res != TINF_OK) {
+		return res == TINF_BUF_ERROR || res == TINF_LIMIT_ERROR
+		     ? res : TINF_DATA_ERROR;
+	}
+
+	/* -- Check Adler-32 checksum -- */
+
+	return tinf_zlib_check(dest, *destLen, source, sourceLen);
+}
+
+/* -- Preset dictionaries -- */
+
+static int tinf_dict_compare(const void *a, const void *b)
+{
+	unsigned int ida = ((const struct tinf_dict *) a)->id;
+	unsigned int idb = ((const struct tinf_dict *) b)->id;
+
+	return ida < idb ? -1 : ida > idb;
+}
+
+void tinf_dict_registry_init(struct tinf_dict *dicts, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count; ++i) {
+		dicts[i].id = tinf_adler32_z(dicts[i].data, dicts[i].len);
+	}
+
+	qsort(dicts, count, sizeof(dicts[0]), tinf_dict_compare);
+}
+
+/* Binary search for dictionary with DICTID id, returns NULL if none */
+static const struct tinf_dict *tinf_dict_find(const struct tinf_dict *dicts,
+                                              size_t count, unsigned int id)
+{
+	size_t lo = 0, hi = count;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (dicts[mid].id < id) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+
+	return lo < count && dicts[lo].id == id ? &dicts[lo] : NULL;
+}
+
+int tinf_zlib_uncompress_dict(void *dest, size_t *destLen,
+                              const void *source, size_t sourceLen,
+                              const struct tinf_dict *dicts, size_t dictCount)
+{
+	const unsigned char *src = (const unsigned char *) source;
+	const struct tinf_dict *dict = NULL;
+	const unsigned char *start;
+	size_t length;
+	int res;
+
+	/* -- Check header and find dictionary -- */
+
+	res = tinf_zlib_check_header(src, sourceLen, 1);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	start = src + 2;
+	length = sourceLen - 6;
+
+	if (src[1] & 0x20) {
+		if (sourceLen < 10) {
+			return TINF_DATA_ERROR;
+		}
+
+		dict = tinf_dict_find(dicts, dictCount, read_be32(start));
+
+		if (dict == NULL) {
+			return TINF_DATA_ERROR;
+		}
+
+		start += 4;
+		length -= 4;
+	}
+
+	/* -- Decompress data -- */
+
+	res = tinf_uncompress_dict(dest, destLen, start, length,
+	                           dict != NULL ? dict->data : NULL,
+	                           dict != NULL ? dict->len : 0);
+
+	if (res != TINF_OK) {
+		return TINF_DATA_ERROR;
+	}
+
+	/* -- Check Adler-32 checksum -- */
+
+	return tinf_zlib_check(dest, *destLen, source, sourceLen);
+}
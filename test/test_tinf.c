@@ -39,6 +39,16 @@ static const unsigned char robuffer[] = { 0 };
 
 static unsigned char buffer[4096];
 
+/* A match of length 3 with a distance of 32768 */
+static const unsigned char matchdist[] = {
+	0xED, 0xDD, 0x01, 0x01, 0x00, 0x00, 0x08, 0x02, 0x20, 0xED,
+	0xFF, 0xE8, 0xFA, 0x11, 0x1C, 0x61, 0x9A, 0xF7, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xE0,
+	0xFE, 0xFF, 0x05
+};
+
 struct packed_data {
 	unsigned int src_size;
 	unsigned int depacked_size;
@@ -171,6 +181,467 @@ static const struct packed_data gzip_errors[] = {
 	{ 21, 1, { 0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0B, 0x67, 0x00, 0x00, 0x8D, 0xEF, 0x02, 0xD2, 0x01, 0x00, 0x00, 0x00 } }
 };
 
+/* Generation of deflate data with full flush sync points */
+
+struct bitwriter {
+	unsigned char *next_out;
+	unsigned int tag;
+	int bitcount;
+};
+
+static void bw_putbits(struct bitwriter *bw, unsigned int bits, int num)
+{
+	bw->tag |= bits << bw->bitcount;
+	bw->bitcount += num;
+
+	while (bw->bitcount >= 8) {
+		*bw->next_out++ = (unsigned char) bw->tag;
+		bw->tag >>= 8;
+		bw->bitcount -= 8;
+	}
+}
+
+/* Write Huffman code, which is stored starting with the most significant bit */
+static void bw_putcode(struct bitwriter *bw, unsigned int code, int len)
+{
+	while (len--) {
+		bw_putbits(bw, (code >> len) & 1, 1);
+	}
+}
+
+static void bw_align(struct bitwriter *bw)
+{
+	if (bw->bitcount > 0) {
+		bw_putbits(bw, 0, 8 - bw->bitcount);
+	}
+}
+
+static unsigned int lcg_next(unsigned int *seed)
+{
+	*seed = *seed * 1103515245U + 12345U;
+	return (*seed >> 16) & 0x7FFF;
+}
+
+/*
+ * Write `segments` segments of deflate data each ending with a full flush,
+ * followed by an empty final block. Each segment has a fixed Huffman block
+ * with `seglen` literals and matches, and every other segment has an
+ * uncompressed block full of false sync markers.
+ *
+ * Returns the size of the compressed data, and the decompressed data is
+ * placed in `expect`.
+ */
+static unsigned int make_flushed_deflate(unsigned char *out,
+                                         unsigned char *expect,
+                                         unsigned int *expectLen,
+                                         int segments, unsigned int seglen)
+{
+	/*
+	 * The first is rejected by the length check of an uncompressed
+	 * block, the second is followed by a valid empty final block
+	 */
+	static const unsigned char fake_sync[] = {
+		0x01, 0x00, 0x00, 0xFF, 0xFF, 0x00,
+		0x01, 0x00, 0x00, 0xFF, 0xFF, 0x03, 0x00
+	};
+	struct bitwriter bw;
+	unsigned int seed = 42;
+	unsigned int dlen = 0;
+	int seg;
+
+	bw.next_out = out;
+	bw.tag = 0;
+	bw.bitcount = 0;
+
+	for (seg = 0; seg < segments; ++seg) {
+		unsigned int i, seg_start = dlen;
+
+		/* Fixed Huffman block */
+		bw_putbits(&bw, 0, 1);
+		bw_putbits(&bw, 1, 2);
+
+		for (i = 0; i < seglen; ++i) {
+			unsigned int lit = lcg_next(&seed) & 0xFF;
+
+			/* Match of length 3 at distance 1 within the segment */
+			if (i % 64 == 63 && dlen - seg_start > 0) {
+				bw_putcode(&bw, 257 - 256, 7);
+				bw_putcode(&bw, 0, 5);
+				expect[dlen] = expect[dlen - 1];
+				expect[dlen + 1] = expect[dlen - 1];
+				expect[dlen + 2] = expect[dlen - 1];
+				dlen += 3;
+				continue;
+			}
+
+			if (lit < 144) {
+				bw_putcode(&bw, 0x30 + lit, 8);
+			}
+			else {
+				bw_putcode(&bw, 0x190 + (lit - 144), 9);
+			}
+
+			expect[dlen++] = (unsigned char) lit;
+		}
+
+		/* End of block */
+		bw_putcode(&bw, 0, 7);
+
+		/* Uncompressed block containing false sync markers */
+		if (seg & 1) {
+			bw_putbits(&bw, 0, 3);
+			bw_align(&bw);
+
+			*bw.next_out++ = 0xF0;
+			*bw.next_out++ = 0x00;
+			*bw.next_out++ = 0x0F;
+			*bw.next_out++ = 0xFF;
+
+			for (i = 0; i < 0xF0; ++i) {
+				unsigned char c = fake_sync[i % ARRAY_SIZE(fake_sync)];
+
+				*bw.next_out++ = c;
+				expect[dlen++] = c;
+			}
+		}
+
+		/* Full flush */
+		bw_putbits(&bw, 0, 3);
+		bw_align(&bw);
+
+		*bw.next_out++ = 0x00;
+		*bw.next_out++ = 0x00;
+		*bw.next_out++ = 0xFF;
+		*bw.next_out++ = 0xFF;
+	}
+
+	/* Empty final fixed Huffman block */
+	bw_putbits(&bw, 1, 1);
+	bw_putbits(&bw, 1, 2);
+	bw_putcode(&bw, 0, 7);
+	bw_align(&bw);
+
+	*expectLen = dlen;
+
+	return bw.next_out - out;
+}
+
+/*
+ * Write deflate data with two uncompressed blocks, each followed by a fixed
+ * Huffman block with a match that refers to data in the uncompressed blocks.
+ *
+ * Returns the size of the compressed data, and the decompressed data is
+ * placed in `expect`.
+ */
+static unsigned int make_stored_deflate(unsigned char *out,
+                                        unsigned char *expect,
+                                        unsigned int *expectLen)
+{
+	static const unsigned int stored_len[2] = { 100, 50 };
+	struct bitwriter bw;
+	unsigned int seed = 7;
+	unsigned int dlen = 0;
+	int blk;
+
+	bw.next_out = out;
+	bw.tag = 0;
+	bw.bitcount = 0;
+
+	for (blk = 0; blk < 2; ++blk) {
+		unsigned int i, dist;
+
+		/* Uncompressed block */
+		bw_putbits(&bw, 0, 3);
+		bw_align(&bw);
+
+		*bw.next_out++ = (unsigned char) stored_len[blk];
+		*bw.next_out++ = 0x00;
+		*bw.next_out++ = (unsigned char) ~stored_len[blk];
+		*bw.next_out++ = 0xFF;
+
+		for (i = 0; i < stored_len[blk]; ++i) {
+			unsigned char c = (unsigned char) lcg_next(&seed);
+
+			*bw.next_out++ = c;
+			expect[dlen++] = c;
+		}
+
+		/* Fixed Huffman block with literal 'x' */
+		bw_putbits(&bw, blk, 1);
+		bw_putbits(&bw, 1, 2);
+		bw_putcode(&bw, 0x30 + 'x', 8);
+		expect[dlen++] = 'x';
+
+		/* Match of length 3 at distance 4, or 52 */
+		bw_putcode(&bw, 257 - 256, 7);
+
+		if (blk == 0) {
+			bw_putcode(&bw, 3, 5);
+			dist = 4;
+		}
+		else {
+			bw_putcode(&bw, 11, 5);
+			bw_putbits(&bw, 3, 4);
+			dist = 52;
+		}
+
+		for (i = 0; i < 3; ++i, ++dlen) {
+			expect[dlen] = expect[dlen - dist];
+		}
+
+		/* End of block */
+		bw_putcode(&bw, 0, 7);
+	}
+
+	bw_align(&bw);
+
+	*expectLen = dlen;
+
+	return bw.next_out - out;
+}
+
+/*
+ * Write deflate data with a final fixed Huffman block of `symbols` random
+ * literals and matches, with distances up to 300, ending with a match.
+ *
+ * Returns the size of the compressed data, and the decompressed data is
+ * placed in `expect`.
+ */
+static unsigned int make_match_deflate(unsigned char *out,
+                                       unsigned char *expect,
+                                       unsigned int *expectLen,
+                                       unsigned int seed, int symbols)
+{
+	static const unsigned short length_base[29] = {
+		 3,  4,  5,   6,   7,   8,   9,  10,  11,  13,
+		15, 17, 19,  23,  27,  31,  35,  43,  51,  59,
+		67, 83, 99, 115, 131, 163, 195, 227, 258
+	};
+	static const unsigned char length_bits[29] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+		1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+		4, 4, 4, 4, 5, 5, 5, 5, 0
+	};
+	static const unsigned short dist_base[18] = {
+		  1,   2,   3,  4,  5,  7,  9, 13, 17, 25,
+		 33,  49,  65, 97, 129, 193, 257, 385
+	};
+	static const unsigned char dist_bits[18] = {
+		0, 0, 0, 0, 1, 1, 2, 2, 3, 3,
+		4, 4, 5, 5, 6, 6, 7, 7
+	};
+	struct bitwriter bw;
+	unsigned int dlen = 0;
+	int n;
+
+	bw.next_out = out;
+	bw.tag = 0;
+	bw.bitcount = 0;
+
+	/* Final fixed Huffman block */
+	bw_putbits(&bw, 1, 1);
+	bw_putbits(&bw, 1, 2);
+
+	for (n = 0; n < symbols; ++n) {
+		unsigned int length, dist, i;
+		int c;
+
+		/* Literal, except for the last symbol */
+		if (dlen == 0 || (n + 1 < symbols && lcg_next(&seed) % 3 == 0)) {
+			unsigned int lit = lcg_next(&seed) & 0xFF;
+
+			if (lit < 144) {
+				bw_putcode(&bw, 0x30 + lit, 8);
+			}
+			else {
+				bw_putcode(&bw, 0x190 + (lit - 144), 9);
+			}
+
+			expect[dlen++] = (unsigned char) lit;
+			continue;
+		}
+
+		length = 3 + lcg_next(&seed) % 256;
+		dist = 1 + lcg_next(&seed) % (dlen < 300 ? dlen : 300);
+
+		for (c = 28; length_base[c] > length; --c) {
+			/* nothing */
+		}
+
+		if (c < 280 - 257) {
+			bw_putcode(&bw, c + 1, 7);
+		}
+		else {
+			bw_putcode(&bw, 0xC0 + (c + 257 - 280), 8);
+		}
+
+		bw_putbits(&bw, length - length_base[c], length_bits[c]);
+
+		for (c = 17; dist_base[c] > dist; --c) {
+			/* nothing */
+		}
+
+		bw_putcode(&bw, c, 5);
+		bw_putbits(&bw, dist - dist_base[c], dist_bits[c]);
+
+		for (i = 0; i < length; ++i, ++dlen) {
+			expect[dlen] = expect[dlen - dist];
+		}
+	}
+
+	/* End of block */
+	bw_putcode(&bw, 0, 7);
+	bw_align(&bw);
+
+	*expectLen = dlen;
+
+	return bw.next_out - out;
+}
+
+/*
+ * Write a fixed Huffman block with a zero byte followed by `matches`
+ * matches of length 258 at distance 1, which expands about 160 times.
+ *
+ * Returns the size of the compressed data, which decompresses to
+ * 1 + 258 * `matches` zero bytes.
+ */
+static unsigned int make_bomb_deflate(unsigned char *out, unsigned int matches)
+{
+	struct bitwriter bw;
+	unsigned int i;
+
+	bw.next_out = out;
+	bw.tag = 0;
+	bw.bitcount = 0;
+
+	bw_putbits(&bw, 1, 1);
+	bw_putbits(&bw, 1, 2);
+	bw_putcode(&bw, 0x30, 8);
+
+	for (i = 0; i < matches; ++i) {
+		bw_putcode(&bw, 0xC0 + (285 - 280), 8);
+		bw_putcode(&bw, 0, 5);
+	}
+
+	bw_putcode(&bw, 0, 7);
+	bw_align(&bw);
+
+	return bw.next_out - out;
+}
+
+/* Concatenate spans into out, returns total size */
+static size_t join_spans(unsigned char *out, const struct tinf_span *spans,
+                         size_t count)
+{
+	size_t i, len = 0;
+
+	for (i = 0; i < count; ++i) {
+		memcpy(out + len, spans[i].data, spans[i].len);
+		len += spans[i].len;
+	}
+
+	return len;
+}
+
+static void write_be32(unsigned char *p, unsigned int value)
+{
+	p[0] = (value >> 24) & 0xFF;
+	p[1] = (value >> 16) & 0xFF;
+	p[2] = (value >> 8) & 0xFF;
+	p[3] = value & 0xFF;
+}
+
+static void write_le16(unsigned char *p, unsigned int value)
+{
+	p[0] = value & 0xFF;
+	p[1] = (value >> 8) & 0xFF;
+}
+
+static void write_le32(unsigned char *p, unsigned int value)
+{
+	p[0] = value & 0xFF;
+	p[1] = (value >> 8) & 0xFF;
+	p[2] = (value >> 16) & 0xFF;
+	p[3] = (value >> 24) & 0xFF;
+}
+
+static void write_le64(unsigned char *p, unsigned int value)
+{
+	write_le32(p, value);
+	write_le32(p + 4, 0);
+}
+
+/*
+ * Write a gzip member containing the deflate data, with a BGZF extra field
+ * if bgzf is set. Returns the size of the member.
+ */
+static unsigned int make_gzip_member(unsigned char *out,
+                                     const unsigned char *deflate,
+                                     unsigned int deflateLen,
+                                     const unsigned char *data,
+                                     unsigned int dataLen, int bgzf)
+{
+	static const unsigned char header[] = {
+		0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0B
+	};
+	unsigned int len = ARRAY_SIZE(header);
+
+	memcpy(out, header, ARRAY_SIZE(header));
+
+	if (bgzf) {
+		out[3] = 0x04;
+		out[len++] = 6;
+		out[len++] = 0;
+		out[len++] = 'B';
+		out[len++] = 'C';
+		out[len++] = 2;
+		out[len++] = 0;
+		len += 2;
+	}
+
+	memcpy(out + len, deflate, deflateLen);
+	len += deflateLen;
+
+	write_le32(out + len, tinf_crc32(data, dataLen));
+	write_le32(out + len + 4, dataLen);
+	len += 8;
+
+	if (bgzf) {
+		out[16] = (len - 1) & 0xFF;
+		out[17] = ((len - 1) >> 8) & 0xFF;
+	}
+
+	return len;
+}
+
+/* Sink that appends data to a buffer, and fails on call number fail_at */
+struct sink_buffer {
+	unsigned char *data;
+	size_t len;
+	size_t max;
+	size_t calls;
+	size_t fail_at;
+};
+
+static int TINFCC sink_append(void *arg, const unsigned char *data,
+                              size_t length)
+{
+	struct sink_buffer *sb = (struct sink_buffer *) arg;
+
+	if (++sb->calls == sb->fail_at || length > sb->max - sb->len) {
+		return 1;
+	}
+
+	memcpy(sb->data + sb->len, data, length);
+	sb->len += length;
+
+	return 0;
+}
+
+/* Number of segments and literals per segment in generated test data */
+#define FLUSHED_SEGMENTS 6
+#define FLUSHED_SEGLEN 100000
+
 /* tinflate */
 
 TEST inflate_padding(void)
@@ -332,15 +803,6 @@ TEST inflate_max_matchlen_alt(void)
 
 TEST inflate_max_matchdist(void)
 {
-	/* A match of length 3 with a distance of 32768 */
-	static const unsigned char data[] = {
-		0xED, 0xDD, 0x01, 0x01, 0x00, 0x00, 0x08, 0x02, 0x20, 0xED,
-		0xFF, 0xE8, 0xFA, 0x11, 0x1C, 0x61, 0x9A, 0xF7, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xE0,
-		0xFE, 0xFF, 0x05
-	};
 	unsigned char out[32771];
 	unsigned int dlen = ARRAY_SIZE(out);
 	int res;
@@ -348,7 +810,7 @@ TEST inflate_max_matchdist(void)
 
 	memset(out, 0xFF, ARRAY_SIZE(out));
 
-	res = tinf_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+	res = tinf_uncompress(out, &dlen, matchdist, ARRAY_SIZE(matchdist));
 
 	ASSERT(res == TINF_OK && dlen == ARRAY_SIZE(out));
 
@@ -448,436 +910,2885 @@ TEST inflate_random(void)
 	PASS();
 }
 
-/* Test tinf_uncompress on compressed data with errors */
-TEST inflate_error_case(const void *closure)
+/* Test tinf_uncompress_segment stops at each sync point */
+TEST inflate_segment(void)
 {
-	const struct packed_data *pd = (const struct packed_data *) closure;
-	int res;
+	unsigned char data[1024];
+	unsigned char expect[1024];
+	unsigned int len, expectLen, pos, outLen;
+	int final = 0;
+	int num = 0;
 
-	unsigned int size = pd->depacked_size;
-	res = tinf_uncompress(buffer, &size, pd->data, pd->src_size);
-
-	ASSERT(res != TINF_OK);
+	len = make_flushed_deflate(data, expect, &expectLen, 2, 100);
 
-	PASS();
-}
+	for (pos = 0, outLen = 0; !final; ++num) {
+		size_t dlen = ARRAY_SIZE(buffer) - outLen;
+		size_t slen = len - pos;
+		int res;
 
-SUITE(tinflate)
-{
-	char suffix[32];
-	size_t i;
+		res = tinf_uncompress_segment(buffer + outLen, &dlen, data + pos,
+		                              &slen, 0, &final);
 
-	RUN_TEST(inflate_padding);
-	RUN_TEST(inflate_empty_no_literals);
-	RUN_TEST(inflate_huffman_only);
-	RUN_TEST(inflate_rle);
-	RUN_TEST(inflate_max_matchlen);
-	RUN_TEST(inflate_max_matchlen_alt);
-	RUN_TEST(inflate_max_matchdist);
-	RUN_TEST(inflate_code_length_codes);
-	RUN_TEST(inflate_max_codelen);
+		ASSERT(res == TINF_OK);
 
-	RUN_TEST(inflate_random);
+		/* A segment ends after the 00 00 FF FF of a sync point */
+		ASSERT(final || (slen > 4 && data[pos + slen - 1] == 0xFF
+		                 && data[pos + slen - 4] == 0x00));
 
-	for (i = 0; i < ARRAY_SIZE(inflate_errors); ++i) {
-		sprintf(suffix, "%d", (int) i);
-		greatest_set_test_suffix(suffix);
-		RUN_TEST1(inflate_error_case, &inflate_errors[i]);
+		pos += slen;
+		outLen += dlen;
 	}
-}
 
-/* tinfzlib */
+	ASSERT_EQ(3, num);
+	ASSERT_EQ(len, pos);
+	ASSERT_EQ(expectLen, outLen);
+	ASSERT_MEM_EQ(expect, buffer, expectLen);
 
-TEST zlib_empty_raw(void)
+	PASS();
+}
+
+TEST inflate_repeated_trees(void)
 {
-	/* Empty buffer, uncompressed */
+	/* Eight flushed dynamic blocks, the last three repeating earlier
+	 * code lengths, with five 48 byte messages in order 0 1 2 3 4 0 4 0 */
 	static const unsigned char data[] = {
-		0x78, 0x9C, 0x01, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00, 0x00,
-		0x01
+		0x04, 0xC1, 0x01, 0x01, 0x00, 0x00, 0x00, 0x82, 0xA0, 0xAD,
+		0xD8, 0xFF, 0x0F, 0x01, 0x00, 0x00, 0x00, 0x50, 0x55, 0x55,
+		0xB5, 0x6D, 0xDB, 0x01, 0x00, 0x00, 0xFF, 0xFF, 0x04, 0xC1,
+		0x01, 0x01, 0x00, 0x00, 0x00, 0x82, 0xA0, 0xB3, 0xD8, 0xFF,
+		0x09, 0x01, 0x00, 0x00, 0x00, 0x50, 0x55, 0x55, 0xB5, 0x6D,
+		0xDB, 0x01, 0x00, 0x00, 0xFF, 0xFF, 0x04, 0xC1, 0x01, 0x01,
+		0x00, 0x00, 0x00, 0x82, 0xA0, 0xB9, 0xD8, 0xFF, 0x03, 0x01,
+		0x00, 0x00, 0x00, 0x50, 0x55, 0x55, 0xB5, 0x6D, 0xDB, 0x01,
+		0x00, 0x00, 0xFF, 0xFF, 0x04, 0xC1, 0x31, 0x01, 0x00, 0x00,
+		0x00, 0xC2, 0xA0, 0xBE, 0xCC, 0xFE, 0xB7, 0x00, 0x00, 0x00,
+		0x00, 0x54, 0x55, 0x55, 0x6D, 0xDB, 0x76, 0x00, 0x00, 0x00,
+		0xFF, 0xFF, 0x04, 0xC1, 0x31, 0x01, 0x00, 0x00, 0x00, 0xC2,
+		0xA0, 0xC4, 0xCC, 0xFE, 0x9F, 0x00, 0x00, 0x00, 0x00, 0x54,
+		0x55, 0x55, 0x6D, 0xDB, 0x76, 0x00, 0x00, 0x00, 0xFF, 0xFF,
+		0x04, 0xC1, 0x01, 0x01, 0x00, 0x00, 0x00, 0x82, 0xA0, 0xAD,
+		0xD8, 0xFF, 0x0F, 0x01, 0x00, 0x00, 0x00, 0x50, 0x55, 0x55,
+		0xB5, 0x6D, 0xDB, 0x01, 0x00, 0x00, 0xFF, 0xFF, 0x04, 0xC1,
+		0x31, 0x01, 0x00, 0x00, 0x00, 0xC2, 0xA0, 0xC4, 0xCC, 0xFE,
+		0x9F, 0x00, 0x00, 0x00, 0x00, 0x54, 0x55, 0x55, 0x6D, 0xDB,
+		0x76, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x04, 0xC1, 0x01, 0x01,
+		0x00, 0x00, 0x00, 0x82, 0xA0, 0xAD, 0xD8, 0xFF, 0x0F, 0x01,
+		0x00, 0x00, 0x00, 0x50, 0x55, 0x55, 0xB5, 0x6D, 0xDB, 0x01,
+		0x00, 0x00, 0xFF, 0xFF, 0x03, 0x00
 	};
-	unsigned int dlen = 0;
+	static const int order[] = { 0, 1, 2, 3, 4, 0, 4, 0 };
+	unsigned char expect[384];
+	unsigned char out[384];
+	unsigned int dlen = ARRAY_SIZE(out);
+	struct tinf_cache *cache;
+	size_t i;
 	int res;
 
-	res = tinf_zlib_uncompress((void *) robuffer, &dlen, data, ARRAY_SIZE(data));
+	for (i = 0; i < ARRAY_SIZE(order); ++i) {
+		unsigned char *p = &expect[48 * i];
+		int c = 'a' + 3 * order[i];
 
-	ASSERT(res == TINF_OK && dlen == 0);
+		memset(p, c, 30);
+		memset(p + 30, c + 1, 12);
+		memset(p + 42, c + 2, 6);
+	}
 
-	PASS();
-}
+	res = tinf_uncompress(out, &dlen, data, ARRAY_SIZE(data));
 
-TEST zlib_empty_fixed(void)
-{
-	/* Empty buffer, fixed Huffman */
-	static const unsigned char data[] = {
-		0x78, 0x9C, 0x03, 0x00, 0x00, 0x00, 0x00, 0x01
-	};
-	unsigned int dlen = 0;
-	int res;
+	ASSERT_EQ(TINF_OK, res);
+	ASSERT_EQ(ARRAY_SIZE(expect), dlen);
+	ASSERT_MEM_EQ(expect, out, dlen);
 
-	res = tinf_zlib_uncompress((void *) robuffer, &dlen, data, ARRAY_SIZE(data));
+	/* Later calls with the same cache reuse the trees */
+	cache = tinf_cache_create();
 
-	ASSERT(res == TINF_OK && dlen == 0);
+	ASSERT(cache != NULL);
 
-	PASS();
-}
+	for (i = 0; i < 3; ++i) {
+		size_t clen = ARRAY_SIZE(out);
 
-TEST zlib_empty_dynamic(void)
-{
-	/* Empty buffer, dynamic Huffman */
-	static const unsigned char data[] = {
-		0x78, 0x9C, 0x05, 0xC1, 0x81, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x10, 0xFF, 0xD5, 0x08, 0x00, 0x00, 0x00, 0x01
-	};
-	unsigned int dlen = 0;
-	int res;
+		memset(out, 0, ARRAY_SIZE(out));
 
-	res = tinf_zlib_uncompress((void *) robuffer, &dlen, data, ARRAY_SIZE(data));
+		res = tinf_uncompress_cached(cache, TINF_FORMAT_DEFLATE, out,
+		                             &clen, data, ARRAY_SIZE(data));
 
-	ASSERT(res == TINF_OK && dlen == 0);
+		ASSERT_EQ(TINF_OK, res);
+		ASSERT_EQ(ARRAY_SIZE(expect), clen);
+		ASSERT_MEM_EQ(expect, out, clen);
+	}
 
-	PASS();
-}
+	/* Not enough room, and format errors */
+	{
+		size_t clen = ARRAY_SIZE(out) - 1;
 
-TEST zlib_onebyte_raw(void)
-{
-	/* One byte 00, uncompressed */
-	static const unsigned char data[] = {
-		0x78, 0x9C, 0x01, 0x01, 0x00, 0xFE, 0xFF, 0x00, 0x00, 0x01,
-		0x00, 0x01
-	};
-	unsigned char out[] = { 0xFF };
-	unsigned int dlen = 1;
-	int res;
+		ASSERT_EQ(TINF_BUF_ERROR,
+		          tinf_uncompress_cached(cache, TINF_FORMAT_DEFLATE, out,
+		                                 &clen, data, ARRAY_SIZE(data)));
 
-	res = tinf_zlib_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+		clen = ARRAY_SIZE(out);
 
-	ASSERT(res == TINF_OK && dlen == 1 && out[0] == 0);
+		ASSERT_EQ(TINF_DATA_ERROR,
+		          tinf_uncompress_cached(cache, TINF_FORMAT_ZLIB, out,
+		                                 &clen, data, ARRAY_SIZE(data)));
+	}
+
+	tinf_cache_destroy(cache);
 
 	PASS();
 }
 
-TEST zlib_onebyte_fixed(void)
+TEST inflate_kernels(void)
 {
-	/* One byte 00, fixed Huffman */
-	static const unsigned char data[] = {
-		0x78, 0x9C, 0x63, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01
-	};
-	unsigned char out[] = { 0xFF };
-	unsigned int dlen = 1;
-	int res;
+	static unsigned char data[4096];
+	static unsigned char expect[65536];
+	static unsigned char out[65536 + 64];
+	unsigned int len, expectLen, seed;
+	int kernel, num = 0;
+
+	for (kernel = TINF_KERNEL_PORTABLE; kernel <= TINF_KERNEL_AVX2; ++kernel) {
+		if (tinf_set_kernel(kernel) != kernel) {
+			continue;
+		}
 
-	res = tinf_zlib_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+		++num;
+
+		/* Output ends with a match at the end of dest */
+		for (seed = 1; seed <= 16; ++seed) {
+			size_t dlen;
+			unsigned int i;
+			int res;
+
+			len = make_match_deflate(data, expect, &expectLen, seed, 200);
+
+			memset(out, 0xA5, ARRAY_SIZE(out));
+
+			dlen = expectLen;
+
+			res = tinf_uncompress_z(out, &dlen, data, len);
+
+			ASSERT_EQ(TINF_OK, res);
+			ASSERT_EQ(expectLen, dlen);
+			ASSERT_MEM_EQ(expect, out, dlen);
+
+			for (i = 0; i < 64; ++i) {
+				ASSERT_EQ(0xA5, out[expectLen + i]);
+			}
+		}
+	}
+
+	ASSERT_EQ(TINF_KERNEL_PORTABLE, tinf_set_kernel(42));
+
+	tinf_set_kernel(TINF_KERNEL_AUTO);
+
+	ASSERT(num >= 1);
+
+	PASS();
+}
+
+TEST inflate_padded(void)
+{
+	static unsigned char data[4096];
+	static unsigned char expect[65536];
+	static unsigned char out[65536];
+	unsigned char *padded;
+	unsigned int len, expectLen, seed;
+	size_t dlen;
+	size_t i;
+	int res;
+
+	/* Exact size, so reading past the padding is caught by sanitizers */
+	for (seed = 0; seed < 8; ++seed) {
+		if (seed == 0) {
+			len = make_flushed_deflate(data, expect, &expectLen, 3, 300);
+		}
+		else {
+			len = make_match_deflate(data, expect, &expectLen, seed, 200);
+		}
+
+		padded = (unsigned char *) malloc(len + TINF_PADDING);
+
+		ASSERT(padded != NULL);
+
+		memcpy(padded, data, len);
+		memset(padded + len, seed & 1 ? 0xFF : 0x00, TINF_PADDING);
+
+		dlen = ARRAY_SIZE(out);
+
+		res = tinf_uncompress_padded(out, &dlen, padded, len);
+
+		ASSERT_EQ(TINF_OK, res);
+		ASSERT_EQ(expectLen, dlen);
+		ASSERT_MEM_EQ(expect, out, dlen);
+
+		/* Every truncated stream reads into the padding */
+		for (i = 0; i < len; ++i) {
+			unsigned char *cut = padded + (len - i);
+
+			memset(cut, seed & 1 ? 0xFF : 0x00, TINF_PADDING);
+
+			dlen = ARRAY_SIZE(out);
+
+			res = tinf_uncompress_padded(out, &dlen, padded, len - i);
+
+			ASSERT(i == 0 ? res == TINF_OK : res != TINF_OK);
+		}
+
+		free(padded);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(inflate_errors); ++i) {
+		len = inflate_errors[i].src_size;
+
+		padded = (unsigned char *) malloc(len + TINF_PADDING);
+
+		ASSERT(padded != NULL);
+
+		memcpy(padded, inflate_errors[i].data, len);
+		memset(padded + len, 0xFF, TINF_PADDING);
+
+		dlen = inflate_errors[i].depacked_size;
+
+		res = tinf_uncompress_padded(out, &dlen, padded, len);
+
+		free(padded);
+
+		ASSERT(res != TINF_OK);
+	}
+
+	PASS();
+}
+
+TEST inflate_slop(void)
+{
+	static unsigned char data[4096];
+	static unsigned char expect[65536];
+	static unsigned char out[65536 + TINF_SLOP + 64];
+	unsigned int len, expectLen, seed;
+	int kernel;
+
+	for (kernel = TINF_KERNEL_PORTABLE; kernel <= TINF_KERNEL_AVX2; ++kernel) {
+		if (tinf_set_kernel(kernel) != kernel) {
+			continue;
+		}
+
+		/* Output ends with a match at the end of dest */
+		for (seed = 1; seed <= 16; ++seed) {
+			size_t dlen;
+			unsigned int i;
+			int res;
+
+			len = make_match_deflate(data, expect, &expectLen, seed, 200);
+
+			memset(out, 0xA5, ARRAY_SIZE(out));
+
+			dlen = expectLen;
+
+			res = tinf_uncompress_slop(out, &dlen, data, len);
+
+			ASSERT_EQ(TINF_OK, res);
+			ASSERT_EQ(expectLen, dlen);
+			ASSERT_MEM_EQ(expect, out, dlen);
+
+			/* Nothing is written past the slop */
+			for (i = 0; i < 64; ++i) {
+				ASSERT_EQ(0xA5, out[expectLen + TINF_SLOP + i]);
+			}
+
+			/* One byte short */
+			dlen = expectLen - 1;
+
+			res = tinf_uncompress_slop(out, &dlen, data, len);
+
+			ASSERT_EQ(TINF_BUF_ERROR, res);
+		}
+	}
+
+	tinf_set_kernel(TINF_KERNEL_AUTO);
+
+	PASS();
+}
+
+/* Return one byte at a time */
+static size_t TINFCC source_bytes(void *arg, const unsigned char **data)
+{
+	struct tinf_iovec *v = (struct tinf_iovec *) arg;
+
+	if (v->len == 0) {
+		return 0;
+	}
+
+	*data = (const unsigned char *) v->base;
+
+	v->base = (void *) (*data + 1);
+	v->len -= 1;
+
+	return 1;
+}
+
+/* Test tinf_uncompress_iov with data split at every possible position */
+TEST inflate_iov(void)
+{
+	static unsigned char data[1024];
+	static unsigned char expect[1024];
+	struct tinf_iovec iov[4], v;
+	unsigned int len, expectLen, i;
+	size_t dlen;
+
+	len = make_flushed_deflate(data, expect, &expectLen, 3, 100);
+
+	for (i = 0; i <= len; ++i) {
+		/* Split at i, with an empty part in between */
+		iov[0].base = data;
+		iov[0].len = i;
+		iov[1].base = NULL;
+		iov[1].len = 0;
+		iov[2].base = data + i;
+		iov[2].len = (len - i) / 2;
+		iov[3].base = data + i + iov[2].len;
+		iov[3].len = len - i - iov[2].len;
+
+		dlen = ARRAY_SIZE(buffer);
+
+		ASSERT_EQ(TINF_OK, tinf_uncompress_iov(buffer, &dlen, iov, 4));
+		ASSERT_EQ(expectLen, dlen);
+		ASSERT_MEM_EQ(expect, buffer, expectLen);
+
+		/* Missing last part */
+		dlen = ARRAY_SIZE(buffer);
+
+		if (iov[3].len > 0) {
+			ASSERT_EQ(TINF_DATA_ERROR,
+			          tinf_uncompress_iov(buffer, &dlen, iov, 3));
+		}
+	}
+
+	/* One byte at a time */
+	v.base = data;
+	v.len = len;
+	dlen = ARRAY_SIZE(buffer);
+
+	ASSERT_EQ(TINF_OK, tinf_uncompress_source(buffer, &dlen,
+	                                          source_bytes, &v));
+	ASSERT_EQ(expectLen, dlen);
+	ASSERT_MEM_EQ(expect, buffer, expectLen);
+
+	/* Not enough room for output */
+	dlen = expectLen - 1;
+
+	ASSERT_EQ(TINF_BUF_ERROR, tinf_uncompress_iov(buffer, &dlen, iov, 4));
+
+	PASS();
+}
+
+/* Test tinf_uncompress_to_iov with output split into pages */
+TEST inflate_to_iov(void)
+{
+	static const size_t page_sizes[] = { 1, 3, 100, 4096 };
+	static unsigned char data[1024];
+	static unsigned char expect[1024];
+	static unsigned char out[32771 + 4096];
+	static struct tinf_iovec iov[32771 + 4096 + 1];
+	unsigned int len, expectLen;
+	size_t i, k, dlen;
+
+	len = make_flushed_deflate(data, expect, &expectLen, 3, 100);
+
+	for (i = 0; i < ARRAY_SIZE(page_sizes); ++i) {
+		size_t num = 0;
+
+		/* Pages of equal size, with an empty page second */
+		for (k = 0; k < ARRAY_SIZE(out); k += page_sizes[i]) {
+			iov[num].base = out + k;
+			iov[num].len = page_sizes[i];
+
+			if (++num == 1) {
+				iov[num].base = NULL;
+				iov[num].len = 0;
+				++num;
+			}
+		}
+
+		memset(out, 0xFF, ARRAY_SIZE(out));
+
+		ASSERT_EQ(TINF_OK, tinf_uncompress_to_iov(iov, num, &dlen,
+		                                          data, len));
+		ASSERT_EQ(expectLen, dlen);
+		ASSERT_MEM_EQ(expect, out, expectLen);
+
+		/* Match reaching back 32768 bytes over many pages */
+		memset(out, 0xFF, ARRAY_SIZE(out));
+
+		ASSERT_EQ(TINF_OK, tinf_uncompress_to_iov(iov, num, &dlen,
+		                                          matchdist,
+		                                          ARRAY_SIZE(matchdist)));
+		ASSERT_EQ(32771, dlen);
+
+		for (k = 3; k < 32768; ++k) {
+			if (out[k] != 0) {
+				FAIL();
+			}
+		}
+
+		ASSERT(out[32768] == 2 && out[32769] == 1 && out[32770] == 0);
+
+		/* Room for only the first byte of the match */
+		if (page_sizes[i] == 3) {
+			ASSERT_EQ(TINF_BUF_ERROR,
+			          tinf_uncompress_to_iov(iov, 32769 / 3 + 1,
+			                                 &dlen, matchdist,
+			                                 ARRAY_SIZE(matchdist)));
+		}
+	}
+
+	/* Errors are found with output in pages of one byte */
+	for (i = 0; i < ARRAY_SIZE(inflate_errors); ++i) {
+		for (k = 0; k < inflate_errors[i].depacked_size; ++k) {
+			iov[k].base = out + k;
+			iov[k].len = 1;
+		}
+
+		if (tinf_uncompress_to_iov(iov, k, &dlen,
+		                           inflate_errors[i].data,
+		                           inflate_errors[i].src_size) == TINF_OK) {
+			FAIL();
+		}
+	}
+
+	PASS();
+}
+
+/* Test tinf_uncompress_spans returns uncompressed blocks as spans of source */
+TEST inflate_spans(void)
+{
+	unsigned char data[512];
+	unsigned char expect[512];
+	unsigned char out[512];
+	struct tinf_span spans[8];
+	unsigned int len, expectLen;
+	size_t dlen, num;
+
+	len = make_stored_deflate(data, expect, &expectLen);
+
+	/* Matches must not find stale data in dest */
+	memset(buffer, 0, ARRAY_SIZE(buffer));
+
+	/* Enough spans for both uncompressed blocks */
+	dlen = ARRAY_SIZE(buffer);
+	num = ARRAY_SIZE(spans);
+
+	ASSERT_EQ(TINF_OK, tinf_uncompress_spans(buffer, &dlen, data, len,
+	                                         spans, &num));
+	ASSERT_EQ(expectLen, dlen);
+	ASSERT_EQ(4, num);
+	ASSERT(spans[0].data == data + 5 && spans[0].len == 100);
+	ASSERT(spans[1].data == buffer + 100 && spans[1].len == 4);
+	ASSERT(spans[2].len == 50);
+	ASSERT(spans[2].data > data + 105 && spans[2].data < data + len);
+	ASSERT(spans[3].data == buffer + 154 && spans[3].len == 4);
+	ASSERT_EQ(expectLen, join_spans(out, spans, num));
+	ASSERT_MEM_EQ(expect, out, expectLen);
+
+	/* Second uncompressed block is copied when spans run short */
+	num = 3;
+
+	ASSERT_EQ(TINF_OK, tinf_uncompress_spans(buffer, &dlen, data, len,
+	                                         spans, &num));
+	ASSERT_EQ(2, num);
+	ASSERT(spans[0].data == data + 5);
+	ASSERT_EQ(expectLen, join_spans(out, spans, num));
+	ASSERT_MEM_EQ(expect, out, expectLen);
+
+	/* A single span is all of dest */
+	num = 1;
+
+	ASSERT_EQ(TINF_OK, tinf_uncompress_spans(buffer, &dlen, data, len,
+	                                         spans, &num));
+	ASSERT_EQ(1, num);
+	ASSERT(spans[0].data == buffer && spans[0].len == expectLen);
+	ASSERT_MEM_EQ(expect, buffer, expectLen);
+
+	/* No spans */
+	num = 0;
+
+	ASSERT_EQ(TINF_BUF_ERROR, tinf_uncompress_spans(buffer, &dlen, data, len,
+	                                                spans, &num));
+
+	/* Not enough room for output */
+	dlen = expectLen - 1;
+	num = ARRAY_SIZE(spans);
+
+	ASSERT_EQ(TINF_BUF_ERROR, tinf_uncompress_spans(buffer, &dlen, data, len,
+	                                                spans, &num));
+
+	PASS();
+}
+
+/* Test tinf_session_uncompress with matches into earlier messages */
+TEST inflate_session(void)
+{
+	static struct tinf_session s;
+	unsigned char data[1024];
+	unsigned char expect[1024];
+	unsigned char msg[2][16];
+	unsigned int len, expectLen, pos, outLen;
+	struct bitwriter bw;
+	size_t mlen[2], dlen;
+	int i;
+
+	/* Literals "hello", and a match of length 5 at distance 5 */
+	for (i = 0; i < 2; ++i) {
+		const char *p;
+
+		bw.next_out = msg[i];
+		bw.tag = 0;
+		bw.bitcount = 0;
+
+		bw_putbits(&bw, 0, 1);
+		bw_putbits(&bw, 1, 2);
+
+		if (i == 0) {
+			for (p = "hello"; *p; ++p) {
+				bw_putcode(&bw, 0x30 + *p, 8);
+			}
+		}
+		else {
+			bw_putcode(&bw, 259 - 256, 7);
+			bw_putcode(&bw, 4, 5);
+			bw_putbits(&bw, 0, 1);
+		}
+
+		bw_putcode(&bw, 0, 7);
+
+		/* Sync flush */
+		bw_putbits(&bw, 0, 3);
+		bw_align(&bw);
+		bw_putbits(&bw, 0xFFFF0000, 32);
+
+		mlen[i] = bw.next_out - msg[i];
+	}
+
+	tinf_session_init(&s);
+
+	for (i = 0; i < 2; ++i) {
+		dlen = ARRAY_SIZE(buffer);
+
+		ASSERT_EQ(TINF_OK, tinf_session_uncompress(&s, buffer, &dlen,
+		                                           msg[i], mlen[i]));
+		ASSERT_EQ(5, dlen);
+		ASSERT_MEM_EQ("hello", buffer, 5);
+	}
+
+	/* History is kept when more than 32 KB have been output */
+	for (i = 0; i < 7000; ++i) {
+		dlen = ARRAY_SIZE(buffer);
+
+		ASSERT_EQ(TINF_OK, tinf_session_uncompress(&s, buffer, &dlen,
+		                                           msg[i & 1],
+		                                           mlen[i & 1]));
+		ASSERT_EQ(5, dlen);
+		ASSERT_MEM_EQ("hello", buffer, 5);
+	}
+
+	/* Without history the second message refers before the start */
+	dlen = ARRAY_SIZE(buffer);
+
+	ASSERT_EQ(TINF_DATA_ERROR, tinf_uncompress_z(buffer, &dlen,
+	                                             msg[1], mlen[1]));
+
+	tinf_session_init(&s);
+
+	ASSERT_EQ(TINF_DATA_ERROR, tinf_session_uncompress(&s, buffer, &dlen,
+	                                                   msg[1], mlen[1]));
+
+	/* Message without sync point at the end */
+	tinf_session_init(&s);
+	dlen = ARRAY_SIZE(buffer);
+
+	ASSERT_EQ(TINF_DATA_ERROR, tinf_session_uncompress(&s, buffer, &dlen,
+	                                                   msg[0], mlen[0] - 4));
+
+	/* Flushed segments as messages, ending with the final block */
+	len = make_flushed_deflate(data, expect, &expectLen, 3, 100);
+
+	tinf_session_init(&s);
+
+	for (pos = 0, outLen = 0; pos < len; ) {
+		size_t slen = len - pos;
+		int final;
+
+		dlen = ARRAY_SIZE(buffer) - outLen;
+
+		ASSERT_EQ(TINF_OK, tinf_uncompress_segment(buffer + outLen, &dlen,
+		                                           data + pos, &slen, 0,
+		                                           &final));
+
+		dlen = ARRAY_SIZE(buffer) - outLen;
+
+		ASSERT_EQ(TINF_OK, tinf_session_uncompress(&s, buffer + outLen,
+		                                           &dlen, data + pos,
+		                                           slen));
+
+		pos += slen;
+		outLen += dlen;
+	}
+
+	ASSERT_EQ(expectLen, outLen);
+	ASSERT_MEM_EQ(expect, buffer, expectLen);
+
+	PASS();
+}
+
+/* Test tinf_uncompress_inplace with the size from tinf_uncompress_inplace_size */
+TEST inflate_inplace(void)
+{
+	static unsigned char data[3][1024];
+	static unsigned char expect[3][32771];
+	static unsigned char buf[32771 + 1024];
+	unsigned int len[3], expectLen[3];
+	size_t i, dlen, bufLen;
+
+	len[0] = make_flushed_deflate(data[0], expect[0], &expectLen[0], 3, 100);
+	len[1] = make_stored_deflate(data[1], expect[1], &expectLen[1]);
+
+	len[2] = ARRAY_SIZE(matchdist);
+	memcpy(data[2], matchdist, len[2]);
+	expectLen[2] = 32771;
+	memset(expect[2], 0, 32771);
+	expect[2][0] = expect[2][32768] = 2;
+	expect[2][1] = expect[2][32769] = 1;
+
+	for (i = 0; i < 3; ++i) {
+		dlen = ARRAY_SIZE(buf);
+
+		ASSERT_EQ(TINF_OK, tinf_uncompress_inplace_size(buf, &dlen, data[i],
+		                                                len[i], &bufLen));
+		ASSERT_EQ(expectLen[i], dlen);
+		ASSERT(bufLen >= dlen && bufLen >= len[i]);
+		ASSERT(bufLen <= ARRAY_SIZE(buf));
+
+		/* Compressed data at the end of the buffer */
+		memset(buf, 0xFF, bufLen);
+		memcpy(buf + bufLen - len[i], data[i], len[i]);
+
+		ASSERT_EQ(TINF_OK, tinf_uncompress_inplace(buf, bufLen, len[i],
+		                                           &dlen));
+		ASSERT_EQ(expectLen[i], dlen);
+		ASSERT_MEM_EQ(expect[i], buf, dlen);
+	}
+
+	/* Output would overwrite unread input */
+	memcpy(buf + expectLen[2] - len[2], data[2], len[2]);
+
+	ASSERT_EQ(TINF_BUF_ERROR, tinf_uncompress_inplace(buf, expectLen[2],
+	                                                  len[2], &dlen));
+
+	ASSERT_EQ(TINF_BUF_ERROR, tinf_uncompress_inplace(buf, 1, 2, &dlen));
+
+	/* Compressed data with errors stays within the buffer */
+	for (i = 0; i < ARRAY_SIZE(inflate_errors); ++i) {
+		bufLen = inflate_errors[i].src_size
+		       + inflate_errors[i].depacked_size;
+
+		memcpy(buf + bufLen - inflate_errors[i].src_size,
+		       inflate_errors[i].data, inflate_errors[i].src_size);
+
+		if (tinf_uncompress_inplace(buf, bufLen, inflate_errors[i].src_size,
+		                            &dlen) == TINF_OK && dlen > bufLen) {
+			FAIL();
+		}
+	}
+
+	PASS();
+}
+
+/* Test tinf_stream_step decodes in bounded steps and keeps state */
+TEST inflate_stream_step(void)
+{
+	unsigned char *data, *expect, *out, *gz;
+	struct tinf_stream *s;
+	unsigned int len, expectLen, maxLen, gzLen;
+	size_t dlen, prev, steps;
+	int res;
+
+	maxLen = FLUSHED_SEGMENTS * (2 * FLUSHED_SEGLEN + 1024);
+
+	data = (unsigned char *) malloc(maxLen);
+	expect = (unsigned char *) malloc(maxLen);
+	out = (unsigned char *) malloc(maxLen);
+	gz = (unsigned char *) malloc(maxLen + 32);
+
+	ASSERT(data != NULL && expect != NULL && out != NULL && gz != NULL);
+
+	len = make_flushed_deflate(data, expect, &expectLen,
+	                           FLUSHED_SEGMENTS, FLUSHED_SEGLEN);
+
+	/* Output budget, which a step exceeds by at most a match or block */
+	s = tinf_stream_create(TINF_FORMAT_DEFLATE, out, maxLen, data, len);
+	ASSERT(s != NULL);
+
+	prev = 0;
+	steps = 0;
+
+	while ((res = tinf_stream_step(s, 4096, 0, &dlen)) == TINF_MORE) {
+		ASSERT(dlen >= prev && dlen - prev < 4096 + 258);
+		prev = dlen;
+		++steps;
+	}
+
+	tinf_stream_destroy(s);
+
+	ASSERT_EQ(TINF_OK, res);
+	ASSERT_EQ(expectLen, dlen);
+	ASSERT_MEM_EQ(expect, out, expectLen);
+	ASSERT(steps >= expectLen / (4096 + 258));
+
+	/* Symbol budget of one, on gzip data */
+	gzLen = make_gzip_member(gz, data, len, expect, expectLen, 0);
+
+	s = tinf_stream_create(TINF_FORMAT_GZIP, out, maxLen, gz, gzLen);
+	ASSERT(s != NULL);
+
+	prev = 0;
+	steps = 0;
+
+	while ((res = tinf_stream_step(s, 0, 1, &dlen)) == TINF_MORE) {
+		ASSERT(dlen - prev <= 258);
+		prev = dlen;
+		++steps;
+	}
+
+	ASSERT_EQ(TINF_OK, res);
+	ASSERT_EQ(expectLen, dlen);
+	ASSERT_MEM_EQ(expect, out, expectLen);
+	ASSERT(steps > FLUSHED_SEGMENTS * FLUSHED_SEGLEN / 258);
+
+	/* The result is kept */
+	ASSERT_EQ(TINF_OK, tinf_stream_step(s, 0, 1, &dlen));
+	ASSERT_EQ(expectLen, dlen);
+
+	tinf_stream_destroy(s);
+
+	/* Corrupt checksum is reported at the end */
+	gz[gzLen - 8] ^= 1;
+
+	s = tinf_stream_create(TINF_FORMAT_GZIP, out, maxLen, gz, gzLen);
+	ASSERT(s != NULL);
+
+	while ((res = tinf_stream_step(s, 65536, 0, &dlen)) == TINF_MORE) {
+	}
+
+	tinf_stream_destroy(s);
+
+	ASSERT_EQ(TINF_DATA_ERROR, res);
+
+	/* Header errors are reported by the first step */
+	s = tinf_stream_create(TINF_FORMAT_ZLIB, out, maxLen, data, 1);
+	ASSERT(s != NULL);
+	ASSERT_EQ(TINF_DATA_ERROR, tinf_stream_step(s, 0, 0, &dlen));
+	ASSERT_EQ(0, dlen);
+
+	tinf_stream_destroy(s);
+
+	free(data);
+	free(expect);
+	free(out);
+	free(gz);
+
+	PASS();
+}
+
+/*
+ * Test tinf_stream_restore continues from a checkpoint saved mid-block,
+ * including from a stream that was itself restored
+ */
+TEST inflate_stream_checkpoint(void)
+{
+	static unsigned char cp[TINF_CHECKPOINT_MAX];
+	unsigned char *data, *expect, *out, *gz;
+	struct tinf_stream *s;
+	unsigned int len, expectLen, maxLen, gzLen;
+	size_t dlen, cpLen, total;
+	int format, res, k;
+
+	maxLen = FLUSHED_SEGMENTS * (2 * FLUSHED_SEGLEN + 1024);
+
+	data = (unsigned char *) malloc(maxLen);
+	expect = (unsigned char *) malloc(maxLen);
+	out = (unsigned char *) malloc(maxLen);
+	gz = (unsigned char *) malloc(maxLen + 32);
+
+	ASSERT(data != NULL && expect != NULL && out != NULL && gz != NULL);
+
+	len = make_flushed_deflate(data, expect, &expectLen,
+	                           FLUSHED_SEGMENTS, FLUSHED_SEGLEN);
+	gzLen = make_gzip_member(gz, data, len, expect, expectLen, 0);
+
+	for (format = TINF_FORMAT_DEFLATE; format <= TINF_FORMAT_GZIP;
+	     format += TINF_FORMAT_GZIP) {
+		const unsigned char *src = format == TINF_FORMAT_GZIP ? gz : data;
+		unsigned int srcLen = format == TINF_FORMAT_GZIP ? gzLen : len;
+
+		memset(out, 0, maxLen);
+
+		s = tinf_stream_create(format, out, maxLen, src, srcLen);
+		ASSERT(s != NULL);
+
+		/* Save and restore a few times, with output to the same place */
+		total = 0;
+
+		for (k = 0; k < 3; ++k) {
+			ASSERT_EQ(TINF_MORE, tinf_stream_step(s, 0, 40001 + k,
+			                                      &dlen));
+
+			cpLen = 100;
+			ASSERT_EQ(TINF_BUF_ERROR, tinf_stream_save(s, cp, &cpLen));
+
+			cpLen = ARRAY_SIZE(cp);
+			ASSERT_EQ(TINF_OK, tinf_stream_save(s, cp, &cpLen));
+
+			tinf_stream_destroy(s);
+
+			total += dlen;
+
+			s = tinf_stream_restore(cp, cpLen, out + total,
+			                        maxLen - total, src, srcLen);
+			ASSERT(s != NULL);
+		}
+
+		while ((res = tinf_stream_step(s, 0, 0, &dlen)) == TINF_MORE) {
+		}
+
+		tinf_stream_destroy(s);
+
+		ASSERT_EQ(TINF_OK, res);
+		ASSERT_EQ(expectLen, total + dlen);
+		ASSERT_MEM_EQ(expect, out, expectLen);
+
+		/* Corrupt output after the checkpoint fails the checksum */
+		if (format == TINF_FORMAT_GZIP) {
+			s = tinf_stream_restore(cp, cpLen, out + total,
+			                        maxLen - total, src, srcLen);
+			ASSERT(s != NULL);
+			ASSERT_EQ(TINF_MORE, tinf_stream_step(s, 0, 1, &dlen));
+
+			out[total] ^= 1;
+
+			while ((res = tinf_stream_step(s, 0, 0, &dlen))
+			       == TINF_MORE) {
+			}
+
+			tinf_stream_destroy(s);
+
+			ASSERT_EQ(TINF_DATA_ERROR, res);
+		}
+	}
+
+	/* Corrupt checkpoint, or one for other data */
+	cp[50] ^= 1;
+
+	s = tinf_stream_restore(cp, cpLen, out, maxLen, gz, gzLen);
+	ASSERT(s != NULL);
+	ASSERT_EQ(TINF_DATA_ERROR, tinf_stream_step(s, 0, 0, &dlen));
+	ASSERT_EQ(0, dlen);
+
+	tinf_stream_destroy(s);
+
+	cp[50] ^= 1;
+
+	s = tinf_stream_restore(cp, cpLen, out, maxLen, gz, gzLen - 1);
+	ASSERT(s != NULL);
+	ASSERT_EQ(TINF_DATA_ERROR, tinf_stream_step(s, 0, 0, &dlen));
+
+	tinf_stream_destroy(s);
+
+	free(data);
+	free(expect);
+	free(out);
+	free(gz);
+
+	PASS();
+}
+
+/* Test tinf_uncompress_limited stops a decompression bomb early */
+TEST inflate_limited(void)
+{
+	struct tinf_limits limits;
+	unsigned char *data, *out;
+	size_t dlen, bombLen;
+	unsigned int len;
+
+	bombLen = 1 + 258 * 100000UL;
+
+	data = (unsigned char *) malloc(200000);
+	out = (unsigned char *) malloc(bombLen);
+
+	ASSERT(data != NULL && out != NULL);
+
+	len = make_bomb_deflate(data, 100000);
+
+	/* No limits */
+	memset(&limits, 0, sizeof(limits));
+
+	dlen = bombLen;
+	ASSERT_EQ(TINF_OK, tinf_uncompress_limited(out, &dlen, data, len,
+	                                           &limits));
+	ASSERT_EQ(bombLen, dlen);
+
+	/* Limits that are not exceeded */
+	limits.max_output = bombLen;
+	limits.max_ratio = 200;
+	limits.max_symbols = 100002;
+
+	dlen = bombLen;
+	ASSERT_EQ(TINF_OK, tinf_uncompress_limited(out, &dlen, data, len,
+	                                           &limits));
+	ASSERT_EQ(bombLen, dlen);
+
+	/* Output limit is exact, unlike lack of room */
+	memset(&limits, 0, sizeof(limits));
+	limits.max_output = bombLen - 1;
+
+	dlen = bombLen;
+	ASSERT_EQ(TINF_LIMIT_ERROR, tinf_uncompress_limited(out, &dlen, data,
+	                                                    len, &limits));
+
+	/* Whichever of the output limit and the end of dest comes first */
+	dlen = bombLen - 1;
+	ASSERT_EQ(TINF_LIMIT_ERROR, tinf_uncompress_limited(out, &dlen, data,
+	                                                    len, &limits));
+
+	dlen = 1000;
+	ASSERT_EQ(TINF_BUF_ERROR, tinf_uncompress_limited(out, &dlen, data,
+	                                                  len, &limits));
+
+	/* Ratio and symbol limits stop within the block, before dest fills */
+	memset(&limits, 0, sizeof(limits));
+	limits.max_ratio = 100;
+
+	dlen = 2 * 1024 * 1024;
+	ASSERT_EQ(TINF_LIMIT_ERROR, tinf_uncompress_limited(out, &dlen, data,
+	                                                    len, &limits));
+
+	memset(&limits, 0, sizeof(limits));
+	limits.max_symbols = 5000;
+
+	dlen = 4 * 1024 * 1024;
+	ASSERT_EQ(TINF_LIMIT_ERROR, tinf_uncompress_limited(out, &dlen, data,
+	                                                    len, &limits));
+
+	/* Small input is checked after the block */
+	memset(&limits, 0, sizeof(limits));
+	limits.max_ratio = 100;
+
+	dlen = bombLen;
+	ASSERT_EQ(TINF_LIMIT_ERROR, tinf_uncompress_limited(out, &dlen,
+	                                                    matchdist,
+	                                                    ARRAY_SIZE(matchdist),
+	                                                    &limits));
+
+	free(data);
+	free(out);
+
+	PASS();
+}
+
+/* Allocator functions that fail, except releasing */
+static void *TINFCC failing_alloc(void *opaque, size_t size)
+{
+	(void) opaque;
+	(void) size;
+
+	return NULL;
+}
+
+static void *TINFCC failing_resize(void *opaque, void *ptr, size_t size)
+{
+	(void) opaque;
+	(void) ptr;
+	(void) size;
+
+	return NULL;
+}
+
+static void TINFCC failing_release(void *opaque, void *ptr)
+{
+	(void) opaque;
+
+	free(ptr);
+}
+
+static void *TINFCC plain_alloc(void *opaque, size_t size)
+{
+	(void) opaque;
+
+	return malloc(size);
+}
+
+/* Test tinf_uncompress_alloc grows the output buffer from a small hint */
+TEST inflate_alloc(void)
+{
+	unsigned char *data, *expect;
+	struct tinf_allocator allocator;
+	struct tinf_arena arena;
+	unsigned int len, expectLen, maxLen;
+	void *out;
+	size_t dlen, i;
+
+	maxLen = FLUSHED_SEGMENTS * (2 * FLUSHED_SEGLEN + 1024);
+
+	data = (unsigned char *) malloc(maxLen);
+	expect = (unsigned char *) malloc(maxLen);
+
+	ASSERT(data != NULL && expect != NULL);
+
+	len = make_flushed_deflate(data, expect, &expectLen,
+	                           FLUSHED_SEGMENTS, FLUSHED_SEGLEN);
+
+	ASSERT_EQ(TINF_OK, tinf_uncompress_alloc(&out, &dlen, data, len, 1, 0,
+	                                         NULL));
+	ASSERT_EQ(expectLen, dlen);
+	ASSERT_MEM_EQ(expect, out, expectLen);
+
+	free(out);
+
+	/* Exactly at the limit */
+	ASSERT_EQ(TINF_OK, tinf_uncompress_alloc(&out, &dlen, data, len, 0,
+	                                         expectLen, NULL));
+	ASSERT_EQ(expectLen, dlen);
+
+	free(out);
+
+	/* Over the limit */
+	ASSERT_EQ(TINF_BUF_ERROR, tinf_uncompress_alloc(&out, &dlen, data, len,
+	                                                0, expectLen - 1, NULL));
+	ASSERT(out == NULL);
+
+	/* Match across growth, from an arena */
+	tinf_arena_init(&arena, 4096, 0);
+	tinf_arena_allocator(&arena, &allocator);
+
+	ASSERT_EQ(TINF_OK, tinf_uncompress_alloc(&out, &dlen, matchdist,
+	                                         ARRAY_SIZE(matchdist), 1, 0,
+	                                         &allocator));
+	ASSERT_EQ(32771, dlen);
+	ASSERT(((unsigned char *) out)[32768] == 2);
+
+	tinf_arena_destroy(&arena);
+
+	/* Allocation failure is reported as such */
+	allocator.alloc = failing_alloc;
+	allocator.resize = failing_resize;
+	allocator.release = failing_release;
+	allocator.opaque = NULL;
+
+	ASSERT_EQ(TINF_MEM_ERROR, tinf_uncompress_alloc(&out, &dlen, data, len,
+	                                                0, 0, &allocator));
+	ASSERT(out == NULL);
+
+	/* Growing the buffer fails */
+	allocator.alloc = plain_alloc;
+
+	ASSERT_EQ(TINF_MEM_ERROR, tinf_uncompress_alloc(&out, &dlen, data, len,
+	                                                1, 0, &allocator));
+	ASSERT(out == NULL);
+
+	/* Compressed data with errors */
+	for (i = 0; i < ARRAY_SIZE(inflate_errors); ++i) {
+		if (tinf_uncompress_alloc(&out, &dlen, inflate_errors[i].data,
+		                          inflate_errors[i].src_size, 0,
+		                          inflate_errors[i].depacked_size,
+		                          NULL) == TINF_OK) {
+			free(out);
+		}
+	}
+
+	free(data);
+	free(expect);
+
+	PASS();
+}
+
+/* Test tinf_uncompress_sink passes all output through a small window */
+TEST inflate_sink(void)
+{
+	static const size_t windows[] = {
+		TINF_WINDOW_MIN, 3 * TINF_WINDOW_MIN + 7
+	};
+	unsigned char *data, *expect, *window;
+	unsigned int len, expectLen, maxLen;
+	struct sink_buffer sb;
+	size_t i;
+
+	maxLen = FLUSHED_SEGMENTS * (2 * FLUSHED_SEGLEN + 1024);
+
+	data = (unsigned char *) malloc(maxLen);
+	expect = (unsigned char *) malloc(maxLen);
+	sb.data = (unsigned char *) malloc(maxLen);
+	window = (unsigned char *) malloc(3 * TINF_WINDOW_MIN + 7);
+
+	ASSERT(data != NULL && expect != NULL && sb.data != NULL
+	       && window != NULL);
+
+	sb.max = maxLen;
+
+	len = make_flushed_deflate(data, expect, &expectLen,
+	                           FLUSHED_SEGMENTS, FLUSHED_SEGLEN);
+
+	for (i = 0; i < ARRAY_SIZE(windows); ++i) {
+		sb.len = 0;
+		sb.calls = 0;
+		sb.fail_at = 0;
+
+		ASSERT_EQ(TINF_OK, tinf_uncompress_sink(sink_append, &sb,
+		                                        data, len,
+		                                        window, windows[i]));
+
+		ASSERT(sb.calls > 1);
+		ASSERT_EQ(expectLen, sb.len);
+		ASSERT_MEM_EQ(expect, sb.data, expectLen);
+	}
+
+	/* Back-reference to the start of the history */
+	sb.len = 0;
+	sb.calls = 0;
+
+	ASSERT_EQ(TINF_OK, tinf_uncompress_sink(sink_append, &sb, matchdist,
+	                                        ARRAY_SIZE(matchdist),
+	                                        window, TINF_WINDOW_MIN));
+
+	ASSERT_EQ(32771, sb.len);
+	ASSERT(sb.data[32768] == 2 && sb.data[32769] == 1 && sb.data[32770] == 0);
+
+	/* Sink stops decompression */
+	sb.len = 0;
+	sb.calls = 0;
+	sb.fail_at = 2;
+
+	ASSERT_EQ(TINF_BUF_ERROR, tinf_uncompress_sink(sink_append, &sb,
+	                                               data, len,
+	                                               window, TINF_WINDOW_MIN));
+
+	/* Window too small */
+	ASSERT_EQ(TINF_BUF_ERROR, tinf_uncompress_sink(sink_append, &sb,
+	                                               data, len, window,
+	                                               TINF_WINDOW_MIN - 1));
+
+	free(data);
+	free(expect);
+	free(sb.data);
+	free(window);
+
+	PASS();
+}
+
+/* Test tinf_uncompress on compressed data with errors */
+TEST inflate_error_case(const void *closure)
+{
+	const struct packed_data *pd = (const struct packed_data *) closure;
+	int res;
+
+	unsigned int size = pd->depacked_size;
+	res = tinf_uncompress(buffer, &size, pd->data, pd->src_size);
+
+	ASSERT(res != TINF_OK);
+
+	PASS();
+}
+
+SUITE(tinflate)
+{
+	char suffix[32];
+	size_t i;
+
+	RUN_TEST(inflate_padding);
+	RUN_TEST(inflate_empty_no_literals);
+	RUN_TEST(inflate_huffman_only);
+	RUN_TEST(inflate_rle);
+	RUN_TEST(inflate_max_matchlen);
+	RUN_TEST(inflate_max_matchlen_alt);
+	RUN_TEST(inflate_max_matchdist);
+	RUN_TEST(inflate_code_length_codes);
+	RUN_TEST(inflate_max_codelen);
+
+	RUN_TEST(inflate_random);
+	RUN_TEST(inflate_segment);
+	RUN_TEST(inflate_repeated_trees);
+	RUN_TEST(inflate_kernels);
+	RUN_TEST(inflate_padded);
+	RUN_TEST(inflate_slop);
+	RUN_TEST(inflate_sink);
+	RUN_TEST(inflate_iov);
+	RUN_TEST(inflate_to_iov);
+	RUN_TEST(inflate_spans);
+	RUN_TEST(inflate_session);
+	RUN_TEST(inflate_inplace);
+	RUN_TEST(inflate_alloc);
+	RUN_TEST(inflate_limited);
+	RUN_TEST(inflate_stream_step);
+	RUN_TEST(inflate_stream_checkpoint);
+
+	for (i = 0; i < ARRAY_SIZE(inflate_errors); ++i) {
+		sprintf(suffix, "%d", (int) i);
+		greatest_set_test_suffix(suffix);
+		RUN_TEST1(inflate_error_case, &inflate_errors[i]);
+	}
+}
+
+/* tinfzlib */
+
+TEST zlib_empty_raw(void)
+{
+	/* Empty buffer, uncompressed */
+	static const unsigned char data[] = {
+		0x78, 0x9C, 0x01, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00, 0x00,
+		0x01
+	};
+	unsigned int dlen = 0;
+	int res;
+
+	res = tinf_zlib_uncompress((void *) robuffer, &dlen, data, ARRAY_SIZE(data));
+
+	ASSERT(res == TINF_OK && dlen == 0);
+
+	PASS();
+}
+
+TEST zlib_empty_fixed(void)
+{
+	/* Empty buffer, fixed Huffman */
+	static const unsigned char data[] = {
+		0x78, 0x9C, 0x03, 0x00, 0x00, 0x00, 0x00, 0x01
+	};
+	unsigned int dlen = 0;
+	int res;
+
+	res = tinf_zlib_uncompress((void *) robuffer, &dlen, data, ARRAY_SIZE(data));
+
+	ASSERT(res == TINF_OK && dlen == 0);
+
+	PASS();
+}
+
+TEST zlib_empty_dynamic(void)
+{
+	/* Empty buffer, dynamic Huffman */
+	static const unsigned char data[] = {
+		0x78, 0x9C, 0x05, 0xC1, 0x81, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x10, 0xFF, 0xD5, 0x08, 0x00, 0x00, 0x00, 0x01
+	};
+	unsigned int dlen = 0;
+	int res;
+
+	res = tinf_zlib_uncompress((void *) robuffer, &dlen, data, ARRAY_SIZE(data));
+
+	ASSERT(res == TINF_OK && dlen == 0);
+
+	PASS();
+}
+
+TEST zlib_onebyte_raw(void)
+{
+	/* One byte 00, uncompressed */
+	static const unsigned char data[] = {
+		0x78, 0x9C, 0x01, 0x01, 0x00, 0xFE, 0xFF, 0x00, 0x00, 0x01,
+		0x00, 0x01
+	};
+	unsigned char out[] = { 0xFF };
+	unsigned int dlen = 1;
+	int res;
+
+	res = tinf_zlib_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+
+	ASSERT(res == TINF_OK && dlen == 1 && out[0] == 0);
+
+	PASS();
+}
+
+TEST zlib_onebyte_fixed(void)
+{
+	/* One byte 00, fixed Huffman */
+	static const unsigned char data[] = {
+		0x78, 0x9C, 0x63, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01
+	};
+	unsigned char out[] = { 0xFF };
+	unsigned int dlen = 1;
+	int res;
+
+	res = tinf_zlib_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+
+	ASSERT(res == TINF_OK && dlen == 1 && out[0] == 0);
+
+	PASS();
+}
+
+TEST zlib_onebyte_dynamic(void)
+{
+	/* One byte 00, dynamic Huffman */
+	static const unsigned char data[] = {
+		0x78, 0x9C, 0x05, 0xC1, 0x81, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x10, 0xFF, 0xD5, 0x10, 0x00, 0x01, 0x00, 0x01
+	};
+	unsigned char out[] = { 0xFF };
+	unsigned int dlen = 1;
+	int res;
+
+	res = tinf_zlib_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+
+	ASSERT(res == TINF_OK && dlen == 1 && out[0] == 0);
+
+	PASS();
+}
+
+TEST zlib_zeroes(void)
+{
+	/* 256 zero bytes, to test unrolling in Adler-32 */
+	static const unsigned char data[] = {
+		0x78, 0x9C, 0x63, 0x60, 0x18, 0xD9, 0x00, 0x00, 0x01, 0x00,
+		0x00, 0x01
+	};
+	unsigned char out[256];
+	unsigned int dlen = ARRAY_SIZE(out);
+	int res;
+	size_t i;
+
+	memset(out, 0xFF, ARRAY_SIZE(out));
+
+	res = tinf_zlib_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+
+	ASSERT(res == TINF_OK && dlen == ARRAY_SIZE(out));
+
+	for (i = 0; i < ARRAY_SIZE(out); ++i) {
+		if (out[i]) {
+			FAIL();
+		}
+	}
+
+	PASS();
+}
+
+/* Test tinf_zlib_uncompress_parallel on data with full flush sync points */
+TEST zlib_parallel(void)
+{
+	struct tinf_allocator allocator;
+	unsigned char *data, *expect, *out;
+	unsigned int len, expectLen, maxLen;
+	int threads;
+
+	maxLen = FLUSHED_SEGMENTS * (2 * FLUSHED_SEGLEN + 1024);
+
+	data = (unsigned char *) malloc(maxLen);
+	expect = (unsigned char *) malloc(maxLen);
+	out = (unsigned char *) malloc(maxLen);
+
+	ASSERT(data != NULL && expect != NULL && out != NULL);
+
+	data[0] = 0x78;
+	data[1] = 0x9C;
+
+	len = 2 + make_flushed_deflate(data + 2, expect, &expectLen,
+	                               FLUSHED_SEGMENTS, FLUSHED_SEGLEN);
+
+	write_be32(data + len, tinf_adler32(expect, expectLen));
+	len += 4;
+
+	for (threads = 1; threads <= 8; threads *= 2) {
+		size_t dlen = maxLen;
+		int res;
+
+		memset(out, 0, maxLen);
+
+		res = tinf_zlib_uncompress_parallel(out, &dlen, data, len, threads);
+
+		ASSERT_EQ(TINF_OK, res);
+		ASSERT_EQ(expectLen, dlen);
+		ASSERT_MEM_EQ(expect, out, expectLen);
+
+		/* Output one byte too small */
+		dlen = expectLen - 1;
+
+		res = tinf_zlib_uncompress_parallel(out, &dlen, data, len, threads);
+
+		ASSERT_EQ(TINF_BUF_ERROR, res);
+	}
+
+	/* Allocation failure falls back to sequential decompression */
+	allocator.alloc = failing_alloc;
+	allocator.resize = failing_resize;
+	allocator.release = failing_release;
+	allocator.opaque = NULL;
+
+	tinf_set_allocator(&allocator);
+
+	{
+		size_t dlen = maxLen;
+		int res;
+
+		memset(out, 0, maxLen);
+
+		res = tinf_zlib_uncompress_parallel(out, &dlen, data, len, 4);
+
+		tinf_set_allocator(NULL);
+
+		ASSERT_EQ(TINF_OK, res);
+		ASSERT_EQ(expectLen, dlen);
+		ASSERT_MEM_EQ(expect, out, expectLen);
+	}
+
+	/* Corrupt checksum */
+	data[len - 1] ^= 1;
+
+	{
+		size_t dlen = maxLen;
+
+		ASSERT(tinf_zlib_uncompress_parallel(out, &dlen, data, len, 4) != TINF_OK);
+	}
+
+	free(data);
+	free(expect);
+	free(out);
+
+	PASS();
+}
+
+/* Test tinf_zlib_uncompress_limited passes limit and buffer errors on */
+TEST zlib_limited(void)
+{
+	struct tinf_limits limits;
+	unsigned char *data, *out;
+	unsigned int len, outLen;
+	size_t dlen;
+
+	outLen = 1 + 258 * 1000;
+
+	data = (unsigned char *) malloc(2000);
+	out = (unsigned char *) calloc(outLen, 1);
+
+	ASSERT(data != NULL && out != NULL);
+
+	data[0] = 0x78;
+	data[1] = 0x9C;
+
+	len = 2 + make_bomb_deflate(data + 2, 1000);
+
+	write_be32(data + len, tinf_adler32(out, outLen));
+	len += 4;
+
+	memset(&limits, 0, sizeof(limits));
+	limits.max_output = outLen;
+
+	dlen = outLen;
+	ASSERT_EQ(TINF_OK, tinf_zlib_uncompress_limited(out, &dlen, data, len,
+	                                                &limits));
+	ASSERT_EQ(outLen, dlen);
+
+	/* Output limit or lack of room, whichever comes first */
+	limits.max_output = outLen - 1;
+
+	dlen = outLen - 1;
+	ASSERT_EQ(TINF_LIMIT_ERROR, tinf_zlib_uncompress_limited(out, &dlen,
+	                                                         data, len,
+	                                                         &limits));
+
+	dlen = 1000;
+	ASSERT_EQ(TINF_BUF_ERROR, tinf_zlib_uncompress_limited(out, &dlen,
+	                                                       data, len,
+	                                                       &limits));
+
+	free(data);
+	free(out);
+
+	PASS();
+}
+
+/* Test tinf_zlib_uncompress_sink */
+TEST zlib_sink(void)
+{
+	unsigned char *data, *expect, *window;
+	unsigned int len, expectLen, maxLen;
+	struct sink_buffer sb;
+
+	maxLen = FLUSHED_SEGMENTS * (2 * FLUSHED_SEGLEN + 1024);
+
+	data = (unsigned char *) malloc(maxLen);
+	expect = (unsigned char *) malloc(maxLen);
+	sb.data = (unsigned char *) malloc(maxLen);
+	window = (unsigned char *) malloc(TINF_WINDOW_MIN);
+
+	ASSERT(data != NULL && expect != NULL && sb.data != NULL
+	       && window != NULL);
+
+	data[0] = 0x78;
+	data[1] = 0x9C;
+
+	len = 2 + make_flushed_deflate(data + 2, expect, &expectLen,
+	                               FLUSHED_SEGMENTS, FLUSHED_SEGLEN);
+
+	write_be32(data + len, tinf_adler32(expect, expectLen));
+	len += 4;
+
+	sb.max = maxLen;
+	sb.len = 0;
+	sb.calls = 0;
+	sb.fail_at = 0;
+
+	ASSERT_EQ(TINF_OK, tinf_zlib_uncompress_sink(sink_append, &sb, data, len,
+	                                          window, TINF_WINDOW_MIN));
+
+	ASSERT_EQ(expectLen, sb.len);
+	ASSERT_MEM_EQ(expect, sb.data, expectLen);
+
+	/* Corrupt checksum */
+	data[len - 1] ^= 1;
+
+	sb.len = 0;
+
+	ASSERT_EQ(TINF_DATA_ERROR, tinf_zlib_uncompress_sink(sink_append, &sb,
+	                                                  data, len, window,
+	                                                  TINF_WINDOW_MIN));
+
+	free(data);
+	free(expect);
+	free(sb.data);
+	free(window);
+
+	PASS();
+}
+
+/* Test tinf_zlib_uncompress on compressed data with errors */
+/* Test tinf_zlib_uncompress_alloc checks the Adler-32 of grown output */
+TEST zlib_alloc(void)
+{
+	/* 256 zero bytes */
+	static unsigned char data[] = {
+		0x78, 0x9C, 0x63, 0x60, 0x18, 0xD9, 0x00, 0x00, 0x01, 0x00,
+		0x00, 0x01
+	};
+	void *out;
+	size_t dlen, i;
+
+	ASSERT_EQ(TINF_OK, tinf_zlib_uncompress_alloc(&out, &dlen, data,
+	                                              ARRAY_SIZE(data), 16, 0,
+	                                              NULL));
+	ASSERT_EQ(256, dlen);
+
+	for (i = 0; i < dlen; ++i) {
+		if (((unsigned char *) out)[i]) {
+			FAIL();
+		}
+	}
+
+	free(out);
+
+	ASSERT_EQ(TINF_BUF_ERROR, tinf_zlib_uncompress_alloc(&out, &dlen, data,
+	                                                     ARRAY_SIZE(data),
+	                                                     16, 255, NULL));
+
+	/* Corrupt checksum */
+	data[ARRAY_SIZE(data) - 1] ^= 1;
+
+	ASSERT_EQ(TINF_DATA_ERROR, tinf_zlib_uncompress_alloc(&out, &dlen, data,
+	                                                      ARRAY_SIZE(data),
+	                                                      16, 0, NULL));
+	ASSERT(out == NULL);
+
+	data[ARRAY_SIZE(data) - 1] ^= 1;
+
+	PASS();
+}
+
+/* Test tinf_zlib_uncompress_dict finds the preset dictionary by DICTID */
+TEST zlib_dict(void)
+{
+	/* Message compressed with the dictionary below */
+	static const unsigned char data[] = {
+		0x78, 0xF9, 0x6E, 0x4F, 0x37, 0x51, 0x43, 0xE5, 0x99, 0x18,
+		0x59, 0x23, 0xEB, 0x37, 0x32, 0xD4, 0x33, 0x45, 0x98, 0x61,
+		0x62, 0x80, 0x30, 0xC5, 0xD0, 0xC0, 0xD0, 0x18, 0x00, 0x86,
+		0xAA, 0x14, 0xC6
+	};
+	/* One byte 00, fixed Huffman, without dictionary */
+	static const unsigned char nodict[] = {
+		0x78, 0x9C, 0x63, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01
+	};
+	static const char dict[] =
+		"temperature=;humidity=;pressure=;device=sensor-"
+		"temperature=;humidity=;pressure=;device=sensor-"
+		"temperature=;humidity=;pressure=;device=sensor-";
+	static const char expect[] =
+		"device=sensor-42;temperature=21.5;humidity=40;pressure=1013";
+	struct tinf_dict dicts[3];
+	size_t dlen;
+
+	dicts[0].data = expect;
+	dicts[0].len = sizeof(expect) - 1;
+	dicts[1].data = dict;
+	dicts[1].len = sizeof(dict) - 1;
+	dicts[2].data = dict;
+	dicts[2].len = 47;
+
+	tinf_dict_registry_init(dicts, ARRAY_SIZE(dicts));
+
+	ASSERT(dicts[0].id < dicts[1].id && dicts[1].id < dicts[2].id);
+
+	dlen = ARRAY_SIZE(buffer);
+
+	ASSERT_EQ(TINF_OK, tinf_zlib_uncompress_dict(buffer, &dlen, data,
+	                                             ARRAY_SIZE(data),
+	                                             dicts, 3));
+	ASSERT_EQ(sizeof(expect) - 1, dlen);
+	ASSERT_MEM_EQ(expect, buffer, dlen);
+
+	/* Raw deflate data with the dictionary */
+	dlen = ARRAY_SIZE(buffer);
+
+	ASSERT_EQ(TINF_OK, tinf_uncompress_dict(buffer, &dlen, data + 6,
+	                                        ARRAY_SIZE(data) - 10,
+	                                        dict, sizeof(dict) - 1));
+	ASSERT_EQ(sizeof(expect) - 1, dlen);
+	ASSERT_MEM_EQ(expect, buffer, dlen);
+
+	/* Data without dictionary */
+	dlen = ARRAY_SIZE(buffer);
+
+	ASSERT_EQ(TINF_OK, tinf_zlib_uncompress_dict(buffer, &dlen, nodict,
+	                                             ARRAY_SIZE(nodict),
+	                                             NULL, 0));
+	ASSERT(dlen == 1 && buffer[0] == 0);
+
+	/* Dictionary not in registry */
+	dicts[0].data = expect;
+	dicts[0].len = sizeof(expect) - 1;
+
+	tinf_dict_registry_init(dicts, 1);
+	dlen = ARRAY_SIZE(buffer);
+
+	ASSERT_EQ(TINF_DATA_ERROR, tinf_zlib_uncompress_dict(buffer, &dlen,
+	                                                     data,
+	                                                     ARRAY_SIZE(data),
+	                                                     dicts, 1));
+
+	/* Preset dictionary not supported without registry */
+	ASSERT_EQ(TINF_DATA_ERROR, tinf_zlib_uncompress_z(buffer, &dlen, data,
+	                                                  ARRAY_SIZE(data)));
+
+	PASS();
+}
+
+TEST zlib_error_case(const void *closure)
+{
+	const struct packed_data *pd = (const struct packed_data *) closure;
+	int res;
+
+	unsigned int size = pd->depacked_size;
+	res = tinf_zlib_uncompress(buffer, &size, pd->data, pd->src_size);
+
+	ASSERT(res != TINF_OK);
+
+	PASS();
+}
+
+SUITE(tinfzlib)
+{
+	char suffix[32];
+	size_t i;
+
+	RUN_TEST(zlib_empty_raw);
+	RUN_TEST(zlib_empty_fixed);
+	RUN_TEST(zlib_empty_dynamic);
+
+	RUN_TEST(zlib_onebyte_raw);
+	RUN_TEST(zlib_onebyte_fixed);
+	RUN_TEST(zlib_onebyte_dynamic);
+	RUN_TEST(zlib_zeroes);
+
+	RUN_TEST(zlib_parallel);
+	RUN_TEST(zlib_sink);
+	RUN_TEST(zlib_alloc);
+	RUN_TEST(zlib_limited);
+	RUN_TEST(zlib_dict);
+
+	for (i = 0; i < ARRAY_SIZE(zlib_errors); ++i) {
+		sprintf(suffix, "%d", (int) i);
+		greatest_set_test_suffix(suffix);
+		RUN_TEST1(zlib_error_case, &zlib_errors[i]);
+	}
+}
+
+/* tinfgzip */
+
+TEST gzip_empty_raw(void)
+{
+	/* Empty buffer, uncompressed */
+	static const unsigned char data[] = {
+		0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0B,
+		0x01, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00
+	};
+	unsigned int dlen = 0;
+	int res;
+
+	res = tinf_gzip_uncompress((void *) robuffer, &dlen, data, ARRAY_SIZE(data));
+
+	ASSERT(res == TINF_OK && dlen == 0);
+
+	PASS();
+}
+
+TEST gzip_empty_fixed(void)
+{
+	/* Empty buffer, fixed Huffman */
+	static const unsigned char data[] = {
+		0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0B,
+		0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+	};
+	unsigned int dlen = 0;
+	int res;
+
+	res = tinf_gzip_uncompress((void *) robuffer, &dlen, data, ARRAY_SIZE(data));
+
+	ASSERT(res == TINF_OK && dlen == 0);
+
+	PASS();
+}
+
+TEST gzip_empty_dynamic(void)
+{
+	/* Empty buffer, dynamic Huffman */
+	static const unsigned char data[] = {
+		0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0B,
+		0x05, 0xC1, 0x81, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0xFF,
+		0xD5, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+	};
+	unsigned int dlen = 0;
+	int res;
+
+	res = tinf_gzip_uncompress((void *) robuffer, &dlen, data, ARRAY_SIZE(data));
+
+	ASSERT(res == TINF_OK && dlen == 0);
+
+	PASS();
+}
+
+TEST gzip_onebyte_raw(void)
+{
+	/* One byte 00, uncompressed */
+	static const unsigned char data[] = {
+		0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0B,
+		0x01, 0x01, 0x00, 0xFE, 0xFF, 0x00, 0x8D, 0xEF, 0x02, 0xD2,
+		0x01, 0x00, 0x00, 0x00
+	};
+	unsigned char out[] = { 0xFF };
+	unsigned int dlen = 1;
+	int res;
+
+	res = tinf_gzip_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+
+	ASSERT(res == TINF_OK && dlen == 1 && out[0] == 0);
+
+	PASS();
+}
+
+TEST gzip_onebyte_fixed(void)
+{
+	/* One byte 00, fixed Huffman */
+	static const unsigned char data[] = {
+		0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0B,
+		0x63, 0x00, 0x00, 0x8D, 0xEF, 0x02, 0xD2, 0x01, 0x00, 0x00,
+		0x00
+	};
+	unsigned char out[] = { 0xFF };
+	unsigned int dlen = 1;
+	int res;
+
+	res = tinf_gzip_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+
+	ASSERT(res == TINF_OK && dlen == 1 && out[0] == 0);
+
+	PASS();
+}
+
+TEST gzip_onebyte_dynamic(void)
+{
+	/* One byte 00, dynamic Huffman */
+	static const unsigned char data[] = {
+		0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0B,
+		0x05, 0xC1, 0x81, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0xFF,
+		0xD5, 0x10, 0x8D, 0xEF, 0x02, 0xD2, 0x01, 0x00, 0x00, 0x00
+	};
+	unsigned char out[] = { 0xFF };
+	unsigned int dlen = 1;
+	int res;
+
+	res = tinf_gzip_uncompress(out, &dlen, data, ARRAY_SIZE(data));
 
 	ASSERT(res == TINF_OK && dlen == 1 && out[0] == 0);
 
 	PASS();
 }
 
-TEST zlib_onebyte_dynamic(void)
+TEST gzip_fhcrc(void)
 {
-	/* One byte 00, dynamic Huffman */
+	/* One byte 00, uncompressed, fhcrc */
 	static const unsigned char data[] = {
-		0x78, 0x9C, 0x05, 0xC1, 0x81, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x10, 0xFF, 0xD5, 0x10, 0x00, 0x01, 0x00, 0x01
+		0x1F, 0x8B, 0x08, 0x02, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0B,
+		0x17, 0x9D, 0x01, 0x01, 0x00, 0xFE, 0xFF, 0x00, 0x8D, 0xEF,
+		0x02, 0xD2, 0x01, 0x00, 0x00, 0x00
 	};
 	unsigned char out[] = { 0xFF };
 	unsigned int dlen = 1;
 	int res;
 
-	res = tinf_zlib_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+	res = tinf_gzip_uncompress(out, &dlen, data, ARRAY_SIZE(data));
 
 	ASSERT(res == TINF_OK && dlen == 1 && out[0] == 0);
 
 	PASS();
 }
 
-TEST zlib_zeroes(void)
+TEST gzip_fextra(void)
 {
-	/* 256 zero bytes, to test unrolling in Adler-32 */
+	/* One byte 00, uncompressed, fextra */
 	static const unsigned char data[] = {
-		0x78, 0x9C, 0x63, 0x60, 0x18, 0xD9, 0x00, 0x00, 0x01, 0x00,
-		0x00, 0x01
+		0x1F, 0x8B, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0B,
+		0x04, 0x00, 0x64, 0x61, 0x74, 0x61, 0x01, 0x01, 0x00, 0xFE,
+		0xFF, 0x00, 0x8D, 0xEF, 0x02, 0xD2, 0x01, 0x00, 0x00, 0x00
 	};
-	unsigned char out[256];
-	unsigned int dlen = ARRAY_SIZE(out);
+	unsigned char out[] = { 0xFF };
+	unsigned int dlen = 1;
+	int res;
+
+	res = tinf_gzip_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+
+	ASSERT(res == TINF_OK && dlen == 1 && out[0] == 0);
+
+	PASS();
+}
+
+TEST gzip_fname(void)
+{
+	/* One byte 00, uncompressed, fname */
+	static const unsigned char data[] = {
+		0x1F, 0x8B, 0x08, 0x08, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0B,
+		0x66, 0x6F, 0x6F, 0x2E, 0x63, 0x00, 0x01, 0x01, 0x00, 0xFE,
+		0xFF, 0x00, 0x8D, 0xEF, 0x02, 0xD2, 0x01, 0x00, 0x00, 0x00
+	};
+	unsigned char out[] = { 0xFF };
+	unsigned int dlen = 1;
+	int res;
+
+	res = tinf_gzip_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+
+	ASSERT(res == TINF_OK && dlen == 1 && out[0] == 0);
+
+	PASS();
+}
+
+TEST gzip_fcomment(void)
+{
+	/* One byte 00, uncompressed, fcomment */
+	static const unsigned char data[] = {
+		0x1F, 0x8B, 0x08, 0x10, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0B,
+		0x68, 0x65, 0x6C, 0x6C, 0x6F, 0x00, 0x01, 0x01, 0x00, 0xFE,
+		0xFF, 0x00, 0x8D, 0xEF, 0x02, 0xD2, 0x01, 0x00, 0x00, 0x00
+	};
+	unsigned char out[] = { 0xFF };
+	unsigned int dlen = 1;
+	int res;
+
+	res = tinf_gzip_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+
+	ASSERT(res == TINF_OK && dlen == 1 && out[0] == 0);
+
+	PASS();
+}
+
+/* Test tinf_gzip_uncompress_z treats size in trailer as a lower bound */
+TEST gzip_isize_bound(void)
+{
+	/* One byte 00, fixed Huffman, ISIZE 0 as if size was 2^32 + 1 */
+	static const unsigned char data[] = {
+		0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0B,
+		0x63, 0x00, 0x00, 0x8D, 0xEF, 0x02, 0xD2, 0x00, 0x00, 0x00,
+		0x00
+	};
+	unsigned char out[] = { 0xFF };
+	size_t dlen = 0;
+	int res;
+
+	res = tinf_gzip_uncompress_z(out, &dlen, data, ARRAY_SIZE(data));
+
+	ASSERT_EQ(TINF_BUF_ERROR, res);
+
+	/* Size 1 does not match ISIZE 0 modulo 2^32 */
+	dlen = 1;
+
+	res = tinf_gzip_uncompress_z(out, &dlen, data, ARRAY_SIZE(data));
+
+	ASSERT_EQ(TINF_DATA_ERROR, res);
+
+	PASS();
+}
+
+/* Test tinf_gzip_uncompress_parallel on data with full flush sync points */
+TEST gzip_parallel(void)
+{
+	static const unsigned char header[] = {
+		0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0B
+	};
+	unsigned char *data, *expect, *out;
+	unsigned int len, expectLen, maxLen;
+	int threads;
+
+	maxLen = FLUSHED_SEGMENTS * (2 * FLUSHED_SEGLEN + 1024);
+
+	data = (unsigned char *) malloc(maxLen);
+	expect = (unsigned char *) malloc(maxLen);
+	out = (unsigned char *) malloc(maxLen);
+
+	ASSERT(data != NULL && expect != NULL && out != NULL);
+
+	memcpy(data, header, ARRAY_SIZE(header));
+
+	len = ARRAY_SIZE(header);
+	len += make_flushed_deflate(data + len, expect, &expectLen,
+	                            FLUSHED_SEGMENTS, FLUSHED_SEGLEN);
+
+	write_le32(data + len, tinf_crc32(expect, expectLen));
+	write_le32(data + len + 4, expectLen);
+	len += 8;
+
+	for (threads = 1; threads <= 8; threads *= 2) {
+		size_t dlen = maxLen;
+		int res;
+
+		memset(out, 0, maxLen);
+
+		res = tinf_gzip_uncompress_parallel(out, &dlen, data, len, threads);
+
+		ASSERT_EQ(TINF_OK, res);
+		ASSERT_EQ(expectLen, dlen);
+		ASSERT_MEM_EQ(expect, out, expectLen);
+
+		/* Output one byte too small */
+		dlen = expectLen - 1;
+
+		res = tinf_gzip_uncompress_parallel(out, &dlen, data, len, threads);
+
+		ASSERT_EQ(TINF_BUF_ERROR, res);
+	}
+
+	/* Corrupt checksum */
+	data[len - 8] ^= 1;
+
+	{
+		size_t dlen = maxLen;
+
+		ASSERT(tinf_gzip_uncompress_parallel(out, &dlen, data, len, 4) != TINF_OK);
+	}
+
+	free(data);
+	free(expect);
+	free(out);
+
+	PASS();
+}
+
+/* Test tinf_gzip_uncompress_members on BGZF and plain members */
+TEST gzip_members(void)
+{
+	static unsigned char data[64 * 1024];
+	static unsigned char expect[64 * 1024];
+	static unsigned char out[64 * 1024];
+	unsigned char deflate[2048];
+	unsigned int len = 0, expectLen = 0;
+	int i, threads;
+
+	for (i = 0; i < 40; ++i) {
+		unsigned int dlen;
+		unsigned int deflateLen;
+
+		deflateLen = make_flushed_deflate(deflate, expect + expectLen,
+		                                  &dlen, 1 + i % 2, 50 + 7 * i);
+
+		/* Every fifth member is a plain gzip member */
+		len += make_gzip_member(data + len, deflate, deflateLen,
+		                        expect + expectLen, dlen, i % 5 != 2);
+		expectLen += dlen;
+	}
+
+	for (threads = 1; threads <= 8; threads *= 2) {
+		size_t dlen = ARRAY_SIZE(out);
+		int res;
+
+		memset(out, 0, ARRAY_SIZE(out));
+
+		res = tinf_gzip_uncompress_members(out, &dlen, data, len, threads);
+
+		ASSERT_EQ(TINF_OK, res);
+		ASSERT_EQ(expectLen, dlen);
+		ASSERT_MEM_EQ(expect, out, expectLen);
+	}
+
+	/* Not enough room for output */
+	{
+		size_t dlen = expectLen - 1;
+
+		ASSERT_EQ(TINF_BUF_ERROR,
+		          tinf_gzip_uncompress_members(out, &dlen, data, len, 4));
+	}
+
+	/* Trailing garbage */
+	{
+		size_t dlen = ARRAY_SIZE(out);
+
+		ASSERT(tinf_gzip_uncompress_members(out, &dlen, data, len + 1, 4)
+		       != TINF_OK);
+	}
+
+	/* Corrupt data in a BGZF member */
+	data[30] ^= 0x10;
+
+	{
+		size_t dlen = ARRAY_SIZE(out);
+
+		ASSERT(tinf_gzip_uncompress_members(out, &dlen, data, len, 4)
+		       != TINF_OK);
+	}
+
+	PASS();
+}
+
+/* Test tinf_gzip_uncompress_spans checks the CRC32 over spans of source */
+TEST gzip_spans(void)
+{
+	unsigned char deflate[512];
+	unsigned char data[512];
+	unsigned char expect[512];
+	unsigned char out[512];
+	struct tinf_span spans[8];
+	unsigned int len, expectLen;
+	size_t dlen, num;
+
+	len = make_stored_deflate(deflate, expect, &expectLen);
+	len = make_gzip_member(data, deflate, len, expect, expectLen, 0);
+
+	dlen = ARRAY_SIZE(buffer);
+	num = ARRAY_SIZE(spans);
+
+	ASSERT_EQ(TINF_OK, tinf_gzip_uncompress_spans(buffer, &dlen, data, len,
+	                                              spans, &num));
+	ASSERT_EQ(expectLen, dlen);
+	ASSERT_EQ(4, num);
+	ASSERT(spans[0].data > data && spans[0].data < data + len);
+	ASSERT_EQ(expectLen, join_spans(out, spans, num));
+	ASSERT_MEM_EQ(expect, out, expectLen);
+
+	/* Corrupt stored data */
+	data[len - 30] ^= 1;
+	num = ARRAY_SIZE(spans);
+
+	ASSERT_EQ(TINF_DATA_ERROR, tinf_gzip_uncompress_spans(buffer, &dlen,
+	                                                      data, len,
+	                                                      spans, &num));
+
+	PASS();
+}
+
+/* Test tinf_gzip_uncompress_limited checks ISIZE against the limit */
+TEST gzip_limited(void)
+{
+	struct tinf_limits limits;
+	unsigned char *deflate, *data, *out;
+	unsigned int deflateLen, len, outLen;
+	size_t dlen;
+
+	outLen = 1 + 258 * 1000;
+
+	deflate = (unsigned char *) malloc(2000);
+	data = (unsigned char *) malloc(2000);
+	out = (unsigned char *) calloc(outLen, 1);
+
+	ASSERT(deflate != NULL && data != NULL && out != NULL);
+
+	deflateLen = make_bomb_deflate(deflate, 1000);
+	len = make_gzip_member(data, deflate, deflateLen, out, outLen, 0);
+
+	memset(&limits, 0, sizeof(limits));
+	limits.max_ratio = 200;
+
+	dlen = outLen;
+	ASSERT_EQ(TINF_OK, tinf_gzip_uncompress_limited(out, &dlen, data, len,
+	                                                &limits));
+	ASSERT_EQ(outLen, dlen);
+
+	/* Rejected from the trailer, before decompressing */
+	limits.max_output = outLen - 1;
+
+	dlen = outLen;
+	ASSERT_EQ(TINF_LIMIT_ERROR, tinf_gzip_uncompress_limited(out, &dlen,
+	                                                         data, len,
+	                                                         &limits));
+
+	limits.max_output = 0;
+	limits.max_ratio = 100;
+
+	dlen = outLen;
+	ASSERT_EQ(TINF_LIMIT_ERROR, tinf_gzip_uncompress_limited(out, &dlen,
+	                                                         data, len,
+	                                                         &limits));
+
+	free(deflate);
+	free(data);
+	free(out);
+
+	PASS();
+}
+
+/* Test tinf_gzip_uncompress_sink */
+TEST gzip_sink(void)
+{
+	unsigned char *data, *expect, *window;
+	unsigned int len, expectLen, maxLen;
+	struct sink_buffer sb;
+
+	maxLen = FLUSHED_SEGMENTS * (2 * FLUSHED_SEGLEN + 1024);
+
+	data = (unsigned char *) malloc(maxLen);
+	expect = (unsigned char *) malloc(maxLen);
+	sb.data = (unsigned char *) malloc(maxLen);
+	window = (unsigned char *) malloc(TINF_WINDOW_MIN);
+
+	ASSERT(data != NULL && expect != NULL && sb.data != NULL
+	       && window != NULL);
+
+	/* Deflate data is placed in the sink buffer until it is needed */
+	len = make_flushed_deflate(sb.data, expect, &expectLen,
+	                           FLUSHED_SEGMENTS, FLUSHED_SEGLEN);
+	len = make_gzip_member(data, sb.data, len, expect, expectLen, 0);
+
+	sb.max = maxLen;
+	sb.len = 0;
+	sb.calls = 0;
+	sb.fail_at = 0;
+
+	ASSERT_EQ(TINF_OK, tinf_gzip_uncompress_sink(sink_append, &sb, data, len,
+	                                          window, TINF_WINDOW_MIN));
+
+	ASSERT_EQ(expectLen, sb.len);
+	ASSERT_MEM_EQ(expect, sb.data, expectLen);
+
+	/* Corrupt checksum */
+	data[len - 8] ^= 1;
+
+	sb.len = 0;
+
+	ASSERT_EQ(TINF_DATA_ERROR, tinf_gzip_uncompress_sink(sink_append, &sb,
+	                                                  data, len, window,
+	                                                  TINF_WINDOW_MIN));
+
+	free(data);
+	free(expect);
+	free(sb.data);
+	free(window);
+
+	PASS();
+}
+
+/* Test tinf_gzip_uncompress on compressed data with errors */
+TEST gzip_error_case(const void *closure)
+{
+	const struct packed_data *pd = (const struct packed_data *) closure;
 	int res;
+
+	unsigned int size = pd->depacked_size;
+	res = tinf_gzip_uncompress(buffer, &size, pd->data, pd->src_size);
+
+	ASSERT(res != TINF_OK);
+
+	PASS();
+}
+
+SUITE(tinfgzip)
+{
+	char suffix[32];
+	size_t i;
+
+	RUN_TEST(gzip_empty_raw);
+	RUN_TEST(gzip_empty_fixed);
+	RUN_TEST(gzip_empty_dynamic);
+
+	RUN_TEST(gzip_onebyte_raw);
+	RUN_TEST(gzip_onebyte_fixed);
+	RUN_TEST(gzip_onebyte_dynamic);
+
+	RUN_TEST(gzip_fhcrc);
+	RUN_TEST(gzip_fextra);
+	RUN_TEST(gzip_fname);
+	RUN_TEST(gzip_fcomment);
+
+	RUN_TEST(gzip_isize_bound);
+	RUN_TEST(gzip_parallel);
+	RUN_TEST(gzip_members);
+	RUN_TEST(gzip_sink);
+	RUN_TEST(gzip_spans);
+	RUN_TEST(gzip_limited);
+
+	for (i = 0; i < ARRAY_SIZE(gzip_errors); ++i) {
+		sprintf(suffix, "%d", (int) i);
+		greatest_set_test_suffix(suffix);
+		RUN_TEST1(gzip_error_case, &gzip_errors[i]);
+	}
+}
+
+/* tinfzip */
+
+struct zip_test_entry {
+	const char *name;
+	unsigned int method;
+	const unsigned char *data;
+	unsigned int compressed_size;
+	const unsigned char *expect;
+	unsigned int size;
+};
+
+/*
+ * Write a zip archive containing `num` entries. If `zip64` is set, all
+ * sizes and offsets are stored in Zip64 fields.
+ */
+static unsigned int make_zip(unsigned char *out,
+                             const struct zip_test_entry *entries, int num,
+                             int zip64)
+{
+	unsigned int offs[8];
+	unsigned char *p = out;
+	unsigned int cdir_offs, cdir_size;
+	int i;
+
+	for (i = 0; i < num; ++i) {
+		const struct zip_test_entry *e = &entries[i];
+		unsigned int name_len = (unsigned int) strlen(e->name);
+
+		offs[i] = p - out;
+
+		write_le32(p, 0x04034B50);
+		write_le16(p + 4, 20);
+		write_le16(p + 6, 0);
+		write_le16(p + 8, e->method);
+		write_le32(p + 10, 0);
+		write_le32(p + 14, tinf_crc32(e->expect, e->size));
+		write_le32(p + 18, e->compressed_size);
+		write_le32(p + 22, e->size);
+		write_le16(p + 26, name_len);
+		write_le16(p + 28, 0);
+		memcpy(p + 30, e->name, name_len);
+		p += 30 + name_len;
+
+		memcpy(p, e->data, e->compressed_size);
+		p += e->compressed_size;
+	}
+
+	cdir_offs = p - out;
+
+	for (i = 0; i < num; ++i) {
+		const struct zip_test_entry *e = &entries[i];
+		unsigned int name_len = (unsigned int) strlen(e->name);
+
+		write_le32(p, 0x02014B50);
+		write_le16(p + 4, zip64 ? 45 : 20);
+		write_le16(p + 6, zip64 ? 45 : 20);
+		write_le16(p + 8, 0);
+		write_le16(p + 10, e->method);
+		write_le32(p + 12, 0);
+		write_le32(p + 16, tinf_crc32(e->expect, e->size));
+		write_le32(p + 20, zip64 ? 0xFFFFFFFF : e->compressed_size);
+		write_le32(p + 24, zip64 ? 0xFFFFFFFF : e->size);
+		write_le16(p + 28, name_len);
+		write_le16(p + 30, zip64 ? 32 : 0);
+		write_le16(p + 32, 0);
+		write_le16(p + 34, 0);
+		write_le16(p + 36, 0);
+		write_le32(p + 38, 0);
+		write_le32(p + 42, zip64 ? 0xFFFFFFFF : offs[i]);
+		memcpy(p + 46, e->name, name_len);
+		p += 46 + name_len;
+
+		if (zip64) {
+			/* Unrelated extra field followed by Zip64 extra field */
+			write_le16(p, 0x5455);
+			write_le16(p + 2, 0);
+			write_le16(p + 4, 0x0001);
+			write_le16(p + 6, 24);
+			write_le64(p + 8, e->size);
+			write_le64(p + 16, e->compressed_size);
+			write_le64(p + 24, offs[i]);
+			p += 32;
+		}
+	}
+
+	cdir_size = (p - out) - cdir_offs;
+
+	if (zip64) {
+		unsigned int eocd64_offs = p - out;
+
+		write_le32(p, 0x06064B50);
+		write_le64(p + 4, 44);
+		write_le16(p + 12, 45);
+		write_le16(p + 14, 45);
+		write_le32(p + 16, 0);
+		write_le32(p + 20, 0);
+		write_le64(p + 24, num);
+		write_le64(p + 32, num);
+		write_le64(p + 40, cdir_size);
+		write_le64(p + 48, cdir_offs);
+		p += 56;
+
+		write_le32(p, 0x07064B50);
+		write_le32(p + 4, 0);
+		write_le64(p + 8, eocd64_offs);
+		write_le32(p + 16, 1);
+		p += 20;
+	}
+
+	write_le32(p, 0x06054B50);
+	write_le16(p + 4, 0);
+	write_le16(p + 6, 0);
+	write_le16(p + 8, zip64 ? 0xFFFF : num);
+	write_le16(p + 10, zip64 ? 0xFFFF : num);
+	write_le32(p + 12, zip64 ? 0xFFFFFFFF : cdir_size);
+	write_le32(p + 16, zip64 ? 0xFFFFFFFF : cdir_offs);
+	write_le16(p + 20, 2);
+	p[22] = 'h';
+	p[23] = 'i';
+	p += 24;
+
+	return p - out;
+}
+
+static unsigned char zip_deflated[4096];
+static unsigned char zip_expect[4096];
+static struct zip_test_entry zip_test_entries[3];
+
+static void make_zip_test_entries(void)
+{
+	static const unsigned char stored[] = "stored entry";
+	unsigned int len, dlen;
+
+	len = make_flushed_deflate(zip_deflated, zip_expect, &dlen, 2, 1000);
+
+	zip_test_entries[0].name = "deflated.bin";
+	zip_test_entries[0].method = 8;
+	zip_test_entries[0].data = zip_deflated;
+	zip_test_entries[0].compressed_size = len;
+	zip_test_entries[0].expect = zip_expect;
+	zip_test_entries[0].size = dlen;
+
+	zip_test_entries[1].name = "dir/stored.txt";
+	zip_test_entries[1].method = 0;
+	zip_test_entries[1].data = stored;
+	zip_test_entries[1].compressed_size = sizeof(stored) - 1;
+	zip_test_entries[1].expect = stored;
+	zip_test_entries[1].size = sizeof(stored) - 1;
+
+	zip_test_entries[2].name = "empty";
+	zip_test_entries[2].method = 0;
+	zip_test_entries[2].data = stored;
+	zip_test_entries[2].compressed_size = 0;
+	zip_test_entries[2].expect = stored;
+	zip_test_entries[2].size = 0;
+}
+
+/* Test reading directory and extracting entries one at a time */
+TEST zip_read(const void *closure)
+{
+	const int zip64 = *(const int *) closure;
+	static unsigned char archive[8192];
+	struct tinf_zip_entry entries[3];
+	unsigned int len;
+	size_t count = 0;
 	size_t i;
+	int res;
+
+	len = make_zip(archive, zip_test_entries, 3, zip64);
+
+	res = tinf_zip_read_directory(NULL, &count, archive, len);
+
+	ASSERT_EQ(TINF_BUF_ERROR, res);
+	ASSERT_EQ(3, count);
+
+	res = tinf_zip_read_directory(entries, &count, archive, len);
+
+	ASSERT_EQ(TINF_OK, res);
+	ASSERT_EQ(3, count);
+
+	for (i = 0; i < count; ++i) {
+		const struct zip_test_entry *e = &zip_test_entries[i];
+
+		ASSERT_EQ(strlen(e->name), entries[i].name_len);
+		ASSERT_MEM_EQ(e->name, entries[i].name, entries[i].name_len);
+		ASSERT_EQ(e->size, entries[i].size);
+		ASSERT_EQ(e->compressed_size, entries[i].compressed_size);
+
+		res = tinf_zip_uncompress(buffer, ARRAY_SIZE(buffer), archive,
+		                          len, &entries[i]);
+
+		ASSERT_EQ(TINF_OK, res);
+		ASSERT_MEM_EQ(e->expect, buffer, e->size);
+
+		if (e->size > 0) {
+			res = tinf_zip_uncompress(buffer, e->size - 1, archive,
+			                          len, &entries[i]);
+
+			ASSERT_EQ(TINF_BUF_ERROR, res);
+		}
+	}
+
+	/* Corrupt data of stored entry so CRC32 does not match */
+	archive[entries[1].offset + 30 + entries[1].name_len] ^= 1;
 
-	memset(out, 0xFF, ARRAY_SIZE(out));
+	res = tinf_zip_uncompress(buffer, ARRAY_SIZE(buffer), archive, len,
+	                          &entries[1]);
 
-	res = tinf_zlib_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+	ASSERT_EQ(TINF_DATA_ERROR, res);
 
-	ASSERT(res == TINF_OK && dlen == ARRAY_SIZE(out));
+	/* Truncated archive */
+	for (i = 1; i < 64; ++i) {
+		count = ARRAY_SIZE(entries);
 
-	for (i = 0; i < ARRAY_SIZE(out); ++i) {
-		if (out[i]) {
-			FAIL();
-		}
+		res = tinf_zip_read_directory(entries, &count, archive, len - i);
+
+		ASSERT(res != TINF_OK);
 	}
 
 	PASS();
 }
 
-/* Test tinf_zlib_uncompress on compressed data with errors */
-TEST zlib_error_case(const void *closure)
+/* Test extracting all entries in parallel */
+TEST zip_uncompress_all(void)
 {
-	const struct packed_data *pd = (const struct packed_data *) closure;
+	static unsigned char archive[8192];
+	static unsigned char out[2][4096];
+	struct tinf_zip_entry entries[3];
+	void *dests[3];
+	int results[3];
+	unsigned int len;
+	size_t count = ARRAY_SIZE(entries);
+	int threads;
 	int res;
 
-	unsigned int size = pd->depacked_size;
-	res = tinf_zlib_uncompress(buffer, &size, pd->data, pd->src_size);
+	len = make_zip(archive, zip_test_entries, 3, 0);
+
+	res = tinf_zip_read_directory(entries, &count, archive, len);
+
+	ASSERT_EQ(TINF_OK, res);
+
+	for (threads = 1; threads <= 4; ++threads) {
+		dests[0] = out[0];
+		dests[1] = out[1];
+		dests[2] = NULL;
+
+		res = tinf_zip_uncompress_all(dests, results, archive, len,
+		                              entries, count, threads);
+
+		ASSERT_EQ(TINF_OK, res);
+		ASSERT_MEM_EQ(zip_test_entries[0].expect, out[0], entries[0].size);
+		ASSERT_MEM_EQ(zip_test_entries[1].expect, out[1], entries[1].size);
+	}
+
+	/* Corrupt data of deflated entry */
+	archive[30 + entries[0].name_len] ^= 0x06;
+
+	res = tinf_zip_uncompress_all(dests, results, archive, len, entries,
+	                              count, 2);
 
 	ASSERT(res != TINF_OK);
+	ASSERT(results[0] != TINF_OK);
+	ASSERT_EQ(TINF_OK, results[1]);
 
 	PASS();
 }
 
-SUITE(tinfzlib)
+SUITE(tinfzip)
 {
-	char suffix[32];
-	size_t i;
+	static const int zip64[] = { 0, 1 };
 
-	RUN_TEST(zlib_empty_raw);
-	RUN_TEST(zlib_empty_fixed);
-	RUN_TEST(zlib_empty_dynamic);
+	make_zip_test_entries();
 
-	RUN_TEST(zlib_onebyte_raw);
-	RUN_TEST(zlib_onebyte_fixed);
-	RUN_TEST(zlib_onebyte_dynamic);
-	RUN_TEST(zlib_zeroes);
+	greatest_set_test_suffix("zip32");
+	RUN_TEST1(zip_read, &zip64[0]);
+	greatest_set_test_suffix("zip64");
+	RUN_TEST1(zip_read, &zip64[1]);
 
-	for (i = 0; i < ARRAY_SIZE(zlib_errors); ++i) {
-		sprintf(suffix, "%d", (int) i);
-		greatest_set_test_suffix(suffix);
-		RUN_TEST1(zlib_error_case, &zlib_errors[i]);
-	}
+	RUN_TEST(zip_uncompress_all);
 }
 
-/* tinfgzip */
+/* tinfpar */
 
-TEST gzip_empty_raw(void)
+/* Test tinf_batch_uncompress on many small jobs of different formats */
+TEST batch_uncompress(void)
 {
-	/* Empty buffer, uncompressed */
-	static const unsigned char data[] = {
+	static const unsigned char deflate_data[] = {
+		0x63, 0x00, 0x00
+	};
+	static const unsigned char zlib_data[] = {
+		0x78, 0x9C, 0x63, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01
+	};
+	static const unsigned char gzip_data[] = {
 		0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0B,
-		0x01, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00
+		0x63, 0x00, 0x00, 0x8D, 0xEF, 0x02, 0xD2, 0x01, 0x00, 0x00,
+		0x00
 	};
-	unsigned int dlen = 0;
-	int res;
+	static struct tinf_batch_job jobs[3000];
+	static unsigned char out[3000];
+	int threads;
+	size_t i;
 
-	res = tinf_gzip_uncompress((void *) robuffer, &dlen, data, ARRAY_SIZE(data));
+	for (threads = 1; threads <= 8; threads *= 2) {
+		int res;
+
+		for (i = 0; i < ARRAY_SIZE(jobs); ++i) {
+			jobs[i].format = (int) (i % 3);
+			switch (jobs[i].format) {
+			case TINF_FORMAT_DEFLATE:
+				jobs[i].source = deflate_data;
+				jobs[i].source_len = ARRAY_SIZE(deflate_data);
+				break;
+			case TINF_FORMAT_ZLIB:
+				jobs[i].source = zlib_data;
+				jobs[i].source_len = ARRAY_SIZE(zlib_data);
+				break;
+			default:
+				jobs[i].source = gzip_data;
+				jobs[i].source_len = ARRAY_SIZE(gzip_data);
+				break;
+			}
+			jobs[i].dest = &out[i];
+			jobs[i].dest_len = 1;
+			jobs[i].result = 42;
+			out[i] = 0xFF;
+		}
 
-	ASSERT(res == TINF_OK && dlen == 0);
+		res = tinf_batch_uncompress(jobs, ARRAY_SIZE(jobs), threads);
 
-	PASS();
-}
+		ASSERT_EQ(TINF_OK, res);
 
-TEST gzip_empty_fixed(void)
-{
-	/* Empty buffer, fixed Huffman */
-	static const unsigned char data[] = {
-		0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0B,
-		0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-	};
-	unsigned int dlen = 0;
-	int res;
+		for (i = 0; i < ARRAY_SIZE(jobs); ++i) {
+			ASSERT_EQ(TINF_OK, jobs[i].result);
+			ASSERT_EQ(1, jobs[i].dest_len);
+			ASSERT_EQ(0, out[i]);
+		}
 
-	res = tinf_gzip_uncompress((void *) robuffer, &dlen, data, ARRAY_SIZE(data));
+		/* One job without room for output */
+		jobs[1234].dest_len = 0;
 
-	ASSERT(res == TINF_OK && dlen == 0);
+		res = tinf_batch_uncompress(jobs, ARRAY_SIZE(jobs), threads);
+
+		ASSERT(res != TINF_OK);
+		ASSERT(jobs[1234].result != TINF_OK);
+		ASSERT_EQ(TINF_OK, jobs[1233].result);
+		ASSERT_EQ(TINF_OK, jobs[1235].result);
+	}
 
 	PASS();
 }
 
-TEST gzip_empty_dynamic(void)
+/* Test tinf_batch_uncompress splits a large job mixed with small ones */
+TEST batch_mixed_sizes(void)
 {
-	/* Empty buffer, dynamic Huffman */
-	static const unsigned char data[] = {
-		0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0B,
-		0x05, 0xC1, 0x81, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0xFF,
-		0xD5, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+	static const unsigned char zlib_data[] = {
+		0x78, 0x9C, 0x63, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01
 	};
-	unsigned int dlen = 0;
-	int res;
+	static struct tinf_batch_job jobs[1001];
+	static unsigned char small_out[1000];
+	unsigned char *data, *expect, *out;
+	unsigned int len, expectLen, maxLen;
+	int threads;
+	size_t i;
 
-	res = tinf_gzip_uncompress((void *) robuffer, &dlen, data, ARRAY_SIZE(data));
+	maxLen = 2 * FLUSHED_SEGMENTS * (2 * FLUSHED_SEGLEN + 1024);
 
-	ASSERT(res == TINF_OK && dlen == 0);
+	data = (unsigned char *) malloc(maxLen);
+	expect = (unsigned char *) malloc(maxLen);
+	out = (unsigned char *) malloc(maxLen);
 
-	PASS();
-}
+	ASSERT(data != NULL && expect != NULL && out != NULL);
 
-TEST gzip_onebyte_raw(void)
-{
-	/* One byte 00, uncompressed */
-	static const unsigned char data[] = {
-		0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0B,
-		0x01, 0x01, 0x00, 0xFE, 0xFF, 0x00, 0x8D, 0xEF, 0x02, 0xD2,
-		0x01, 0x00, 0x00, 0x00
-	};
-	unsigned char out[] = { 0xFF };
-	unsigned int dlen = 1;
-	int res;
+	len = make_flushed_deflate(data, expect, &expectLen,
+	                           2 * FLUSHED_SEGMENTS, FLUSHED_SEGLEN);
 
-	res = tinf_gzip_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+	/* Large enough to be split */
+	ASSERT(len >= 1024 * 1024);
 
-	ASSERT(res == TINF_OK && dlen == 1 && out[0] == 0);
+	for (threads = 1; threads <= 8; threads *= 2) {
+		for (i = 0; i < ARRAY_SIZE(jobs); ++i) {
+			if (i == 500) {
+				jobs[i].format = TINF_FORMAT_DEFLATE;
+				jobs[i].source = data;
+				jobs[i].source_len = len;
+				jobs[i].dest = out;
+				jobs[i].dest_len = maxLen;
+				continue;
+			}
 
-	PASS();
-}
+			jobs[i].format = TINF_FORMAT_ZLIB;
+			jobs[i].source = zlib_data;
+			jobs[i].source_len = ARRAY_SIZE(zlib_data);
+			jobs[i].dest = &small_out[i < 500 ? i : i - 1];
+			jobs[i].dest_len = 1;
+		}
 
-TEST gzip_onebyte_fixed(void)
-{
-	/* One byte 00, fixed Huffman */
-	static const unsigned char data[] = {
-		0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0B,
-		0x63, 0x00, 0x00, 0x8D, 0xEF, 0x02, 0xD2, 0x01, 0x00, 0x00,
-		0x00
-	};
-	unsigned char out[] = { 0xFF };
-	unsigned int dlen = 1;
-	int res;
+		memset(out, 0, maxLen);
 
-	res = tinf_gzip_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+		ASSERT_EQ(TINF_OK, tinf_batch_uncompress(jobs, ARRAY_SIZE(jobs),
+		                                         threads));
 
-	ASSERT(res == TINF_OK && dlen == 1 && out[0] == 0);
+		ASSERT_EQ(expectLen, jobs[500].dest_len);
+		ASSERT_MEM_EQ(expect, out, expectLen);
+
+		for (i = 0; i < ARRAY_SIZE(jobs); ++i) {
+			ASSERT_EQ(TINF_OK, jobs[i].result);
+		}
+	}
+
+	free(data);
+	free(expect);
+	free(out);
 
 	PASS();
 }
 
-TEST gzip_onebyte_dynamic(void)
+SUITE(tinfpar)
 {
-	/* One byte 00, dynamic Huffman */
-	static const unsigned char data[] = {
-		0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0B,
-		0x05, 0xC1, 0x81, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0xFF,
-		0xD5, 0x10, 0x8D, 0xEF, 0x02, 0xD2, 0x01, 0x00, 0x00, 0x00
-	};
-	unsigned char out[] = { 0xFF };
-	unsigned int dlen = 1;
-	int res;
+	RUN_TEST(batch_uncompress);
+	RUN_TEST(batch_mixed_sizes);
+}
 
-	res = tinf_gzip_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+/* tinfalloc */
 
-	ASSERT(res == TINF_OK && dlen == 1 && out[0] == 0);
+struct counting_allocator {
+	int allocs;
+	int frees;
+};
 
-	PASS();
+static void *TINFCC counting_alloc(void *opaque, size_t size)
+{
+	((struct counting_allocator *) opaque)->allocs++;
+
+	return malloc(size);
 }
 
-TEST gzip_fhcrc(void)
+static void *TINFCC counting_resize(void *opaque, void *ptr, size_t size)
 {
-	/* One byte 00, uncompressed, fhcrc */
-	static const unsigned char data[] = {
-		0x1F, 0x8B, 0x08, 0x02, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0B,
-		0x17, 0x9D, 0x01, 0x01, 0x00, 0xFE, 0xFF, 0x00, 0x8D, 0xEF,
-		0x02, 0xD2, 0x01, 0x00, 0x00, 0x00
-	};
-	unsigned char out[] = { 0xFF };
-	unsigned int dlen = 1;
-	int res;
+	if (ptr == NULL) {
+		((struct counting_allocator *) opaque)->allocs++;
+	}
 
-	res = tinf_gzip_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+	return realloc(ptr, size);
+}
 
-	ASSERT(res == TINF_OK && dlen == 1 && out[0] == 0);
+static void TINFCC counting_release(void *opaque, void *ptr)
+{
+	((struct counting_allocator *) opaque)->frees++;
 
-	PASS();
+	free(ptr);
 }
 
-TEST gzip_fextra(void)
+/* Make concatenated gzip members with BGZF extra fields */
+static unsigned int make_bgzf_members(unsigned char *data,
+                                      unsigned char *expect,
+                                      unsigned int *expectLen)
 {
-	/* One byte 00, uncompressed, fextra */
-	static const unsigned char data[] = {
-		0x1F, 0x8B, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0B,
-		0x04, 0x00, 0x64, 0x61, 0x74, 0x61, 0x01, 0x01, 0x00, 0xFE,
-		0xFF, 0x00, 0x8D, 0xEF, 0x02, 0xD2, 0x01, 0x00, 0x00, 0x00
-	};
-	unsigned char out[] = { 0xFF };
-	unsigned int dlen = 1;
-	int res;
+	unsigned char deflate[2048];
+	unsigned int len = 0;
+	int i;
 
-	res = tinf_gzip_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+	*expectLen = 0;
 
-	ASSERT(res == TINF_OK && dlen == 1 && out[0] == 0);
+	for (i = 0; i < 10; ++i) {
+		unsigned int dlen;
+		unsigned int deflateLen;
 
-	PASS();
+		deflateLen = make_flushed_deflate(deflate, expect + *expectLen,
+		                                  &dlen, 1, 50 + 7 * i);
+
+		len += make_gzip_member(data + len, deflate, deflateLen,
+		                        expect + *expectLen, dlen, 1);
+		*expectLen += dlen;
+	}
+
+	return len;
 }
 
-TEST gzip_fname(void)
+/* Test memory is allocated through tinf_set_allocator */
+TEST allocator_hooks(void)
 {
-	/* One byte 00, uncompressed, fname */
-	static const unsigned char data[] = {
-		0x1F, 0x8B, 0x08, 0x08, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0B,
-		0x66, 0x6F, 0x6F, 0x2E, 0x63, 0x00, 0x01, 0x01, 0x00, 0xFE,
-		0xFF, 0x00, 0x8D, 0xEF, 0x02, 0xD2, 0x01, 0x00, 0x00, 0x00
-	};
-	unsigned char out[] = { 0xFF };
-	unsigned int dlen = 1;
+	static unsigned char data[16 * 1024];
+	static unsigned char expect[16 * 1024];
+	struct counting_allocator counts = { 0, 0 };
+	struct tinf_allocator allocator;
+	unsigned int len, expectLen;
+	size_t dlen = ARRAY_SIZE(buffer);
 	int res;
 
-	res = tinf_gzip_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+	len = make_bgzf_members(data, expect, &expectLen);
 
-	ASSERT(res == TINF_OK && dlen == 1 && out[0] == 0);
+	allocator.alloc = counting_alloc;
+	allocator.resize = counting_resize;
+	allocator.release = counting_release;
+	allocator.opaque = &counts;
+
+	tinf_set_allocator(&allocator);
+
+	res = tinf_gzip_uncompress_members(buffer, &dlen, data, len, 1);
+
+	tinf_set_allocator(NULL);
+
+	ASSERT_EQ(TINF_OK, res);
+	ASSERT_EQ(expectLen, dlen);
+	ASSERT_MEM_EQ(expect, buffer, expectLen);
+
+	ASSERT(counts.allocs > 0);
+	ASSERT_EQ(counts.allocs, counts.frees);
 
 	PASS();
 }
 
-TEST gzip_fcomment(void)
+TEST arena_alloc(void)
 {
-	/* One byte 00, uncompressed, fcomment */
-	static const unsigned char data[] = {
-		0x1F, 0x8B, 0x08, 0x10, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0B,
-		0x68, 0x65, 0x6C, 0x6C, 0x6F, 0x00, 0x01, 0x01, 0x00, 0xFE,
-		0xFF, 0x00, 0x8D, 0xEF, 0x02, 0xD2, 0x01, 0x00, 0x00, 0x00
-	};
-	unsigned char out[] = { 0xFF };
-	unsigned int dlen = 1;
-	int res;
+	static unsigned char data[16 * 1024];
+	static unsigned char expect[16 * 1024];
+	struct tinf_allocator allocator;
+	struct tinf_arena arena;
+	unsigned char *p, *q, *r;
+	unsigned int len, expectLen;
+	size_t dlen = ARRAY_SIZE(buffer);
+	int flags, res;
+	size_t i;
 
-	res = tinf_gzip_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+	for (flags = 0; flags <= TINF_ARENA_HUGEPAGES; ++flags) {
+		tinf_arena_init(&arena, 4096, flags);
+		tinf_arena_allocator(&arena, &allocator);
 
-	ASSERT(res == TINF_OK && dlen == 1 && out[0] == 0);
+		p = (unsigned char *) allocator.alloc(allocator.opaque, 5);
+		q = (unsigned char *) allocator.alloc(allocator.opaque, 100);
+
+		ASSERT(p != NULL && q != NULL);
+		ASSERT(((size_t) p & 15) == 0 && ((size_t) q & 15) == 0);
+
+		memset(p, 1, 5);
+		memset(q, 2, 100);
+
+		/* Last allocation grows in place */
+		r = (unsigned char *) allocator.resize(allocator.opaque, q, 1000);
+
+		ASSERT(r == q);
+
+		/* Other allocations move */
+		r = (unsigned char *) allocator.resize(allocator.opaque, p, 1000);
+
+		ASSERT(r != NULL && r != p);
+
+		for (i = 0; i < 5; ++i) {
+			ASSERT_EQ(1, r[i]);
+		}
+
+		/* Allocation larger than a slab, also with huge pages */
+		r = (unsigned char *) allocator.alloc(allocator.opaque, 3 * 1024 * 1024);
+
+		ASSERT(r != NULL);
+
+		memset(r, 3, 3 * 1024 * 1024);
+
+		/* The large slab is kept and reused after reset */
+		tinf_arena_reset(&arena);
+
+		p = (unsigned char *) allocator.alloc(allocator.opaque, 3 * 1024 * 1024);
+
+		ASSERT(p == r);
+
+		allocator.release(allocator.opaque, p);
+
+		ASSERT(allocator.alloc(allocator.opaque, 10) == r);
+
+		tinf_arena_destroy(&arena);
+	}
+
+	/* Arena as allocator for decompression */
+	len = make_bgzf_members(data, expect, &expectLen);
+
+	tinf_arena_init(&arena, 64 * 1024, 0);
+	tinf_arena_allocator(&arena, &allocator);
+	tinf_set_allocator(&allocator);
+
+	res = tinf_gzip_uncompress_members(buffer, &dlen, data, len, 1);
+
+	tinf_set_allocator(NULL);
+	tinf_arena_destroy(&arena);
+
+	ASSERT_EQ(TINF_OK, res);
+	ASSERT_EQ(expectLen, dlen);
+	ASSERT_MEM_EQ(expect, buffer, expectLen);
 
 	PASS();
 }
 
-/* Test tinf_gzip_uncompress on compressed data with errors */
-TEST gzip_error_case(const void *closure)
+SUITE(tinfalloc)
 {
-	const struct packed_data *pd = (const struct packed_data *) closure;
-	int res;
+	RUN_TEST(allocator_hooks);
+	RUN_TEST(arena_alloc);
+}
 
-	unsigned int size = pd->depacked_size;
-	res = tinf_gzip_uncompress(buffer, &size, pd->data, pd->src_size);
+/* checksums */
 
-	ASSERT(res != TINF_OK);
+/* Test combining checksums gives checksum of concatenated data */
+TEST checksum_combine(void)
+{
+	unsigned char data[1024];
+	unsigned int split;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(data); ++i) {
+		data[i] = (unsigned char) rand();
+	}
+
+	for (split = 0; split <= ARRAY_SIZE(data); split += 97) {
+		unsigned int len2 = ARRAY_SIZE(data) - split;
+
+		ASSERT_EQ(tinf_adler32(data, ARRAY_SIZE(data)),
+		          tinf_adler32_combine(tinf_adler32(data, split),
+		                               tinf_adler32(data + split, len2),
+		                               len2));
+
+		ASSERT_EQ(tinf_crc32(data, ARRAY_SIZE(data)),
+		          tinf_crc32_combine(tinf_crc32(data, split),
+		                             tinf_crc32(data + split, len2),
+		                             len2));
+	}
 
 	PASS();
 }
 
-SUITE(tinfgzip)
+/* Test size_t versions give the same checksums */
+TEST checksum_z(void)
 {
-	char suffix[32];
+	unsigned char data[1024];
 	size_t i;
 
-	RUN_TEST(gzip_empty_raw);
-	RUN_TEST(gzip_empty_fixed);
-	RUN_TEST(gzip_empty_dynamic);
+	for (i = 0; i < ARRAY_SIZE(data); ++i) {
+		data[i] = (unsigned char) rand();
+	}
 
-	RUN_TEST(gzip_onebyte_raw);
-	RUN_TEST(gzip_onebyte_fixed);
-	RUN_TEST(gzip_onebyte_dynamic);
+	for (i = 0; i <= ARRAY_SIZE(data); i += 31) {
+		ASSERT_EQ(tinf_adler32(data, (unsigned int) i), tinf_adler32_z(data, i));
+		ASSERT_EQ(tinf_crc32(data, (unsigned int) i), tinf_crc32_z(data, i));
+	}
 
-	RUN_TEST(gzip_fhcrc);
-	RUN_TEST(gzip_fextra);
-	RUN_TEST(gzip_fname);
-	RUN_TEST(gzip_fcomment);
+	PASS();
+}
 
-	for (i = 0; i < ARRAY_SIZE(gzip_errors); ++i) {
-		sprintf(suffix, "%d", (int) i);
-		greatest_set_test_suffix(suffix);
-		RUN_TEST1(gzip_error_case, &gzip_errors[i]);
-	}
+SUITE(checksum)
+{
+	RUN_TEST(checksum_combine);
+	RUN_TEST(checksum_z);
 }
 
 GREATEST_MAIN_DEFS();
@@ -893,6 +3804,10 @@ int main(int argc, char *argv[])
 	RUN_SUITE(tinflate);
 	RUN_SUITE(tinfzlib);
 	RUN_SUITE(tinfgzip);
+	RUN_SUITE(tinfzip);
+	RUN_SUITE(tinfpar);
+	RUN_SUITE(tinfalloc);
+	RUN_SUITE(checksum);
 
 	GREATEST_MAIN_END();
 }
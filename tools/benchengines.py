@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+
+# Copyright (c) 2014-2019 Joergen Ibsen
+#
+# Permission is hereby granted, free of charge, to any person obtaining a
+# copy of this software and associated documentation files (the "Software"),
+# to deal in the Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+# THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+# DEALINGS IN THE SOFTWARE.
+
+"""
+Inflate engine benchmark.
+
+Builds tinf with each value of TINF_ENGINE in a subdirectory of the build
+directory, and reports the code size of the inflate engine and the speed
+of decompressing a gzip file with tinfbench.
+"""
+
+import argparse
+import glob
+import os
+import shutil
+import subprocess
+import sys
+
+ENGINES = ('small', 'fast')
+
+
+def code_size(obj):
+    """Return size of code and data of object file, or file size."""
+    if shutil.which('size'):
+        out = subprocess.run(['size', obj], check=True, capture_output=True,
+                             text=True).stdout.splitlines()
+        text, data, bss = (int(v) for v in out[1].split()[:3])
+        return text + data + bss
+    return os.path.getsize(obj)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare inflate engines.')
+    parser.add_argument('infile', help='gzip file to decompress')
+    parser.add_argument('-b', '--build-dir', default='build-engines',
+                        help='directory for builds (default: %(default)s)')
+    parser.add_argument('-r', '--runs', type=int, default=10,
+                        help='number of runs (default: %(default)s)')
+    args = parser.parse_args()
+
+    source_dir = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+    for engine in ENGINES:
+        build = os.path.join(args.build_dir, engine)
+
+        subprocess.run(['cmake', '-S', source_dir, '-B', build,
+                        '-DCMAKE_BUILD_TYPE=Release',
+                        '-DTINF_BUILD_TESTING=OFF',
+                        '-DTINF_ENGINE=' + engine],
+                       check=True, stdout=subprocess.DEVNULL)
+        subprocess.run(['cmake', '--build', build, '--config', 'Release',
+                        '--target', 'tinfbench'],
+                       check=True, stdout=subprocess.DEVNULL)
+
+        objs = [o for o in glob.glob(os.path.join(build, '**', 'tinflate*'),
+                                     recursive=True)
+                if o.endswith(('.o', '.obj'))]
+        exes = glob.glob(os.path.join(build, '**', 'tinfbench*'),
+                         recursive=True)
+        exes = [e for e in exes if os.path.isfile(e) and os.access(e, os.X_OK)]
+
+        if not objs or not exes:
+            sys.exit('benchengines: build output not found in ' + build)
+
+        print('engine {}: tinflate {} bytes'.format(engine,
+                                                    code_size(objs[0])))
+        sys.stdout.flush()
+
+        subprocess.run([exes[0], args.infile, str(args.runs)], check=True)
+
+
+if __name__ == '__main__':
+    main()
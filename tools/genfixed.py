@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+
+# Copyright (c) 2014-2019 Joergen Ibsen
+#
+# Permission is hereby granted, free of charge, to any person obtaining a
+# copy of this software and associated documentation files (the "Software"),
+# to deal in the Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+# THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+# DEALINGS IN THE SOFTWARE.
+
+"""
+Fixed Huffman tree generator.
+
+Writes src/tinffixed.h, which holds the fixed literal/length and distance
+trees of deflate with the lookup tables of the fast engine, so they are
+not built for each block.
+"""
+
+import argparse
+
+FAST_BITS = 9
+
+
+def fixed_lengths():
+    """Return code lengths of fixed literal/length and distance codes."""
+    lit = [8] * 144 + [9] * 112 + [7] * 24 + [8] * 8
+    dist = [5] * 32
+    return lit, dist
+
+
+def build_tree(lengths):
+    """Return counts and symbols sorted by code, as tinf_build_tree does."""
+    counts = [0] * 16
+    for length in lengths:
+        counts[length] += 1
+    counts[0] = 0
+
+    offs = [0] * 16
+    for i in range(1, 16):
+        offs[i] = offs[i - 1] + counts[i - 1]
+
+    symbols = [0] * len(lengths)
+    for sym, length in enumerate(lengths):
+        if length:
+            symbols[offs[length]] = sym
+            offs[length] += 1
+
+    return counts, symbols
+
+
+def build_fast(counts, symbols):
+    """Return lookup table of codes of up to FAST_BITS bits."""
+    fast = [0] * (1 << FAST_BITS)
+    code = idx = 0
+
+    for length in range(1, FAST_BITS + 1):
+        for _ in range(counts[length]):
+            rev = int(format(code, '0{}b'.format(length))[::-1], 2)
+            for j in range(rev, 1 << FAST_BITS, 1 << length):
+                fast[j] = symbols[idx] | (length << 9)
+            idx += 1
+            code += 1
+        code <<= 1
+
+    return fast
+
+
+def c_array(values, per_line):
+    """Return values as the lines of a C array initializer."""
+    lines = []
+    for i in range(0, len(values), per_line):
+        row = ', '.join('{:d}'.format(v) for v in values[i:i + per_line])
+        lines.append('\t\t' + row + (',' if i + per_line < len(values) else ''))
+    return '\n'.join(lines)
+
+
+def c_tree(name, lengths, max_sym):
+    """Return C definition of tree with the given code lengths."""
+    counts, symbols = build_tree(lengths)
+    fast = build_fast(counts, symbols)
+
+    return '\n'.join([
+        'static const struct tinf_tree {} = {{'.format(name),
+        '\t{',
+        c_array(counts, 16),
+        '\t},',
+        '\t{',
+        c_array(symbols, 12),
+        '\t},',
+        '\t{:d}'.format(max_sym),
+        '#if defined(TINF_ENGINE_FAST)',
+        '\t, {',
+        c_array(fast, 10),
+        '\t}, 1',
+        '#endif',
+        '};',
+    ])
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Generate fixed trees.')
+    parser.add_argument('outfile', nargs='?', default='src/tinffixed.h',
+                        help='output file (default: %(default)s)')
+    args = parser.parse_args()
+
+    lit, dist = fixed_lengths()
+
+    with open(args.outfile, 'w', newline='\n') as f:
+        f.write('/*\n'
+                ' * tinffixed.h - fixed Huffman trees of deflate\n'
+                ' *\n'
+                ' * Generated by tools/genfixed.py, do not edit.\n'
+                ' *\n'
+                ' * Included by tinflate.c after struct tinf_tree, the fast'
+                ' tables are for\n'
+                ' * TINF_FAST_BITS = {:d}.\n'
+                ' */\n\n'.format(FAST_BITS))
+        f.write(c_tree('tinf_fixed_ltree', lit, 285) + '\n\n')
+        f.write(c_tree('tinf_fixed_dtree', dist, 29) + '\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,292 @@
+/*
+ * tinfbench - measure decompression speed of a gzip file
+ *
+ * Copyright (c) 2003-2019 Joergen Ibsen
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *   1. The origin of this software must not be misrepresented; you must
+ *      not claim that you wrote the original software. If you use this
+ *      software in a product, an acknowledgment in the product
+ *      documentation would be appreciated but is not required.
+ *
+ *   2. Altered source versions must be plainly marked as such, and must
+ *      not be misrepresented as being the original software.
+ *
+ *   3. This notice may not be removed or altered from any source
+ *      distribution.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(_WIN32)
+#  include <windows.h>
+#else
+#  include <sys/time.h>
+#endif
+
+#include "tinf.h"
+
+#ifndef TINF_ENGINE_NAME
+#  define TINF_ENGINE_NAME "unknown"
+#endif
+
+static const char *const kernel_names[] = { "portable", "bmi2", "avx2" };
+
+/* Number of copies of the input decompressed by a batch */
+#define BATCH_JOBS 64
+
+/* Largest number of threads measured */
+#define MAX_THREADS 64
+
+static unsigned int read_le32(const unsigned char *p)
+{
+	return ((unsigned int) p[0])
+	     | ((unsigned int) p[1] << 8)
+	     | ((unsigned int) p[2] << 16)
+	     | ((unsigned int) p[3] << 24);
+}
+
+/* Wall clock time in seconds, since threads add up in clock() */
+static double wall_time(void)
+{
+#if defined(_WIN32)
+	LARGE_INTEGER freq, count;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+
+	return (double) count.QuadPart / (double) freq.QuadPart;
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return (double) tv.tv_sec + (double) tv.tv_usec / 1e6;
+#endif
+}
+
+static void report(const char *what, int threads, size_t len, size_t dlen,
+                   double best)
+{
+	printf("%s, %2d threads: %lu -> %lu bytes, %.3f ms, %.1f MB/s\n",
+	       what, threads, (unsigned long) len, (unsigned long) dlen,
+	       best * 1000.0, best > 0 ? dlen / best / 1e6 : 0.0);
+}
+
+/*
+ * Decompress source with tinf_gzip_uncompress_parallel, and BATCH_JOBS
+ * copies of it with tinf_batch_uncompress, for 1 to MAX_THREADS threads
+ */
+static int bench_threads(const unsigned char *source, size_t len,
+                         size_t dlen, int runs)
+{
+	struct tinf_batch_job jobs[BATCH_JOBS];
+	unsigned char *dest;
+	int retval = 0;
+	int threads, i, j;
+
+	dest = (unsigned char *) malloc(BATCH_JOBS * (dlen ? dlen : 1));
+
+	if (dest == NULL) {
+		fputs("tinfbench: not enough memory\n", stderr);
+		return 0;
+	}
+
+	for (threads = 1; threads <= MAX_THREADS; threads *= 2) {
+		double best_par = 0, best_batch = 0;
+
+		for (i = 0; i < runs; ++i) {
+			size_t outlen = dlen;
+			double start = wall_time();
+			double secs;
+
+			if (tinf_gzip_uncompress_parallel(dest, &outlen, source, len,
+			                                  threads) != TINF_OK
+			 || outlen != dlen) {
+				fputs("tinfbench: decompression failed\n", stderr);
+				goto out;
+			}
+
+			secs = wall_time() - start;
+
+			if (i == 0 || secs < best_par) {
+				best_par = secs;
+			}
+		}
+
+		for (i = 0; i < runs; ++i) {
+			double start;
+			double secs;
+
+			for (j = 0; j < BATCH_JOBS; ++j) {
+				memset(&jobs[j], 0, sizeof(jobs[j]));
+				jobs[j].format = TINF_FORMAT_GZIP;
+				jobs[j].source = source;
+				jobs[j].source_len = len;
+				jobs[j].dest = dest + (size_t) j * (dlen ? dlen : 1);
+				jobs[j].dest_len = dlen;
+			}
+
+			start = wall_time();
+
+			if (tinf_batch_uncompress(jobs, BATCH_JOBS, threads) != TINF_OK) {
+				fputs("tinfbench: decompression failed\n", stderr);
+				goto out;
+			}
+
+			secs = wall_time() - start;
+
+			if (i == 0 || secs < best_batch) {
+				best_batch = secs;
+			}
+		}
+
+		report("parallel", threads, len, dlen, best_par);
+		report("batch   ", threads, BATCH_JOBS * len, BATCH_JOBS * dlen,
+		       best_batch);
+	}
+
+	retval = 1;
+
+out:
+	free(dest);
+
+	return retval;
+}
+
+int main(int argc, char *argv[])
+{
+	FILE *fin = NULL;
+	unsigned char *source = NULL;
+	unsigned char *dest = NULL;
+	size_t len, dlen;
+	long size;
+	int runs = 10;
+	int threads = 0;
+	int retval = EXIT_FAILURE;
+	int kernel, i;
+
+	if (argc > 1 && strcmp(argv[1], "-t") == 0) {
+		threads = 1;
+		--argc;
+		++argv;
+	}
+
+	if (argc != 2 && argc != 3) {
+		fputs("usage: tinfbench [-t] INFILE [RUNS]\n\n"
+		      "Decompresses the gzip file INFILE RUNS times (default 10), and reports\n"
+		      "the speed of the fastest run with each available decode kernel.\n\n"
+		      "With -t, reports the speed of tinf_gzip_uncompress_parallel on INFILE,\n"
+		      "and of tinf_batch_uncompress on 64 copies of it, for 1 to 64 threads.\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	if (argc == 3) {
+		runs = atoi(argv[2]);
+
+		if (runs < 1) {
+			runs = 1;
+		}
+	}
+
+	/* -- Read source -- */
+
+	if ((fin = fopen(argv[1], "rb")) == NULL) {
+		fprintf(stderr, "tinfbench: unable to open input file '%s'\n", argv[1]);
+		goto out;
+	}
+
+	fseek(fin, 0, SEEK_END);
+
+	size = ftell(fin);
+
+	fseek(fin, 0, SEEK_SET);
+
+	if (size < 18) {
+		fputs("tinfbench: input too small to be gzip\n", stderr);
+		goto out;
+	}
+
+	len = (size_t) size;
+
+	source = (unsigned char *) malloc(len);
+
+	if (source == NULL || fread(source, 1, len, fin) != len) {
+		fputs("tinfbench: error reading input file\n", stderr);
+		goto out;
+	}
+
+	dlen = read_le32(&source[len - 4]);
+
+	dest = (unsigned char *) malloc(dlen ? dlen : 1);
+
+	if (dest == NULL) {
+		fputs("tinfbench: not enough memory\n", stderr);
+		goto out;
+	}
+
+	/* -- Decompress data with each number of threads -- */
+
+	if (threads) {
+		if (bench_threads(source, len, dlen, runs)) {
+			retval = EXIT_SUCCESS;
+		}
+
+		goto out;
+	}
+
+	/* -- Decompress data with each kernel, keeping the fastest run -- */
+
+	for (kernel = TINF_KERNEL_PORTABLE; kernel <= TINF_KERNEL_AVX2; ++kernel) {
+		double best = 0;
+
+		if (tinf_set_kernel(kernel) != kernel) {
+			continue;
+		}
+
+		for (i = 0; i < runs; ++i) {
+			size_t outlen = dlen;
+			clock_t start = clock();
+			double secs;
+
+			if (tinf_gzip_uncompress_z(dest, &outlen, source, len) != TINF_OK
+			 || outlen != dlen) {
+				fputs("tinfbench: decompression failed\n", stderr);
+				goto out;
+			}
+
+			secs = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+			if (i == 0 || secs < best) {
+				best = secs;
+			}
+		}
+
+		printf("engine %s, kernel %s: %lu -> %lu bytes, %.3f ms, %.1f MB/s\n",
+		       TINF_ENGINE_NAME, kernel_names[kernel],
+		       (unsigned long) len, (unsigned long) dlen,
+		       best * 1000.0, best > 0 ? dlen / best / 1e6 : 0.0);
+	}
+
+	retval = EXIT_SUCCESS;
+
+out:
+	if (fin != NULL) {
+		fclose(fin);
+	}
+
+	free(source);
+	free(dest);
+
+	return retval;
+}